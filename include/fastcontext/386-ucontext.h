@@ -17,6 +17,12 @@ int qt_swapctxt(uctxt_t *, uctxt_t *);
 void qt_makectxt(uctxt_t *, void (*)(void), int, ...);
 int qt_getmctxt(mctxt_t *);
 void qt_setmctxt(mctxt_t *);
+#ifdef __x86_64__
+/* Variants that leave MXCSR and the x87 control word alone */
+int qt_swapctxt_lean(uctxt_t *, uctxt_t *);
+int qt_getmctxt_lean(mctxt_t *);
+void qt_setmctxt_lean(mctxt_t *);
+#endif
 
 #ifdef __x86_64__
 typedef uint64_t qt_register_t;
@@ -15,6 +15,7 @@
 #define NEEDX86MAKECONTEXT
 #define NEEDSWAPCONTEXT
 #define NEEDX86REGISTERARGS
+#define NEEDLEANSWAPCONTEXT
 #include "386-ucontext.h"
 #elif ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32) ||                         \
        (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC64))
@@ -1,6 +1,10 @@
 #ifndef MAESTRO_SCHED_H
 #define MAESTRO_SCHED_H
 
+#include <stdint.h>
+
+#include "qt_visibility.h"
+
 enum trigger_type {
   MTT_CORE = 1,
   MTT_SOCKET = 2,
@@ -14,9 +18,18 @@ enum trigger_action {
   MTA_OTHER = 0
 };
 
-void maestro_sched(enum trigger_type type, enum trigger_action action, int val);
-int maestro_allowed_workers(void);
-int maestro_current_workers(int val);
-int64_t maestro_size(void);
+/* Raise or lower the number of workers allowed to run by val, within the
+ * [QT_ELASTIC_MIN, QT_ELASTIC_MAX] range. */
+void INTERNAL maestro_sched(enum trigger_type type,
+                            enum trigger_action action,
+                            int val);
+/* The number of workers currently allowed to run. */
+int INTERNAL maestro_allowed_workers(void);
+/* Allow val workers to run (clamped to the range); returns the new count. */
+int INTERNAL maestro_current_workers(int val);
+/* The number of tasks waiting in the ready queues of active shepherds. */
+int64_t INTERNAL maestro_size(void);
+
+void INTERNAL qt_elastic_subsystem_init(void);
 
 #endif
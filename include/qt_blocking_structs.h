@@ -1,9 +1,11 @@
 #ifndef QT_BLOCKING_STRUCTS_H
 #define QT_BLOCKING_STRUCTS_H
 
+#include <stdatomic.h>
 #include <stdlib.h> /* for malloc() and free() */
 #include <sys/types.h>
 
+#include "qt_futex.h"
 #include "qt_mpool.h"
 #include "qt_profiling.h"
 #include "qt_shepherd_innards.h"
@@ -30,10 +32,24 @@ typedef enum blocking_syscalls {
   USER_DEFINED
 } syscall_t;
 
+/* One task (or pthread) waiting on several addresses at once, with
+ * qthread_readFF_any()/_all() or their syncvar versions. It lives on the
+ * waiter's stack and gets one qthread_addrres_t in the FFQ of each address
+ * that was empty. The timed operations (qthread_readFE_timed() and friends)
+ * use an "any" wait with a single node, in whichever queue they block on,
+ * that their timer can take back out. */
+typedef struct qthread_multiwait_s {
+  size_t _Atomic pending;  /* fills still needed, +1 until the waiter blocks */
+  void const *_Atomic hit; /* any: the first address to fill */
+  uint_fast8_t any;
+  _Atomic uint32_t released; /* a pthread waiter sleeps on this */
+} qthread_multiwait_t;
+
 typedef struct qthread_addrres_s {
   aligned_t *addr; /* ptr to the memory NOT being blocked on */
   qthread_t *waiter;
   struct qthread_addrres_s *next;
+  qthread_multiwait_t *multi; /* NULL, unless this is part of a multi-wait */
 } qthread_addrres_t;
 
 typedef struct _qt_blocking_queue_node_s {
@@ -66,6 +82,7 @@ static inline qthread_addrres_t *ALLOC_ADDRRES(void) { /*{{{ */
   qthread_addrres_t *tmp =
     (qthread_addrres_t *)qt_mpool_alloc(generic_addrres_pool);
 
+  if (tmp) { tmp->multi = NULL; }
   return tmp;
 } /*}}} */
 
@@ -73,5 +90,98 @@ static inline void FREE_ADDRRES(qthread_addrres_t *t) { /*{{{ */
   qt_mpool_free(generic_addrres_pool, t);
 } /*}}} */
 
+/* A plain pthread (one that is not a qthread) that has to wait on an FEB or a
+ * syncvar queues one of these, from its own stack, with a NULL waiter. Whoever
+ * dequeues it does its operation for it, just as for a blocked task, and then
+ * releases it rather than scheduling it. Once released, the node belongs to
+ * the pthread again and must not be touched. */
+typedef struct qthread_addrres_external_s {
+  qthread_addrres_t res;
+  _Atomic uint32_t released;
+} qthread_addrres_external_t;
+
+/* Queue the calling pthread on q, one of m's waiter lists, unlock m, and sleep
+ * until qt_addrres_external_release() is called on it. m must be locked. */
+static inline void qt_addrres_external_wait(qthread_addrstat_t *m,
+                                            qthread_addrres_t **q,
+                                            aligned_t *addr) { /*{{{ */
+  qthread_addrres_external_t X;
+
+  X.res.addr = addr;
+  X.res.waiter = NULL;
+  X.res.next = *q;
+  X.res.multi = NULL;
+  atomic_store_explicit(&X.released, 0, memory_order_relaxed);
+  *q = &X.res;
+  QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  while (atomic_load_explicit(&X.released, memory_order_acquire) == 0) {
+    qt_futex_wait(&X.released, 0, NULL);
+  }
+} /*}}} */
+
+static inline void qt_addrres_external_release(qthread_addrres_t *X) { /*{{{ */
+  _Atomic uint32_t *released;
+
+  if (X->multi) {
+    /* multi-wait nodes come from the pool, not from the pthread's stack */
+    released = &X->multi->released;
+    FREE_ADDRRES(X);
+  } else {
+    released = &((qthread_addrres_external_t *)X)->released;
+  }
+  atomic_store_explicit(released, 1, memory_order_release);
+  /* the node may already be gone; waking a stale address is harmless */
+  qt_futex_wake(released, 1);
+} /*}}} */
+
+static inline void qt_multiwait_init(qthread_multiwait_t *w,
+                                     uint_fast8_t any) { /*{{{ */
+  atomic_store_explicit(&w->pending, any ? 2 : 1, memory_order_relaxed);
+  atomic_store_explicit(&w->hit, NULL, memory_order_relaxed);
+  atomic_store_explicit(&w->released, 0, memory_order_relaxed);
+  w->any = any;
+} /*}}} */
+
+/* addr, which w has a node waiting on, was found full or was filled. Returns
+ * nonzero if that node's operation is to be done: an "any" wait takes only the
+ * first address to come through (or its timeout; see qt_timer_block()). The
+ * caller must hold the lock of addr's waiter lists. */
+static inline int qt_multiwait_claim(qthread_multiwait_t *w,
+                                     void const *addr) { /*{{{ */
+  void const *none = NULL;
+
+  if (!w->any) { return 1; }
+  return atomic_compare_exchange_strong_explicit(
+    &w->hit, &none, addr, memory_order_relaxed, memory_order_relaxed);
+} /*}}} */
+
+/* Drop one hold on w. Returns nonzero if it was the last one, and so w's
+ * waiter must be released. */
+static inline int qt_multiwait_drop(qthread_multiwait_t *w) { /*{{{ */
+  return atomic_fetch_sub_explicit(&w->pending, 1, memory_order_acq_rel) == 1;
+} /*}}} */
+
+/* Claim and drop in one go, for nodes that have no operation to do. Returns
+ * nonzero if this completes w's wait. */
+static inline int qt_multiwait_hit(qthread_multiwait_t *w,
+                                   void const *addr) { /*{{{ */
+  return qt_multiwait_claim(w, addr) && qt_multiwait_drop(w);
+} /*}}} */
+
+/* Drop the waiter's own hold on w, once all of its nodes are queued. Returns
+ * nonzero if nothing is left to wait for; otherwise, the last hit releases the
+ * waiter. */
+static inline int qt_multiwait_arm(qthread_multiwait_t *w) { /*{{{ */
+  return qt_multiwait_drop(w);
+} /*}}} */
+
+/* the pthread version of blocking on w */
+static inline void qt_multiwait_external_wait(qthread_multiwait_t *w) { /*{{{ */
+  if (qt_multiwait_arm(w)) { return; }
+  while (atomic_load_explicit(&w->released, memory_order_acquire) == 0) {
+    qt_futex_wait(&w->released, 0, NULL);
+  }
+} /*}}} */
+
 #endif // ifndef QT_BLOCKING_STRUCTS_H
 /* vim:set expandtab: */
@@ -17,6 +17,8 @@ typedef filter_code (*qt_feb_taskfilter_f)(qt_key_t addr,
                                            qthread_t *restrict waiter,
                                            void *restrict arg);
 
+struct qthread_multiwait_s;
+
 void INTERNAL qt_feb_subsystem_init(uint_fast8_t);
 
 int API_FUNC qthread_writeEF_nb(aligned_t *restrict const dest,
@@ -28,6 +30,9 @@ int API_FUNC qthread_readFF_nb(aligned_t *restrict const dest,
 int API_FUNC qthread_readFE_nb(aligned_t *restrict const dest,
                                aligned_t const *restrict const src);
 int INTERNAL qthread_check_feb_preconds(qthread_t *t);
+void INTERNAL qt_multiwait_block(struct qthread_multiwait_s *w, qthread_t *me);
+void INTERNAL qt_multiwait_wake(struct qthread_multiwait_s *w,
+                                qthread_t *waiter);
 
 void API_FUNC qthread_feb_callback(qt_feb_callback_f cb, void *arg);
 void INTERNAL qthread_feb_taskfilter(qt_feb_taskfilter_f tf, void *arg);
@@ -0,0 +1,22 @@
+#ifndef QT_FUTEX_H
+#define QT_FUTEX_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h> /* for struct timespec */
+
+#include "qt_visibility.h"
+
+/* Sleep while *addr == val, for at most reltime (NULL means forever). Returns
+ * zero if woken (or if *addr did not match), ETIMEDOUT otherwise. Spurious
+ * wakeups are possible; callers must recheck their condition. */
+int INTERNAL qt_futex_wait(_Atomic uint32_t *addr,
+                           uint32_t val,
+                           struct timespec const *reltime);
+
+/* Wake up to count threads sleeping on addr. The caller must change *addr
+ * before calling this, or the wakeup may be lost. */
+void INTERNAL qt_futex_wake(_Atomic uint32_t *addr, int count);
+
+#endif // ifndef QT_FUTEX_H
+/* vim:set expandtab: */
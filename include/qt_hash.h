@@ -30,6 +30,15 @@ void qt_hash_initialize_subsystem(void);
  */
 qt_hash INTERNAL qt_hash_create(int needSync);
 
+/*!
+ * @fn qt_hash_create_onnode(int needSync,
+ *                           int node)
+ * @brief Same as qt_hash_create(), but binds the hash map's memory (and its
+ *	lock) to NUMA <node>, where the platform supports it. A negative <node>
+ *	means no binding.
+ */
+qt_hash INTERNAL qt_hash_create_onnode(int needSync, int node);
+
 /*!
  * @fn qt_hash_destroy(qt_hash h)
  * @brief Deallocates a hash map and any mappings that remain in it.
@@ -119,6 +128,13 @@ void INTERNAL qt_hash_lock(qt_hash h);
  */
 void INTERNAL qt_hash_unlock(qt_hash h);
 
+/*!
+ * @fn qt_hash_contended(qt_hash h)
+ * @brief Return how many times a lock of the hash map had to wait for another
+ *	holder. Only counted with QTHREAD_COUNT_THREADS; otherwise always 0.
+ */
+size_t INTERNAL qt_hash_contended(qt_hash h);
+
 #ifdef __cplusplus
 }
 #endif
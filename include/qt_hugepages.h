@@ -0,0 +1,31 @@
+#ifndef QT_HUGEPAGES_H
+#define QT_HUGEPAGES_H
+
+#include <stddef.h> /* for size_t */
+
+#include "qt_visibility.h"
+
+/* Huge-page arenas for the pools that hold task descriptors and stacks
+ * (QT_HUGE_PAGES). Arenas are QT_HUGEPAGE_SIZE aligned and sized; with
+ * "explicit" they come from the hugetlb pool if it has room, otherwise (and
+ * with "yes") they are ordinary mappings marked MADV_HUGEPAGE, which the
+ * kernel backs with transparent huge pages when it can. */
+#define QT_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+enum qt_hugepages_mode {
+  QT_HUGEPAGES_OFF = 0,
+  QT_HUGEPAGES_TRANSPARENT,
+  QT_HUGEPAGES_EXPLICIT
+};
+
+extern enum qt_hugepages_mode qt_hugepages;
+
+void INTERNAL qt_hugepages_init(void);
+/* Map bytes (a multiple of QT_HUGEPAGE_SIZE) of huge-page aligned memory;
+ * *huge says whether it is (or was successfully advised to be) backed by
+ * huge pages. Returns NULL if the memory cannot be mapped at all. */
+void INTERNAL *qt_hugepage_map(size_t bytes, int *huge);
+void INTERNAL qt_hugepage_unmap(void *addr, size_t bytes);
+
+#endif // ifndef QT_HUGEPAGES_H
+/* vim:set expandtab: */
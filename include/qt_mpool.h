@@ -6,12 +6,15 @@
 typedef struct qt_mpool_s *qt_mpool;
 
 void *qt_mpool_alloc(qt_mpool pool);
+size_t qt_mpool_alloc_bulk(qt_mpool pool, void **items, size_t n);
 
 void qt_mpool_free(qt_mpool pool, void *mem);
 
 #define qt_mpool_create(item_size) qt_mpool_create_aligned((item_size), 0)
 
 qt_mpool qt_mpool_create_aligned(size_t item_size, size_t const alignment);
+qt_mpool qt_mpool_create_huge(size_t item_size, size_t const alignment);
+void qt_mpool_hugepage_usage(qt_mpool pool, size_t *mapped, size_t *huge);
 void qt_mpool_destroy(qt_mpool pool);
 
 void qt_mpool_subsystem_init(void);
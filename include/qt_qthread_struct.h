@@ -40,8 +40,8 @@
 #define QTHREAD_AGGREGABLE (1 << 10)
 #define QTHREAD_AGGREGATED (1 << 11)
 #define QTHREAD_NETWORK (1 << 12)
-#define QTHREAD_RESERVED_FLAG3 (1 << 13)
-#define QTHREAD_RESERVED_FLAG2 (1 << 14)
+#define QTHREAD_FIXED_FPENV (1 << 13)
+#define QTHREAD_REPLACED (1 << 14)
 #define QTHREAD_RESERVED_FLAG1 (1 << 15)
 
 #define QTHREAD_RET_MASK (QTHREAD_RET_IS_SYNCVAR | QTHREAD_RET_IS_SINC)
@@ -58,6 +58,8 @@ struct qthread_runtime_data_s {
     qt_blocking_queue_node_t *io;
     qthread_t *thread;
     qthread_queue_t queue;
+    struct qthread_timer_s *timer;
+    qthread_multiwait_t *multi;
   } blockedon;
 
   qthread_shepherd_t *shepherd_ptr; /* the shepherd we run on */
@@ -99,6 +101,9 @@ struct qthread_s {
                              desire for this thread to be somewhere) */
   _Atomic uint16_t flags; /* may not need all bits */
   _Atomic uint8_t thread_state;
+  uint8_t priority; /* 0 (default) .. QTHREAD_NUM_PRIORITIES-1 */
+  uint8_t argclass; /* argcopy size class, if QTHREAD_BIG_STRUCT */
+  uint8_t stackclass; /* stack size class (see QTHREAD_SPAWN_STACK_*) */
 
   alignas(
     8) uint8_t data[]; /* this is where we stick argcopy and tasklocal data */
@@ -25,6 +25,7 @@ typedef struct qthread_shepherd_s qthread_shepherd_t;
 #define QTHREAD_NO_NODE ((unsigned int)(-1))
 
 #define STEAL_BUFFER_LENGTH 128
+#define QT_STACK_CACHE_MAX 16
 
 struct qthread_worker_s {
   uintptr_t hazard_ptrs
@@ -37,10 +38,16 @@ struct qthread_worker_s {
   struct qthread_s **nostealbuffer;
   struct qthread_s **stealbuffer;
   qthread_t *current;
+  qthread_t *handoff;   /* task woken by current, to be run next */
+  unsigned int nwoken;  /* tasks woken by the current FEB operation */
+  /* stacks of tasks that finished here, for new tasks to run on */
+  void *stack_cache[QTHREAD_NUM_STACK_CLASSES][QT_STACK_CACHE_MAX];
+  unsigned int nstack_cache[QTHREAD_NUM_STACK_CLASSES];
   qthread_worker_id_t unique_id;
   qthread_worker_id_t worker_id;
   qthread_worker_id_t packed_worker_id;
   _Atomic alignas(8) uint_fast8_t active;
+  _Atomic uint32_t enable_seq; /* bumped on enable; disabled workers sleep on it */
 };
 typedef struct qthread_worker_s qthread_worker_t;
 
@@ -86,8 +93,11 @@ static inline qthread_worker_t *qthread_internal_getworker(void) {
 
 unsigned int INTERNAL
 qthread_internal_shep_to_node(qthread_shepherd_id_t const shep);
+unsigned int INTERNAL qthread_internal_stripe_to_node(size_t const stripe);
 qthread_shepherd_t INTERNAL *
 qthread_find_active_shepherd(qthread_shepherd_id_t *l, unsigned int *d);
+void INTERNAL qt_worker_wake(qthread_worker_t *w);
+void INTERNAL qt_worker_wait_enabled(qthread_worker_t *w);
 
 void qthread_back_to_master(qthread_t *t);
 void qthread_back_to_master2(qthread_t *t);
@@ -0,0 +1,53 @@
+#ifndef QT_STACKS_H
+#define QT_STACKS_H
+
+#include <stddef.h> /* for size_t */
+
+#include "qt_shepherd_innards.h"
+#include "qt_visibility.h"
+
+/* Task stack allocation. Stacks come in QTHREAD_NUM_STACK_CLASSES size
+ * classes. Each worker keeps a short LIFO per class of the stacks of tasks
+ * that finished on it; beyond that, stacks go back to a pool belonging to
+ * their class and to the NUMA node they were allocated on, no matter where
+ * they are freed. */
+
+/* Set up the pools and start the trimmer; needs the shepherds' affinity
+ * information and the final qthread_stack_sizes. With guard_pages,
+ * every stack is bracketed by two PROT_NONE pages. */
+void INTERNAL qt_stack_subsystem_init(int guard_pages);
+/* Stop the trimmer and release every pool; worker caches must be flushed
+ * first. */
+void INTERNAL qt_stack_subsystem_fini(void);
+
+/* A stack of class sclass from the worker's cache or its node's pool (the
+ * first node's if worker is NULL). The returned pointer is the lowest usable
+ * byte; the runtime data sits just past the end of the stack (past the upper
+ * guard page, with guard pages). */
+void INTERNAL *qt_stack_alloc(qthread_worker_t *worker, unsigned int sclass);
+/* Return a stack of class sclass to the pool it came from. */
+void INTERNAL qt_stack_free(void *stack, unsigned int sclass);
+/* Try to keep a stack of class sclass in the worker's cache; returns 0 (and
+ * does nothing) if the cache is full or the stack belongs to another node. */
+int INTERNAL qt_stack_keep(qthread_worker_t *worker,
+                           void *stack,
+                           unsigned int sclass);
+/* Return every stack in the worker's cache to its pool. */
+void INTERNAL qt_stack_worker_flush(qthread_worker_t *worker);
+
+/* How many bytes the pools of class sclass have mapped, and how many of
+ * those are on huge pages (see QT_HUGE_PAGES). */
+void INTERNAL qt_stack_hugepage_usage(unsigned int sclass,
+                                      size_t *mapped,
+                                      size_t *huge);
+
+/* With QT_STACK_PROFILE, stacks are painted as they are handed out; this
+ * measures how deep the task that ran f on the stack went and adds it to
+ * f's profile. */
+void INTERNAL qt_stack_profile_record(qthread_f f,
+                                      void *stack,
+                                      unsigned int sclass);
+extern int qt_stack_profiling;
+
+#endif // ifndef QT_STACKS_H
+/* vim:set expandtab: */
@@ -20,6 +20,9 @@ typedef enum threadstate {
   QTHREAD_STATE_SYSCALL,   /* thread performing external blocking operation */
   QTHREAD_STATE_ILLEGAL,   /* illegal state */
   QTHREAD_STATE_TERM_SHEP, /* special flag to terminate the shepherd */
+  QTHREAD_STATE_HANDOFF,   /* reschedule, and run worker->handoff next */
+  QTHREAD_STATE_SLEEPING,  /* waiting on the timer wheel */
+  QTHREAD_STATE_MULTI_BLOCKED, /* waiting for one or all of several febs */
   QTHREAD_STATE_NUM_STATES /* tell performance data how many states there are */
 } threadstate_t;
 
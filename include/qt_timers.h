@@ -0,0 +1,52 @@
+#ifndef QT_TIMERS_H
+#define QT_TIMERS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "qthread/qthread.h"
+
+#include "qt_expect.h"
+#include "qt_qthread_t.h"
+#include "qt_visibility.h"
+
+/* Timers (qthread_sleep(), qthread_spawn_after() and
+ * qthread_spawn_periodic()) live in a hierarchical timing wheel with a
+ * QT_TIMER_TICK granularity. The wheel is advanced by the workers, between
+ * tasks, whenever a timer is due, and by a timer thread that sleeps until the
+ * next one is (so that timers fire even if every worker is busy or idle). */
+
+/* The tick at which the wheel next needs attention; UINT64_MAX when no
+ * timers are pending. */
+extern _Atomic uint64_t qt_timer_wake;
+
+void INTERNAL qt_timer_subsystem_init(void);
+/* Put a sleeping task's entry (see qthread_sleep()) on the wheel; called by
+ * the worker once the task has switched out. */
+void INTERNAL qt_timer_insert(struct qthread_timer_s *timer);
+void INTERNAL qt_timer_poll_internal(void);
+
+struct qthread_multiwait_s;
+
+/* Block on w (see qt_multiwait_block()) for at most nsecs. If the time runs
+ * out first, expire(arg) is called, from the timer thread or from a worker
+ * between tasks, and must take w's node back out of its queue and release w,
+ * unless an FEB or syncvar operation has dequeued the node already. Either
+ * way, once this returns, the timer is gone. */
+void INTERNAL qt_timer_block(struct qthread_multiwait_s *w,
+                             qthread_t *me,
+                             uint64_t nsecs,
+                             qthread_f expire,
+                             void *arg);
+
+/* Fire whatever timers are due; cheap when nothing is pending. */
+static inline void qt_timer_poll(void) {
+  if (QTHREAD_UNLIKELY(atomic_load_explicit(&qt_timer_wake,
+                                            memory_order_relaxed) !=
+                       UINT64_MAX)) {
+    qt_timer_poll_internal();
+  }
+}
+
+#endif // ifndef QT_TIMERS_H
+/* vim:set expandtab: */
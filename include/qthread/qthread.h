@@ -299,7 +299,9 @@ enum _qthread_features {
   SPAWN_AGGREGABLE,
   SPAWN_COUNT,
   SPAWN_LOCAL_PRIORITY,
-  SPAWN_NETWORK
+  SPAWN_NETWORK,
+  SPAWN_FIXED_FPENV,
+  SPAWN_WORK_FIRST
 };
 
 #define QTHREAD_SPAWN_PARENT (1 << SPAWN_PARENT)
@@ -313,6 +315,41 @@ enum _qthread_features {
 #define QTHREAD_SPAWN_AGGREGABLE (1 << SPAWN_AGGREGABLE)
 #define QTHREAD_SPAWN_LOCAL_PRIORITY (1 << SPAWN_LOCAL_PRIORITY)
 #define QTHREAD_SPAWN_NETWORK (1 << SPAWN_NETWORK)
+/* The task promises not to change the floating-point control state (SSE
+ * rounding mode and exception masks, x87 control word), so context switches
+ * to and from it can skip saving and restoring it where that is supported. */
+#define QTHREAD_SPAWN_FIXED_FPENV (1 << SPAWN_FIXED_FPENV)
+/* Work-first spawn: the child starts running immediately on the spawning
+ * worker, and the parent's continuation is what waits in the queue (and can
+ * be stolen), as in Cilk. Recursive fork-join then keeps only about one
+ * suspended task per level of recursion per worker. Only applies to
+ * qthread_spawn() called from a task without preconditions; otherwise the
+ * flag is ignored. */
+#define QTHREAD_SPAWN_WORK_FIRST (1 << SPAWN_WORK_FIRST)
+
+/* Task priorities. A priority from 0 (the default) to
+ * QTHREAD_NUM_PRIORITIES-1 (most urgent) can be or'd into the feature flags
+ * of qthread_spawn() with QTHREAD_SPAWN_PRIORITY(p). Schedulers that support
+ * priorities run (and steal) higher-priority tasks first; the others ignore
+ * it. */
+#define QTHREAD_NUM_PRIORITIES 8
+#define QTHREAD_SPAWN_PRIORITY_SHIFT 28
+#define QTHREAD_SPAWN_PRIORITY_MASK                                            \
+  ((unsigned int)(QTHREAD_NUM_PRIORITIES - 1) << QTHREAD_SPAWN_PRIORITY_SHIFT)
+#define QTHREAD_SPAWN_PRIORITY(p)                                              \
+  (((unsigned int)(p) << QTHREAD_SPAWN_PRIORITY_SHIFT) &                       \
+   QTHREAD_SPAWN_PRIORITY_MASK)
+
+/* Stack size classes. Or'ing QTHREAD_SPAWN_STACK_SMALL or
+ * QTHREAD_SPAWN_STACK_LARGE into the feature flags of qthread_spawn() runs
+ * the task on a stack of QT_STACK_SIZE_SMALL or QT_STACK_SIZE_LARGE bytes
+ * instead of QT_STACK_SIZE; qthread_spawn_stack_flag() picks the class for a
+ * given size. */
+#define QTHREAD_NUM_STACK_CLASSES 3
+#define QTHREAD_SPAWN_STACK_SHIFT 26
+#define QTHREAD_SPAWN_STACK_MASK (3u << QTHREAD_SPAWN_STACK_SHIFT)
+#define QTHREAD_SPAWN_STACK_SMALL (1u << QTHREAD_SPAWN_STACK_SHIFT)
+#define QTHREAD_SPAWN_STACK_LARGE (2u << QTHREAD_SPAWN_STACK_SHIFT)
 
 int qthread_spawn(qthread_f f,
                   void const *arg,
@@ -323,6 +360,27 @@ int qthread_spawn(qthread_f f,
                   qthread_shepherd_id_t target_shep,
                   unsigned int feature_flag);
 
+/* Spawns n tasks at once; see qthread_spawn_bulk(3). On error, none of them
+ * has been spawned. */
+int qthread_spawn_bulk(qthread_f f,
+                       void const *args,
+                       size_t arg_size,
+                       void *rets,
+                       size_t n,
+                       qthread_shepherd_id_t target_shep,
+                       unsigned int feature_flag);
+/* The QTHREAD_SPAWN_STACK_* flag (or 0, for the default) of the smallest
+ * stack class with at least stack_size bytes of stack; the largest class if
+ * none has that much. */
+unsigned int qthread_spawn_stack_flag(size_t stack_size);
+
+/* Tail-spawn: when the calling task's function returns, the task runs f on
+ * arg (copied, if arg_size is nonzero) instead of finishing, keeping its
+ * descriptor, stack, return location, team and task-local data. Meant to be
+ * used as "return qthread_replace(f, arg, arg_size);"; the function's
+ * return value and its own argument are dead once this has been called. */
+int qthread_replace(qthread_f f, void const *arg, size_t arg_size);
+
 /* This is a function to move a thread from one shepherd to another. */
 int qthread_migrate_to(qthread_shepherd_id_t const shepherd);
 
@@ -349,6 +407,22 @@ void *qthread_tos(void);
 void *qthread_bos(void);
 
 size_t qthread_stackleft(void);
+
+/* Stack high-water marks, gathered per task function when QT_STACK_PROFILE
+ * is set. Bucket i of the histogram counts the tasks that used at most
+ * 256 << i bytes of stack (and more than 128 << i, for i > 0). */
+#define QTHREAD_STACK_PROFILE_BUCKETS 24
+typedef struct qthread_stack_profile_s {
+  qthread_f f;
+  size_t ntasks;
+  size_t max_used;   /* the deepest any of them went, in bytes */
+  size_t total_used; /* summed over the tasks, for the mean */
+  size_t stack_size; /* the largest stack any of them ran on */
+  size_t histogram[QTHREAD_STACK_PROFILE_BUCKETS];
+} qthread_stack_profile_t;
+/* Copies up to max profiles into profiles; returns how many task functions
+ * have been profiled (0 if profiling is off). */
+size_t qthread_stack_profile(qthread_stack_profile_t *profiles, size_t max);
 aligned_t *qthread_retloc(void);
 int qthread_shep_ok(void);
 void qthread_shep_next(qthread_shepherd_id_t *shep);
@@ -450,6 +524,22 @@ int qthread_queue_release_one(qthread_queue_t q);
 int qthread_queue_release_all(qthread_queue_t q);
 int qthread_queue_destroy(qthread_queue_t q);
 
+/* Timers. Times are in nanoseconds and rounded up to the QT_TIMER_TICK
+ * granularity. qthread_sleep() parks the calling task (neither its worker
+ * nor a pthread waits with it); qthread_spawn_after() spawns f(arg) once the
+ * delay has passed, and qthread_spawn_periodic() every period until the
+ * timer is cancelled. */
+struct qthread_timer_s;
+typedef struct qthread_timer_s *qthread_timer_t;
+
+int qthread_sleep(uint64_t nsecs);
+int qthread_spawn_after(uint64_t nsecs, qthread_f f, void const *arg);
+int qthread_spawn_periodic(uint64_t period,
+                           qthread_f f,
+                           void const *arg,
+                           qthread_timer_t *timer);
+int qthread_timer_cancel(qthread_timer_t timer);
+
 /****************************************************************************
  * functions to implement FEB locking/unlocking
  ****************************************************************************
@@ -571,6 +661,20 @@ int qthread_writeFF_const(aligned_t *dest, aligned_t src);
 int qthread_readFF(aligned_t *dest, aligned_t const *src);
 int qthread_syncvar_readFF(uint64_t *restrict dest, syncvar_t *restrict src);
 
+/* These functions wait on several addresses at once, leaving them all full.
+ * The _any versions return as soon as one of srcs[0..n-1] is full, and store
+ * its position in *index (if index is not NULL); the _all versions return once
+ * every one of them has been full. The waiting task is queued on each address
+ * that is empty and is woken only once, by the fill that completes its wait.
+ * Nothing is read: use readFF (or readXX) on the addresses that are needed.
+ */
+int qthread_readFF_any(aligned_t const *const *srcs, size_t n, size_t *index);
+int qthread_readFF_all(aligned_t const *const *srcs, size_t n);
+int qthread_syncvar_readFF_any(syncvar_t *const *srcs,
+                               size_t n,
+                               size_t *index);
+int qthread_syncvar_readFF_all(syncvar_t *const *srcs, size_t n);
+
 /* These functions wait for memory to become full, and then empty it. When
  * memory becomes full, only one thread blocked like this will be awoken. Data
  * is read from src and written to dest.
@@ -593,6 +697,36 @@ int qthread_syncvar_readFE(uint64_t *restrict dest, syncvar_t *restrict src);
 int qthread_readXX(aligned_t *dest, aligned_t const *src);
 // NOTE: There is no syncvar version of readXX
 
+/* These are readFE, readFF and writeEF with a timeout: if the operation cannot
+ * complete within nsecs nanoseconds (rounded up to the QT_TIMER_TICK
+ * granularity), the caller is taken back off the address's queue and
+ * ETIMEDOUT is returned, as pthread_cond_timedwait() does, with nothing read
+ * or written. With a timeout of 0 they do not block at all. A task waiting
+ * like this is parked just as the untimed versions park it.
+ */
+int qthread_readFE_timed(aligned_t *restrict dest,
+                         aligned_t const *restrict src,
+                         uint64_t nsecs);
+int qthread_readFF_timed(aligned_t *restrict dest,
+                         aligned_t const *restrict src,
+                         uint64_t nsecs);
+int qthread_writeEF_timed(aligned_t *restrict dest,
+                          aligned_t const *restrict src,
+                          uint64_t nsecs);
+int qthread_writeEF_const_timed(aligned_t *dest, aligned_t src, uint64_t nsecs);
+int qthread_syncvar_readFE_timed(uint64_t *restrict dest,
+                                 syncvar_t *restrict src,
+                                 uint64_t nsecs);
+int qthread_syncvar_readFF_timed(uint64_t *restrict dest,
+                                 syncvar_t *restrict src,
+                                 uint64_t nsecs);
+int qthread_syncvar_writeEF_timed(syncvar_t *restrict dest,
+                                  uint64_t const *restrict src,
+                                  uint64_t nsecs);
+int qthread_syncvar_writeEF_const_timed(syncvar_t *restrict dest,
+                                        uint64_t src,
+                                        uint64_t nsecs);
+
 /* functions to implement FEB-ish locking/unlocking
  *
  * These are atomic and functional, but do not have the same semantics as full
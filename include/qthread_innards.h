@@ -26,6 +26,9 @@
 #include "qt_threadqueues.h"
 #include "qt_visibility.h"
 
+#define QTHREAD_ARGCOPY_MIN_CLASS 64
+#define QTHREAD_ARGCOPY_NCLASSES 8
+
 typedef struct qlib_s {
   unsigned int nshepherds;
   aligned_t nshepherds_active;
@@ -35,11 +38,18 @@ typedef struct qlib_s {
   qt_threadqueue_t **threadqueues;
 
   unsigned qthread_stack_size;
+  /* stack size of each class (see QTHREAD_SPAWN_STACK_*); the first is
+   * qthread_stack_size */
+  unsigned qthread_stack_sizes[QTHREAD_NUM_STACK_CLASSES];
   unsigned master_stack_size;
   unsigned max_stack_size;
 
   unsigned qthread_argcopy_size;
   unsigned qthread_tasklocal_size;
+  /* inline argument space of each task-descriptor size class, smallest
+   * first; the last is qthread_argcopy_size */
+  unsigned qthread_argcopy_classes[QTHREAD_ARGCOPY_NCLASSES];
+  unsigned qthread_argcopy_nclasses;
 
   qthread_t *mccoy_thread; /* free when exiting */
 
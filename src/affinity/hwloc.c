@@ -498,20 +498,35 @@ int INTERNAL qt_affinity_gendists(qthread_shepherd_t *sheps,
   }
 #endif /* ifdef QTHREAD_HAVE_HWLOC_DISTS */
   for (size_t i = 0; i < nshepherds; ++i) {
+    hwloc_obj_t iobj = hwloc_get_obj_inside_cpuset_by_depth(
+      topology, allowed_cpuset, shep_depth, sheps[i].node);
     for (size_t j = 0, k = 0; j < nshepherds; ++j) {
       if (j != i) {
+        /* How far up the tree the two shepherds have to go to meet: PUs of
+         * the same core share a parent, cores sharing an L3 meet at the
+         * cache, and so on up to the machine. This orders the sheplist
+         * (and the work-stealing levels built from it) by topology even
+         * when there is no latency matrix. */
+        hwloc_obj_t jobj = hwloc_get_obj_inside_cpuset_by_depth(
+          topology, allowed_cpuset, shep_depth, sheps[j].node);
+        unsigned int hops = 0;
+        if (iobj && jobj && (iobj != jobj)) {
+          hwloc_obj_t anc = hwloc_get_common_ancestor_obj(topology, iobj, jobj);
+          hops = (unsigned int)(iobj->depth - anc->depth);
+        }
 #ifdef QTHREAD_HAVE_HWLOC_DISTS
         if (matrix) {
           sheps[i].shep_dists[j] =
             matrix->latency[node_to_NUMAnode[sheps[i].node] +
                             matrix->nbobjs * node_to_NUMAnode[sheps[j].node]] *
-            10;
+              10 +
+            hops;
         } else {
           // handle what is fundamentally a bug in old versions of hwloc
-          sheps[i].shep_dists[j] = 10;
+          sheps[i].shep_dists[j] = 10 + hops;
         }
 #else  /* ifdef QTHREAD_HAVE_HWLOC_DISTS */
-        sheps[i].shep_dists[j] = 10;
+        sheps[i].shep_dists[j] = 10 + hops;
 #endif /* ifdef QTHREAD_HAVE_HWLOC_DISTS */
         sheps[i].sorted_sheplist[k++] = j;
       }
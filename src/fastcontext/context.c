@@ -154,4 +154,19 @@ QT_SKIP_THREAD_SANITIZER int INTERNAL qt_swapctxt(uctxt_t *oucp, uctxt_t *ucp) {
 
 #endif /* ifdef NEEDSWAPCONTEXT */
 
+#ifdef NEEDLEANSWAPCONTEXT
+/* qt_swapctxt() for tasks that do not change the floating-point control
+ * state: the MXCSR and x87 control word are neither saved nor restored. */
+QT_SKIP_THREAD_SANITIZER int INTERNAL qt_swapctxt_lean(uctxt_t *oucp,
+                                                      uctxt_t *ucp) {
+  Q_PREFETCH(ucp, 0, 0);
+  if (qt_getmctxt_lean(&oucp->mc) == 0) {
+    Q_PREFETCH((void *)ucp->mc.mc_esp, 1, 3);
+    qt_setmctxt_lean(&ucp->mc);
+  }
+  return 0;
+}
+
+#endif /* ifdef NEEDLEANSWAPCONTEXT */
+
 /* vim:set expandtab: */
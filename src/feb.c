@@ -17,51 +17,34 @@
 #include "qt_alloc.h"
 #include "qt_asserts.h"
 #include "qt_blocking_structs.h"
+#include "qt_envariables.h"
 #include "qt_hash.h"
 #include "qt_initialized.h" // for qthread_library_initialized
 #include "qt_output_macros.h"
 #include "qt_profiling.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_qthread_struct.h"
+#include "qt_shepherd_innards.h"
 #include "qt_subsystems.h"
 #include "qt_threadqueues.h"
+#include "qt_timers.h"       /* for qt_timer_block() */
 #include "qthread_innards.h" /* for qlib */
 
 /********************************************************************
  * Local Variables
  *********************************************************************/
 static qt_hash *FEBs;
+/* FEB_filter_size counters, always a power of two between these bounds; see
+ * qt_feb_filter_slot() */
+#define QT_FEB_FILTER_MIN (1ul << 6)
+#define QT_FEB_FILTER_MAX (1ul << 24)
+static uint32_t _Atomic *FEB_filter;
+static size_t FEB_filter_size;
+static uint_fast8_t direct_handoff = 0;
 #ifdef QTHREAD_COUNT_THREADS
 aligned_t *febs_stripes;
 #endif
 
-/********************************************************************
- * Local Types
- *********************************************************************/
-typedef enum bt {
-  PURGE,
-  WRITEEF,
-  WRITEEF_NB,
-  WRITEF,
-  WRITEFF,
-  READFF,
-  READFF_NB,
-  READFE,
-  READFE_NB,
-  FILL,
-  EMPTY
-} blocker_type;
-
-typedef struct {
-  pthread_mutex_t lock;
-  pthread_cond_t condition;
-  uint32_t completed;
-  void *a;
-  void *b;
-  blocker_type type;
-  int retval;
-} qthread_feb_blocker_t;
-
 /********************************************************************
  * Local Prototypes
  *********************************************************************/
@@ -73,7 +56,8 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
                            qthread_addrstat_t *m,
                            void *maddr,
                            uint_fast8_t const recursive,
-                           qthread_addrres_t **precond_tasks);
+                           qthread_addrres_t **precond_tasks,
+                           qthread_addrres_t **externals);
 static inline void qthread_gotlock_empty(qthread_shepherd_t *shep,
                                          qthread_addrstat_t *m,
                                          void *maddr);
@@ -82,7 +66,8 @@ qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
                             qthread_addrstat_t *m,
                             void *maddr,
                             uint_fast8_t const recursive,
-                            qthread_addrres_t **precond_tasks);
+                            qthread_addrres_t **precond_tasks,
+                            qthread_addrres_t **externals);
 
 /********************************************************************
  * Shared Globals
@@ -90,8 +75,8 @@ qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
 qt_mpool generic_addrstat_pool = NULL;
 qt_mpool generic_addrres_pool = NULL;
 
-/* guaranteed to be between 0 and 128, using the first parts of addr that are
- * significant */
+/* always a power of two; qthread_initialize() sizes it to the number of
+ * workers (or $QT_LOCKING_STRIPES) before any of the tables are built */
 unsigned int QTHREAD_LOCKING_STRIPES = 128;
 
 /********************************************************************
@@ -100,14 +85,17 @@ unsigned int QTHREAD_LOCKING_STRIPES = 128;
 
 static void qt_feb_subsystem_shutdown(void) {
   for (unsigned i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
-    qt_hash_destroy_deallocate(FEBs[i],
-                               (qt_hash_deallocator_fn)qthread_addrstat_delete);
 #ifdef QTHREAD_COUNT_THREADS
-    print_status(
-      "bin %i used %u times for FEBs\n", i, (unsigned int)febs_stripes[i]);
+    print_status("bin %i used %u times for FEBs, contended %u times\n",
+                 i,
+                 (unsigned int)febs_stripes[i],
+                 (unsigned int)qt_hash_contended(FEBs[i]));
 #endif
+    qt_hash_destroy_deallocate(FEBs[i],
+                               (qt_hash_deallocator_fn)qthread_addrstat_delete);
   }
   FREE(FEBs, sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
+  qt_internal_aligned_free((void *)FEB_filter, CACHELINE_WIDTH);
 #ifdef QTHREAD_COUNT_THREADS
   FREE(febs_stripes, sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
 #endif
@@ -118,10 +106,28 @@ static void qt_feb_subsystem_shutdown(void) {
 }
 
 void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync) {
+  direct_handoff = qt_internal_get_env_bool("DIRECT_HANDOFF", 0);
   generic_addrstat_pool = qt_mpool_create(sizeof(qthread_addrstat_t));
   generic_addrres_pool = qt_mpool_create(sizeof(qthread_addrres_t));
   FEBs = MALLOC(sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
   assert(FEBs);
+  {
+    /* sized for how many addrstats may be live at once, which has nothing to
+     * do with how many stripes they are spread over */
+    unsigned long const want =
+      qt_internal_get_env_num("FEB_FILTER_SIZE", 1ul << 16, 1ul << 16);
+
+    FEB_filter_size = QT_FEB_FILTER_MIN;
+    while (FEB_filter_size < want && FEB_filter_size < QT_FEB_FILTER_MAX) {
+      FEB_filter_size <<= 1;
+    }
+  }
+  FEB_filter = qt_internal_aligned_alloc(sizeof(uint32_t) * FEB_filter_size,
+                                         CACHELINE_WIDTH);
+  assert(FEB_filter);
+  for (size_t i = 0; i < FEB_filter_size; i++) {
+    atomic_init(&FEB_filter[i], 0);
+  }
 #ifdef QTHREAD_COUNT_THREADS
   febs_stripes = MALLOC(sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
   assert(febs_stripes);
@@ -130,73 +136,155 @@ void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync) {
 #ifdef QTHREAD_COUNT_THREADS
     febs_stripes[i] = 0;
 #endif
-    FEBs[i] = qt_hash_create(need_sync);
+    FEBs[i] = qt_hash_create_onnode(
+      need_sync, (int)qthread_internal_stripe_to_node(i));
     assert(FEBs[i]);
   }
   qthread_internal_cleanup_late(qt_feb_subsystem_shutdown);
 }
 
+/* shep is NULL when the FEB operation was done by a plain pthread; then the
+ * waiter goes back to the shepherd it last ran on */
+static inline void qt_feb_enqueue(qthread_t *waiter,
+                                  qthread_shepherd_t *shep) {
+  if ((shep == NULL) ||
+      ((atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
+        QTHREAD_UNSTEALABLE) &&
+       (waiter->rdata->shepherd_ptr != shep))) {
+    qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
+  } else {
+    qt_threadqueue_enqueue(shep->ready, waiter);
+  }
+}
+
+/* Direct hand-off (QT_DIRECT_HANDOFF): when an FEB operation performed by a
+ * task wakes exactly one waiter, the waiter is not queued; instead it is
+ * parked in the worker's handoff slot and, once the FEB lock is released,
+ * the signalling task requeues itself and the worker switches straight to
+ * the waiter (see qt_feb_handoff()). Simple tasks cannot be switched away
+ * from, the McCoy thread only runs on worker 0, and unstealable waiters
+ * belonging to other shepherds have to go home, so those always take the
+ * queue. */
+static inline int qt_feb_can_handoff(qthread_worker_t *w,
+                                     qthread_t *waiter) {
+  qthread_t *me = w->current;
+  uint_fast16_t const wflags =
+    atomic_load_explicit(&waiter->flags, memory_order_relaxed);
+
+  if ((me == NULL) ||
+      (atomic_load_explicit(&me->flags, memory_order_relaxed) &
+       QTHREAD_SIMPLE)) {
+    return 0;
+  }
+  if ((wflags & QTHREAD_REAL_MCCOY) && (w->packed_worker_id != 0)) {
+    return 0;
+  }
+  if ((wflags & QTHREAD_UNSTEALABLE) &&
+      (waiter->rdata->shepherd_ptr != w->shepherd)) {
+    return 0;
+  }
+  return 1;
+}
+
 static inline void qt_feb_schedule(qthread_t *waiter,
                                    qthread_shepherd_t *shep) {
   atomic_store_explicit(
     &waiter->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
-  if ((atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
-       QTHREAD_UNSTEALABLE) &&
-      (waiter->rdata->shepherd_ptr != shep)) {
-    qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
+  if (direct_handoff) {
+    qthread_worker_t *w = qthread_internal_getworker();
+    if (w) {
+      if ((w->nwoken++ == 0) && qt_feb_can_handoff(w, waiter)) {
+        w->handoff = waiter;
+        return;
+      }
+      if (w->handoff) {
+        /* more than one waiter: nobody gets the direct swap */
+        qt_feb_enqueue(w->handoff, shep);
+        w->handoff = NULL;
+      }
+    }
+  }
+  qt_feb_enqueue(waiter, shep);
+}
+
+/* X has been dequeued and its operation done; let its waiter go. Pthreads
+ * are only collected here, and woken by qt_feb_release_externals() once the
+ * FEB's lock has been dropped: a pthread woken while it is held may well
+ * preempt the waker and then spin on that lock. */
+static inline void qt_feb_release(qthread_addrres_t *X,
+                                  qthread_shepherd_t *shep,
+                                  qthread_addrres_t **externals) {
+  if (X->multi && !qt_multiwait_drop(X->multi)) {
+    /* its waiter has yet to block, or still needs other fills */
+    FREE_ADDRRES(X);
+    return;
+  }
+  if (X->waiter == NULL) {
+    X->next = *externals;
+    *externals = X;
   } else {
-    qt_threadqueue_enqueue(shep->ready, waiter);
+    qt_feb_schedule(X->waiter, shep);
+    FREE_ADDRRES(X);
   }
 }
 
-/* functions to implement FEB locking/unlocking */
-
-static aligned_t qthread_feb_blocker_thread(void *arg) { /*{{{ */
-  qthread_feb_blocker_t *restrict const a = (qthread_feb_blocker_t *)arg;
-
-  switch (a->type) {
-    case READFE: a->retval = qthread_readFE(a->a, a->b); break;
-    case READFE_NB: a->retval = qthread_readFE_nb(a->a, a->b); break;
-    case READFF: a->retval = qthread_readFF(a->a, a->b); break;
-    case READFF_NB: a->retval = qthread_readFF_nb(a->a, a->b); break;
-    case PURGE: a->retval = qthread_purge_to(a->a, a->b); break;
-    case WRITEEF: a->retval = qthread_writeEF(a->a, a->b); break;
-    case WRITEEF_NB: a->retval = qthread_writeEF_nb(a->a, a->b); break;
-    case WRITEF: a->retval = qthread_writeF(a->a, a->b); break;
-    case WRITEFF: a->retval = qthread_writeFF(a->a, a->b); break;
-    case FILL: a->retval = qthread_fill(a->a); break;
-    case EMPTY: a->retval = qthread_empty(a->a); break;
-  }
-  pthread_mutex_lock(&a->lock);
-  a->completed = 1;
-  pthread_cond_signal(&a->condition);
-  pthread_mutex_unlock(&a->lock);
-  return 0;
-} /*}}} */
+static inline void qt_feb_release_externals(qthread_addrres_t *X) {
+  while (X) {
+    qthread_addrres_t *next = X->next;
+    qt_addrres_external_release(X);
+    X = next;
+  }
+}
 
-static int
-qthread_feb_blocker_func(void *dest, void *src, blocker_type t) { /*{{{*/
-  qthread_feb_blocker_t args = {PTHREAD_MUTEX_INITIALIZER,
-                                PTHREAD_COND_INITIALIZER,
-                                0u,
-                                dest,
-                                src,
-                                t,
-                                QTHREAD_SUCCESS};
-
-  pthread_mutex_lock(&args.lock);
-  qthread_fork(qthread_feb_blocker_thread, &args, NULL);
-  while (!args.completed) pthread_cond_wait(&args.condition, &args.lock);
-  pthread_mutex_unlock(&args.lock);
-  pthread_cond_destroy(&args.condition);
-  pthread_mutex_destroy(&args.lock);
-  return args.retval;
-} /*}}}*/
+/* called once an FEB operation has released its lock */
+static inline void qt_feb_handoff(void) {
+  if (!direct_handoff) { return; }
+
+  qthread_worker_t *w = qthread_internal_getworker();
+  if (w == NULL) { return; }
+  w->nwoken = 0;
+  if (w->handoff) {
+    qthread_t *me = w->current;
+    assert(me);
+    atomic_store_explicit(
+      &me->thread_state, QTHREAD_STATE_HANDOFF, memory_order_relaxed);
+    qthread_back_to_master(me);
+  }
+}
 
 #define QTHREAD_CHOOSE_STRIPE2(addr)                                           \
   (qt_hash64((uint64_t)(uintptr_t)addr) & (QTHREAD_LOCKING_STRIPES - 1))
 
 // #define QTHREAD_CHOOSE_STRIPE2(addr) QTHREAD_CHOOSE_STRIPE(addr)
+
+/* A counting filter over the addresses that have an addrstat in FEBs, so that
+ * the common case (no addrstat, so the word is full and nobody waits on it)
+ * needs no hash probe and no hash lock. An address's counter is picked by the
+ * upper hash bits, which QTHREAD_CHOOSE_STRIPE2() does not use, and is raised
+ * before its addrstat goes into the hash and lowered after it comes out. A
+ * zero counter thus means no addrstat; a nonzero one means maybe, and the
+ * hash has to be asked. With more live addrstats than $QT_FEB_FILTER_SIZE,
+ * most counters are nonzero and the filter only adds to the cost. */
+static inline uint32_t _Atomic *qt_feb_filter_slot(void const *addr) {
+  uint64_t const h = qt_hash64((uint64_t)(uintptr_t)addr);
+
+  assert(FEB_filter);
+  return &FEB_filter[(h >> 32) & (FEB_filter_size - 1)];
+}
+
+static inline void qt_feb_filter_add(void const *addr) {
+  atomic_fetch_add_explicit(qt_feb_filter_slot(addr), 1, memory_order_seq_cst);
+}
+
+static inline void qt_feb_filter_drop(void const *addr) {
+  atomic_fetch_sub_explicit(qt_feb_filter_slot(addr), 1, memory_order_seq_cst);
+}
+
+/* nonzero if addr certainly has no addrstat, i.e. is full with no waiters */
+static inline int qt_feb_filter_absent(void const *addr) {
+  return atomic_load_explicit(qt_feb_filter_slot(addr), memory_order_seq_cst) ==
+         0;
+}
 /* The lock ordering in these functions is very particular, and is designed to
  * reduce the impact of having only one hashtable. Don't monkey with it unless
  * you REALLY know what you're doing! If one hashtable becomes a problem, we
@@ -208,6 +296,7 @@ int API_FUNC qthread_feb_status(aligned_t const *addr) { /*{{{ */
   aligned_t const *alignedaddr;
 
   if (qlib == NULL) { return 1; }
+  if (qt_feb_filter_absent(addr)) { return 1; }
   qthread_addrstat_t *m;
   int status = 1; /* full */
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(addr);
@@ -274,6 +363,7 @@ static inline void qthread_FEB_remove(void *maddr) { /*{{{ */
         (m->FFWQ == NULL) && (m->full == 1)) {
       m->valid = 0;
       qassertnot(qt_hash_remove(FEBs[lockbin], maddr), 0);
+      qt_feb_filter_drop(maddr);
     } else {
       QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
       return;
@@ -288,6 +378,7 @@ static inline void qthread_FEB_remove(void *maddr) { /*{{{ */
       if ((m->FEQ == NULL) && (m->EFQ == NULL) && (m->FFQ == NULL) &&
           (m->FFWQ == NULL) && (m->full == 1)) {
         qassertnot(qt_hash_remove_locked(FEBs[lockbin], maddr), 0);
+        qt_feb_filter_drop(maddr);
       } else {
         QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
         m = NULL;
@@ -320,7 +411,8 @@ qthread_precond_launch(qthread_shepherd_t *shep,
       FREE_ADDRRES(precond_free);
       if (qthread_check_feb_preconds(precond_head->waiter) != 1) {
         if (precond_head->waiter->target_shepherd == NO_SHEPHERD) {
-          qt_threadqueue_enqueue(shep->ready, precond_head->waiter);
+          qt_threadqueue_enqueue(shep ? shep->ready : qlib->shepherds[0].ready,
+                                 precond_head->waiter);
         } else {
           qt_threadqueue_enqueue(
             qlib->shepherds[precond_head->waiter->target_shepherd].ready,
@@ -340,7 +432,8 @@ qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
                             qthread_addrstat_t *m,
                             void *maddr,
                             uint_fast8_t const recursive,
-                            qthread_addrres_t **precond_tasks) { /*{{{ */
+                            qthread_addrres_t **precond_tasks,
+                            qthread_addrres_t **externals) { /*{{{ */
   qthread_addrres_t *X = NULL;
   int removeable;
 
@@ -355,9 +448,8 @@ qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
     if (maddr && (maddr != X->addr)) { *(aligned_t *)maddr = *(X->addr); }
     MACHINE_FENCE;
     /* requeue */
-    qt_feb_schedule(X->waiter, shep);
-    FREE_ADDRRES(X);
-    qthread_gotlock_fill_inner(shep, m, maddr, 1, precond_tasks);
+    qt_feb_release(X, shep, externals);
+    qthread_gotlock_fill_inner(shep, m, maddr, 1, precond_tasks, externals);
   }
   if ((m->full == 1) && (m->EFQ == NULL) && (m->FEQ == NULL) &&
       (m->FFQ == NULL) && (m->FFWQ == NULL)) {
@@ -367,8 +459,10 @@ qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
   }
   if (recursive == 0) {
     QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    qt_feb_release_externals(*externals);
     if (*precond_tasks) { qthread_precond_launch(shep, *precond_tasks); }
     if (removeable) { qthread_FEB_remove(maddr); }
+    qt_feb_handoff();
   }
 } /*}}} */
 
@@ -376,8 +470,9 @@ static inline void qthread_gotlock_empty(qthread_shepherd_t *shep,
                                          qthread_addrstat_t *m,
                                          void *maddr) {
   qthread_addrres_t *tmp = NULL;
+  qthread_addrres_t *externals = NULL;
 
-  qthread_gotlock_empty_inner(shep, m, maddr, 0, &tmp);
+  qthread_gotlock_empty_inner(shep, m, maddr, 0, &tmp, &externals);
 }
 
 static inline void
@@ -385,7 +480,8 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
                            qthread_addrstat_t *m,
                            void *maddr,
                            uint_fast8_t const recursive,
-                           qthread_addrres_t **precond_tasks) { /*{{{ */
+                           qthread_addrres_t **precond_tasks,
+                           qthread_addrres_t **externals) { /*{{{ */
   qthread_addrres_t *X = NULL;
 
   assert(m);
@@ -403,8 +499,9 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
     MACHINE_FENCE;
     /* schedule */
     qthread_t *waiter = X->waiter;
-    if (QTHREAD_STATE_NASCENT ==
-        atomic_load_explicit(&waiter->thread_state, memory_order_relaxed)) {
+    if (waiter &&
+        (QTHREAD_STATE_NASCENT ==
+         atomic_load_explicit(&waiter->thread_state, memory_order_relaxed))) {
       if (*precond_tasks == NULL) {
         /* create empty head to avoid later checks/branches; use the waiter to
          * find the tail */
@@ -427,8 +524,7 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
       ((qthread_addrres_t *)((*precond_tasks)->waiter))->next = X;
       (*precond_tasks)->waiter = (void *)X;
     } else {
-      qt_feb_schedule(waiter, shep);
-      FREE_ADDRRES(X);
+      qt_feb_release(X, shep, externals);
     }
   }
   /* dequeue all FFQ, do their operation, and schedule them */
@@ -436,6 +532,11 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
     /* dQ */
     X = m->FFQ;
     m->FFQ = X->next;
+    if (X->multi && !qt_multiwait_claim(X->multi, maddr)) {
+      /* part of an "any" wait that is already over */
+      FREE_ADDRRES(X);
+      continue;
+    }
     /* op */
     if (X->addr && (X->addr != maddr)) {
       *(aligned_t *)(X->addr) = *(aligned_t *)maddr;
@@ -443,8 +544,9 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
     MACHINE_FENCE;
     /* schedule */
     qthread_t *waiter = X->waiter;
-    if (QTHREAD_STATE_NASCENT ==
-        atomic_load_explicit(&waiter->thread_state, memory_order_relaxed)) {
+    if (waiter &&
+        (QTHREAD_STATE_NASCENT ==
+         atomic_load_explicit(&waiter->thread_state, memory_order_relaxed))) {
       if (*precond_tasks == NULL) {
         /* create empty head to avoid later checks/branches; use the waiter to
          * find the tail */
@@ -454,8 +556,7 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
       ((qthread_addrres_t *)((*precond_tasks)->waiter))->next = X;
       (*precond_tasks)->waiter = (void *)X;
     } else {
-      qt_feb_schedule(waiter, shep);
-      FREE_ADDRRES(X);
+      qt_feb_release(X, shep, externals);
     }
   }
   if (m->FEQ != NULL) {
@@ -467,9 +568,8 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
       *(aligned_t *)(X->addr) = *(aligned_t *)maddr;
     }
     MACHINE_FENCE;
-    qt_feb_schedule(X->waiter, shep);
-    FREE_ADDRRES(X);
-    qthread_gotlock_empty_inner(shep, m, maddr, 1, precond_tasks);
+    qt_feb_release(X, shep, externals);
+    qthread_gotlock_empty_inner(shep, m, maddr, 1, precond_tasks, externals);
   }
   if (recursive == 0) {
     int removeable;
@@ -479,9 +579,11 @@ qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
       removeable = 0;
     }
     QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    qt_feb_release_externals(*externals);
     if (*precond_tasks) { qthread_precond_launch(shep, *precond_tasks); }
     /* now, remove it if it needs to be removed */
     if (removeable) { qthread_FEB_remove(maddr); }
+    qt_feb_handoff();
   }
 } /*}}} */
 
@@ -489,8 +591,9 @@ static inline void qthread_gotlock_fill(qthread_shepherd_t *shep,
                                         qthread_addrstat_t *m,
                                         void *maddr) {
   qthread_addrres_t *tmp = NULL;
+  qthread_addrres_t *externals = NULL;
 
-  qthread_gotlock_fill_inner(shep, m, maddr, 0, &tmp);
+  qthread_gotlock_fill_inner(shep, m, maddr, 0, &tmp, &externals);
 }
 
 int API_FUNC qthread_empty(aligned_t const *dest) { /*{{{ */
@@ -502,7 +605,6 @@ int API_FUNC qthread_empty(aligned_t const *dest) { /*{{{ */
 
   assert(qthread_library_initialized);
 
-  if (!shep) { return qthread_feb_blocker_func((void *)dest, NULL, EMPTY); }
   alignedaddr = dest;
   {
     int const lockbin = QTHREAD_CHOOSE_STRIPE2(alignedaddr);
@@ -519,7 +621,9 @@ int API_FUNC qthread_empty(aligned_t const *dest) { /*{{{ */
       if (!m) { return QTHREAD_MALLOC_ERROR; }
       m->full = 0;
       MACHINE_FENCE;
+      qt_feb_filter_add((void *)alignedaddr);
       if (!qt_hash_put(FEBbin, (void *)alignedaddr, m)) {
+        qt_feb_filter_drop((void *)alignedaddr);
         qthread_addrstat_delete(m);
         continue;
       }
@@ -554,6 +658,7 @@ int API_FUNC qthread_empty(aligned_t const *dest) { /*{{{ */
         return QTHREAD_MALLOC_ERROR;
       }
       m->full = 0;
+      qt_feb_filter_add((void *)alignedaddr);
       qassertnot(qt_hash_put_locked(FEBbin, (void *)alignedaddr, m), 0);
       m = NULL;
     } else {
@@ -571,13 +676,13 @@ int API_FUNC qthread_fill(aligned_t const *dest) { /*{{{ */
   aligned_t const *alignedaddr;
 
   if (qlib == NULL) { return QTHREAD_SUCCESS; }
+  if (qt_feb_filter_absent(dest)) { return QTHREAD_SUCCESS; } /* full */
   qthread_addrstat_t *m;
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
   qthread_shepherd_t *shep = qthread_internal_getshep();
 
   assert(qthread_library_initialized);
 
-  if (!shep) { return qthread_feb_blocker_func((void *)dest, NULL, FILL); }
   alignedaddr = dest;
   /* lock hash */
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
@@ -623,13 +728,17 @@ int API_FUNC qthread_fill(aligned_t const *dest) { /*{{{ */
 int API_FUNC qthread_writeF(aligned_t *dest, aligned_t const *src) { /*{{{ */
   aligned_t *alignedaddr;
 
+  if (qt_feb_filter_absent(dest)) { /* already full, nobody to wake */
+    if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+    MACHINE_FENCE;
+    return QTHREAD_SUCCESS;
+  }
   qthread_addrstat_t *m;
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
   qthread_shepherd_t *shep = qthread_internal_getshep();
 
   assert(qthread_library_initialized);
 
-  if (!shep) { return qthread_feb_blocker_func(dest, (void *)src, WRITEF); }
   alignedaddr = dest;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -688,7 +797,6 @@ int API_FUNC qthread_purge_to(aligned_t *restrict dest,
 
   assert(qthread_library_initialized);
 
-  if (!shep) { return qthread_feb_blocker_func(dest, (void *)src, PURGE); }
   alignedaddr = dest;
   {
     int const lockbin = QTHREAD_CHOOSE_STRIPE2(alignedaddr);
@@ -705,7 +813,9 @@ int API_FUNC qthread_purge_to(aligned_t *restrict dest,
       if (!m) { return QTHREAD_MALLOC_ERROR; }
       m->full = 0;
       MACHINE_FENCE;
+      qt_feb_filter_add((void *)alignedaddr);
       if (!qt_hash_put(FEBbin, (void *)alignedaddr, m)) {
+        qt_feb_filter_drop((void *)alignedaddr);
         qthread_addrstat_delete(m);
         continue;
       }
@@ -740,6 +850,7 @@ int API_FUNC qthread_purge_to(aligned_t *restrict dest,
         return QTHREAD_MALLOC_ERROR;
       }
       m->full = 0;
+      qt_feb_filter_add((void *)alignedaddr);
       qassertnot(qt_hash_put_locked(FEBbin, (void *)alignedaddr, m), 0);
       m = NULL;
     } else {
@@ -780,7 +891,6 @@ int API_FUNC qthread_writeEF(aligned_t *restrict dest,
 
   assert(qthread_library_initialized);
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, WRITEEF); }
   alignedaddr = dest;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -795,7 +905,9 @@ int API_FUNC qthread_writeEF(aligned_t *restrict dest,
         return QTHREAD_MALLOC_ERROR;
       }
       QTHREAD_FASTLOCK_LOCK(&m->lock);
+      qt_feb_filter_add((void *)alignedaddr);
       if (!qt_hash_put(FEBs[lockbin], (void *)alignedaddr, m)) {
+        qt_feb_filter_drop((void *)alignedaddr);
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
         qthread_addrstat_delete(m);
         continue;
@@ -830,6 +942,7 @@ int API_FUNC qthread_writeEF(aligned_t *restrict dest,
         qt_hash_unlock(FEBs[lockbin]);
         return QTHREAD_MALLOC_ERROR;
       }
+      qt_feb_filter_add(alignedaddr);
       qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
     }
     QTHREAD_FASTLOCK_LOCK(&(m->lock));
@@ -839,6 +952,10 @@ int API_FUNC qthread_writeEF(aligned_t *restrict dest,
   assert(m);
   /* by this point m is locked */
   if (m->full == 1) { /* full, thus, we must block */
+    if (!me) {
+      qt_addrres_external_wait(m, &m->EFQ, (aligned_t *)src);
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     if (X == NULL) {
       QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
@@ -858,7 +975,7 @@ int API_FUNC qthread_writeEF(aligned_t *restrict dest,
   } else {
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
     MACHINE_FENCE;
-    qthread_gotlock_fill(me->rdata->shepherd_ptr, m, alignedaddr);
+    qthread_gotlock_fill(me ? me->rdata->shepherd_ptr : NULL, m, alignedaddr);
   }
   return QTHREAD_SUCCESS;
 } /*}}} */
@@ -875,7 +992,6 @@ int API_FUNC qthread_writeEF_nb(aligned_t *restrict dest,
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
   qthread_t *me = qthread_internal_self();
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, WRITEEF); }
   alignedaddr = dest;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -910,7 +1026,7 @@ int API_FUNC qthread_writeEF_nb(aligned_t *restrict dest,
   } else {
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
     MACHINE_FENCE;
-    qthread_gotlock_fill(me->rdata->shepherd_ptr, m, alignedaddr);
+    qthread_gotlock_fill(me ? me->rdata->shepherd_ptr : NULL, m, alignedaddr);
   }
   return QTHREAD_SUCCESS;
 } /*}}} */
@@ -927,6 +1043,11 @@ int API_FUNC qthread_writeFF(aligned_t *restrict dest,
                              aligned_t const *restrict src) { /*{{{ */
   aligned_t const *alignedaddr;
 
+  if (qt_feb_filter_absent(dest)) { /* already full! */
+    if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+    MACHINE_FENCE;
+    return QTHREAD_SUCCESS;
+  }
   qthread_addrstat_t *m = NULL;
   qthread_addrres_t *X = NULL;
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
@@ -934,7 +1055,6 @@ int API_FUNC qthread_writeFF(aligned_t *restrict dest,
 
   assert(qthread_library_initialized);
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, WRITEFF); }
   alignedaddr = dest;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -965,6 +1085,10 @@ int API_FUNC qthread_writeFF(aligned_t *restrict dest,
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
     MACHINE_FENCE;
   } else if (m->full != 1) { /* not full... so we must block */
+    if (!me) {
+      qt_addrres_external_wait(m, &m->FFWQ, (aligned_t *)src);
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     if (X == NULL) {
       QTHREAD_FASTLOCK_UNLOCK(&m->lock);
@@ -1002,6 +1126,11 @@ int API_FUNC qthread_readFF(aligned_t *restrict dest,
                             aligned_t const *restrict src) { /*{{{ */
   aligned_t const *alignedaddr;
 
+  if (qt_feb_filter_absent(src)) { /* already full! */
+    MACHINE_FENCE;
+    if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+    return QTHREAD_SUCCESS;
+  }
   qthread_addrstat_t *m = NULL;
   qthread_addrres_t *X = NULL;
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(src);
@@ -1009,7 +1138,6 @@ int API_FUNC qthread_readFF(aligned_t *restrict dest,
 
   assert(qthread_library_initialized);
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, READFF); }
   alignedaddr = src;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -1040,6 +1168,10 @@ int API_FUNC qthread_readFF(aligned_t *restrict dest,
     MACHINE_FENCE;
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
   } else if (m->full != 1) { /* not full... so we must block */
+    if (!me) {
+      qt_addrres_external_wait(m, &m->FFQ, (aligned_t *)dest);
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     if (X == NULL) {
       QTHREAD_FASTLOCK_UNLOCK(&m->lock);
@@ -1068,11 +1200,14 @@ int API_FUNC qthread_readFF_nb(aligned_t *restrict dest,
                                aligned_t const *restrict src) { /*{{{ */
   aligned_t const *alignedaddr;
 
+  if (qt_feb_filter_absent(src)) { /* already full! */
+    MACHINE_FENCE;
+    if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+    return QTHREAD_SUCCESS;
+  }
   qthread_addrstat_t *m = NULL;
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(src);
-  qthread_t *me = qthread_internal_self();
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, READFF_NB); }
   alignedaddr = src;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -1118,6 +1253,369 @@ int API_FUNC qthread_readFF_nb(aligned_t *restrict dest,
   return QTHREAD_SUCCESS;
 } /*}}} */
 
+/* Find and lock the addrstat of addr; NULL means that addr is full (and has
+ * nobody waiting on it). */
+static inline qthread_addrstat_t *
+qt_feb_getlocked(aligned_t const *addr) { /*{{{ */
+  if (qt_feb_filter_absent(addr)) { return NULL; }
+  qthread_addrstat_t *m = NULL;
+  int const lockbin = QTHREAD_CHOOSE_STRIPE2(addr);
+
+  QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
+#ifdef LOCK_FREE_FEBS
+  do {
+    m = qt_hash_get(FEBs[lockbin], (void *)addr);
+    if (!m) { break; }
+    hazardous_ptr(0, m);
+    if (m != qt_hash_get(FEBs[lockbin], (void *)addr)) { continue; }
+    if (!m->valid) { continue; }
+    QTHREAD_FASTLOCK_LOCK(&m->lock);
+    if (!m->valid) {
+      QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+      continue;
+    }
+    break;
+  } while (1);
+#else  /* ifdef LOCK_FREE_FEBS */
+  qt_hash_lock(FEBs[lockbin]);
+  m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)addr);
+  if (m) { QTHREAD_FASTLOCK_LOCK(&m->lock); }
+  qt_hash_unlock(FEBs[lockbin]);
+#endif /* ifdef LOCK_FREE_FEBS */
+  return m;
+} /*}}} */
+
+/* Find (or make) and lock the addrstat of addr; NULL means that memory ran
+ * out */
+static inline qthread_addrstat_t *
+qt_feb_getlocked_new(aligned_t const *addr) { /*{{{ */
+  qthread_addrstat_t *m;
+  int const lockbin = QTHREAD_CHOOSE_STRIPE2(addr);
+
+  QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
+#ifdef LOCK_FREE_FEBS
+  do {
+    m = qt_hash_get(FEBs[lockbin], (void *)addr);
+  got_m:
+    if (!m) {
+      m = qthread_addrstat_new();
+      if (!m) { return NULL; }
+      QTHREAD_FASTLOCK_LOCK(&m->lock);
+      qt_feb_filter_add((void *)addr);
+      if (!qt_hash_put(FEBs[lockbin], (void *)addr, m)) {
+        qt_feb_filter_drop((void *)addr);
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        qthread_addrstat_delete(m);
+        continue;
+      }
+      break;
+    } else {
+      qthread_addrstat_t *m2;
+
+      hazardous_ptr(0, m);
+      if (m != (m2 = qt_hash_get(FEBs[lockbin], (void *)addr))) {
+        m = m2;
+        goto got_m;
+      }
+      if (!m->valid) { continue; }
+      QTHREAD_FASTLOCK_LOCK(&m->lock);
+      if (!m->valid) {
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        continue;
+      }
+      break;
+    }
+  } while (1);
+#else  /* ifdef LOCK_FREE_FEBS */
+  qt_hash_lock(FEBs[lockbin]);
+  m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)addr);
+  if (!m) {
+    m = qthread_addrstat_new();
+    if (!m) {
+      qt_hash_unlock(FEBs[lockbin]);
+      return NULL;
+    }
+    qt_feb_filter_add((void *)addr);
+    qassertnot(qt_hash_put_locked(FEBs[lockbin], (void *)addr, m), 0);
+  }
+  QTHREAD_FASTLOCK_LOCK(&m->lock);
+  qt_hash_unlock(FEBs[lockbin]);
+#endif /* ifdef LOCK_FREE_FEBS */
+  return m;
+} /*}}} */
+
+/* Take whatever nodes of w are still queued on srcs[0..n-1] back out; returns
+ * how many there were */
+static size_t qt_feb_multiwait_cancel(aligned_t const *const *srcs,
+                                      size_t n,
+                                      qthread_multiwait_t *w) { /*{{{ */
+  size_t found = 0;
+
+  for (size_t i = 0; i < n; ++i) {
+    qthread_addrstat_t *m = qt_feb_getlocked(srcs[i]);
+    qthread_addrres_t **queues[3];
+    int removeable;
+
+    if (m == NULL) { continue; }
+    queues[0] = &m->FFQ;
+    queues[1] = &m->FEQ;
+    queues[2] = &m->EFQ;
+    for (int q = 0; q < 3; ++q) {
+      qthread_addrres_t **base = queues[q];
+
+      while (*base) {
+        qthread_addrres_t *X = *base;
+        if (X->multi == w) {
+          *base = X->next;
+          FREE_ADDRRES(X);
+          found++;
+        } else {
+          base = &X->next;
+        }
+      }
+    }
+    removeable = (m->full == 1) && (m->EFQ == NULL) && (m->FEQ == NULL) &&
+                 (m->FFQ == NULL) && (m->FFWQ == NULL);
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    if (removeable) { qthread_FEB_remove((void *)srcs[i]); }
+  }
+  return found;
+} /*}}} */
+
+/* Queue one node of w on each of srcs[0..n-1] that is empty. For an "any"
+ * wait, stop at the first one that is full. Returns how many of srcs were
+ * looked at, or -1 if a node could not be allocated. */
+static ssize_t qt_feb_multiwait_queue(aligned_t const *const *srcs,
+                                      size_t n,
+                                      qthread_multiwait_t *w,
+                                      qthread_t *me) { /*{{{ */
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    qthread_addrstat_t *m = qt_feb_getlocked(srcs[i]);
+    qthread_addrres_t *X;
+
+    if ((m == NULL) || (m->full == 1)) {
+      if (m) { QTHREAD_FASTLOCK_UNLOCK(&m->lock); }
+      if (w->any) {
+        qt_multiwait_hit(w, srcs[i]);
+        return i;
+      }
+      continue;
+    }
+    X = ALLOC_ADDRRES();
+    if (X == NULL) {
+      QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+      qt_feb_multiwait_cancel(srcs, i, w);
+      return -1;
+    }
+    X->addr = NULL;
+    X->waiter = me;
+    X->multi = w;
+    X->next = m->FFQ;
+    m->FFQ = X;
+    if (!w->any) {
+      atomic_fetch_add_explicit(&w->pending, 1, memory_order_relaxed);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  }
+  return i;
+} /*}}} */
+
+/* Sleep until w's wait (on FEBs or syncvars) is over, unless it already is */
+void INTERNAL qt_multiwait_block(qthread_multiwait_t *w,
+                                 qthread_t *me) { /*{{{ */
+  if (atomic_load_explicit(&w->pending, memory_order_acquire) == 1) {
+    /* only our own hold is left: nothing queued can release us */
+    return;
+  }
+  if (me) {
+    atomic_store_explicit(
+      &me->thread_state, QTHREAD_STATE_MULTI_BLOCKED, memory_order_relaxed);
+    me->rdata->blockedon.multi = w;
+    qthread_back_to_master(me);
+  } else {
+    qt_multiwait_external_wait(w);
+  }
+  MACHINE_FENCE;
+} /*}}} */
+
+/* Let w's waiter go, from outside of any FEB or syncvar operation (i.e. from
+ * the expiry of a timed wait); waiter is NULL for a pthread */
+void INTERNAL qt_multiwait_wake(qthread_multiwait_t *w,
+                                qthread_t *waiter) { /*{{{ */
+  if (waiter) {
+    atomic_store_explicit(
+      &waiter->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
+    qt_feb_enqueue(waiter, NULL);
+  } else {
+    atomic_store_explicit(&w->released, 1, memory_order_release);
+    qt_futex_wake(&w->released, 1);
+  }
+} /*}}} */
+
+int API_FUNC qthread_readFF_any(aligned_t const *const *srcs,
+                                size_t n,
+                                size_t *index) { /*{{{ */
+  qthread_multiwait_t w;
+  qthread_t *me = qthread_internal_self();
+  ssize_t queued;
+  void const *hit;
+
+  assert(qthread_library_initialized);
+  qassert_ret(srcs && n > 0, QTHREAD_BADARGS);
+
+  qt_multiwait_init(&w, 1);
+  queued = qt_feb_multiwait_queue(srcs, n, &w, me);
+  if (queued < 0) { return QTHREAD_MALLOC_ERROR; }
+  qt_multiwait_block(&w, me);
+  /* the fills that came too late left their nodes behind */
+  qt_feb_multiwait_cancel(srcs, queued, &w);
+  hit = atomic_load_explicit(&w.hit, memory_order_relaxed);
+  assert(hit);
+  if (index) {
+    size_t i = 0;
+    while (srcs[i] != hit) { ++i; }
+    *index = i;
+  }
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_readFF_all(aligned_t const *const *srcs,
+                                size_t n) { /*{{{ */
+  qthread_multiwait_t w;
+  qthread_t *me = qthread_internal_self();
+
+  assert(qthread_library_initialized);
+  qassert_ret(srcs || n == 0, QTHREAD_BADARGS);
+
+  qt_multiwait_init(&w, 0);
+  if (qt_feb_multiwait_queue(srcs, n, &w, me) < 0) {
+    return QTHREAD_MALLOC_ERROR;
+  }
+  /* every node is taken off by the fill it was waiting for */
+  qt_multiwait_block(&w, me);
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+/* The timed operations block the way their untimed versions do, with a node
+ * that is part of an "any" multi-wait on the waiter's stack; the timer, if it
+ * goes off first, takes the node back out of its queue (under the addrstat
+ * lock, as the operation that would have dequeued it does), claims the wait
+ * with the multi-wait itself as the address, and lets the waiter go. */
+typedef struct {
+  qthread_multiwait_t w;
+  aligned_t const *addr;
+  qthread_t *waiter;
+} qt_feb_timedwait_t;
+
+static aligned_t qt_feb_timed_expire(void *arg) { /*{{{ */
+  qt_feb_timedwait_t *tw = (qt_feb_timedwait_t *)arg;
+
+  if (qt_feb_multiwait_cancel(&tw->addr, 1, &tw->w) &&
+      qt_multiwait_hit(&tw->w, &tw->w)) {
+    qt_multiwait_wake(&tw->w, tw->waiter);
+  }
+  return 0;
+} /*}}} */
+
+/* Block on queue q of addr's addrstat m, which is locked, with addr as the
+ * address the dequeuing operation works with, for at most nsecs */
+static int qt_feb_timed_block(qthread_addrstat_t *m,
+                              qthread_addrres_t **q,
+                              aligned_t const *key,
+                              aligned_t *addr,
+                              uint64_t nsecs) { /*{{{ */
+  qt_feb_timedwait_t tw;
+  qthread_addrres_t *X = NULL;
+
+  if (nsecs > 0) { X = ALLOC_ADDRRES(); }
+  if (X == NULL) {
+    int const removeable = (m->full == 1) && (m->EFQ == NULL) &&
+                           (m->FEQ == NULL) && (m->FFQ == NULL) &&
+                           (m->FFWQ == NULL);
+
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    if (removeable) { qthread_FEB_remove((void *)key); }
+    return (nsecs > 0) ? QTHREAD_MALLOC_ERROR : ETIMEDOUT;
+  }
+  qt_multiwait_init(&tw.w, 1);
+  tw.addr = key;
+  tw.waiter = qthread_internal_self();
+  X->addr = addr;
+  X->waiter = tw.waiter;
+  X->multi = &tw.w;
+  X->next = *q;
+  *q = X;
+  QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  qt_timer_block(&tw.w, tw.waiter, nsecs, qt_feb_timed_expire, &tw);
+  if (atomic_load_explicit(&tw.w.hit, memory_order_relaxed) == &tw.w) {
+    return ETIMEDOUT;
+  }
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_readFE_timed(aligned_t *restrict dest,
+                                  aligned_t const *restrict src,
+                                  uint64_t nsecs) { /*{{{ */
+  qthread_addrstat_t *m;
+  qthread_t *me = qthread_internal_self();
+
+  assert(qthread_library_initialized);
+
+  m = qt_feb_getlocked_new(src);
+  if (m == NULL) { return QTHREAD_MALLOC_ERROR; }
+  if (m->full == 0) {
+    return qt_feb_timed_block(m, &m->FEQ, src, dest, nsecs);
+  }
+  MACHINE_FENCE;
+  if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+  qthread_gotlock_empty(me ? me->rdata->shepherd_ptr : NULL, m, (void *)src);
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_readFF_timed(aligned_t *restrict dest,
+                                  aligned_t const *restrict src,
+                                  uint64_t nsecs) { /*{{{ */
+  qthread_addrstat_t *m;
+
+  assert(qthread_library_initialized);
+
+  m = qt_feb_getlocked(src);
+  if ((m != NULL) && (m->full == 0)) {
+    return qt_feb_timed_block(m, &m->FFQ, src, dest, nsecs);
+  }
+  MACHINE_FENCE;
+  if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+  if (m) { QTHREAD_FASTLOCK_UNLOCK(&m->lock); }
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_writeEF_timed(aligned_t *restrict dest,
+                                   aligned_t const *restrict src,
+                                   uint64_t nsecs) { /*{{{ */
+  qthread_addrstat_t *m;
+  qthread_t *me = qthread_internal_self();
+
+  assert(qthread_library_initialized);
+
+  m = qt_feb_getlocked_new(dest);
+  if (m == NULL) { return QTHREAD_MALLOC_ERROR; }
+  if (m->full == 1) {
+    return qt_feb_timed_block(m, &m->EFQ, dest, (aligned_t *)src, nsecs);
+  }
+  if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
+  MACHINE_FENCE;
+  qthread_gotlock_fill(me ? me->rdata->shepherd_ptr : NULL, m, dest);
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_writeEF_const_timed(aligned_t *dest,
+                                         aligned_t src,
+                                         uint64_t nsecs) { /*{{{ */
+  return qthread_writeEF_timed(dest, &src, nsecs);
+} /*}}} */
+
 /* the way this works is that:
  * 1 - src's FEB state must be "full"
  * 2 - data is copied from src to destination
@@ -1134,8 +1632,7 @@ int API_FUNC qthread_readFE(aligned_t *restrict dest,
 
   assert(qthread_library_initialized);
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, READFE); }
-  assert(me->rdata);
+  assert(me == NULL || me->rdata);
   alignedaddr = src;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -1147,7 +1644,9 @@ int API_FUNC qthread_readFE(aligned_t *restrict dest,
       m = qthread_addrstat_new();
       if (!m) { return QTHREAD_MALLOC_ERROR; }
       QTHREAD_FASTLOCK_LOCK(&m->lock);
+      qt_feb_filter_add(alignedaddr);
       if (!qt_hash_put(FEBs[lockbin], alignedaddr, m)) {
+        qt_feb_filter_drop(alignedaddr);
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
         qthread_addrstat_delete(m);
         continue;
@@ -1180,6 +1679,7 @@ int API_FUNC qthread_readFE(aligned_t *restrict dest,
         qt_hash_unlock(FEBs[lockbin]);
         return QTHREAD_MALLOC_ERROR;
       }
+      qt_feb_filter_add(alignedaddr);
       qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
     }
     QTHREAD_FASTLOCK_LOCK(&(m->lock));
@@ -1189,8 +1689,13 @@ int API_FUNC qthread_readFE(aligned_t *restrict dest,
   assert(m);
   /* by this point m is locked */
   if (m->full == 0) { /* empty, thus, we must block */
-    qthread_addrres_t *X = ALLOC_ADDRRES();
+    qthread_addrres_t *X;
 
+    if (!me) {
+      qt_addrres_external_wait(m, &m->FEQ, (aligned_t *)dest);
+      return QTHREAD_SUCCESS;
+    }
+    X = ALLOC_ADDRRES();
     if (X == NULL) {
       QTHREAD_FASTLOCK_UNLOCK(&m->lock);
       return QTHREAD_MALLOC_ERROR;
@@ -1210,7 +1715,8 @@ int API_FUNC qthread_readFE(aligned_t *restrict dest,
   } else { /* full, thus IT IS OURS! MUAHAHAHA! */
     MACHINE_FENCE;
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
-    qthread_gotlock_empty(me->rdata->shepherd_ptr, m, (void *)alignedaddr);
+    qthread_gotlock_empty(
+      me ? me->rdata->shepherd_ptr : NULL, m, (void *)alignedaddr);
   }
   return QTHREAD_SUCCESS;
 } /*}}} */
@@ -1237,7 +1743,6 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict dest,
   int const lockbin = QTHREAD_CHOOSE_STRIPE2(src);
   qthread_t *me = qthread_internal_self();
 
-  if (!me) { return qthread_feb_blocker_func(dest, (void *)src, READFE_NB); }
   alignedaddr = src;
   QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -1248,7 +1753,9 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict dest,
       m = qthread_addrstat_new();
       if (!m) { return QTHREAD_MALLOC_ERROR; }
       QTHREAD_FASTLOCK_LOCK(&m->lock);
+      qt_feb_filter_add(alignedaddr);
       if (!qt_hash_put(FEBs[lockbin], alignedaddr, m)) {
+        qt_feb_filter_drop(alignedaddr);
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
         qthread_addrstat_delete(m);
         continue;
@@ -1277,6 +1784,7 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict dest,
         qt_hash_unlock(FEBs[lockbin]);
         return QTHREAD_MALLOC_ERROR;
       }
+      qt_feb_filter_add(alignedaddr);
       qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
     }
     QTHREAD_FASTLOCK_LOCK(&(m->lock));
@@ -1290,7 +1798,8 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict dest,
   } else { /* full, thus IT IS OURS! MUAHAHAHA! */
     MACHINE_FENCE;
     if (dest && (dest != src)) { *(aligned_t *)dest = *(aligned_t *)src; }
-    qthread_gotlock_empty(me->rdata->shepherd_ptr, m, (void *)alignedaddr);
+    qthread_gotlock_empty(
+      me ? me->rdata->shepherd_ptr : NULL, m, (void *)alignedaddr);
   }
   return QTHREAD_SUCCESS;
 } /*}}} */
@@ -1409,14 +1918,15 @@ static filter_code qt_feb_tf_call_cb(qt_key_t const addr,
   if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
     if (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
         QTHREAD_BIG_STRUCT) {
-      tls = &waiter->data[qlib->qthread_argcopy_size];
+      tls = &waiter->data[qlib->qthread_argcopy_classes[waiter->argclass]];
     } else {
       tls = waiter->data;
     }
   } else {
     if (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
         QTHREAD_BIG_STRUCT) {
-      tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
+      tls = *(void **)&waiter
+               ->data[qlib->qthread_argcopy_classes[waiter->argclass]];
     } else {
       tls = *(void **)&waiter->data[0];
     }
@@ -1460,6 +1970,10 @@ qt_feb_call_tf(qt_key_t const addr, qthread_addrstat_t *m, void *arg) { /*{{{*/
     }
     for (; curs != NULL; curs = curs->next) {
       qthread_t *waiter = curs->waiter;
+      if (waiter == NULL) { /* a pthread, not a task */
+        base = &curs->next;
+        continue;
+      }
       switch (tf(addr, waiter, f_arg)) {
         case IGNORE_AND_CONTINUE: // ignore, move to the next one
           base = &curs->next;
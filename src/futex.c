@@ -0,0 +1,99 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* System Headers */
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define QT_USE_LINUX_FUTEX 1
+#else
+#include <pthread.h>
+#endif
+
+/* Internal Headers */
+#include "qt_futex.h"
+#include "qt_visibility.h"
+
+#ifdef QT_USE_LINUX_FUTEX
+
+int INTERNAL qt_futex_wait(_Atomic uint32_t *addr,
+                           uint32_t val,
+                           struct timespec const *reltime) { /*{{{*/
+  if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, reltime, NULL, 0) ==
+      -1) {
+    return (errno == ETIMEDOUT) ? ETIMEDOUT : 0;
+  }
+  return 0;
+} /*}}}*/
+
+void INTERNAL qt_futex_wake(_Atomic uint32_t *addr, int count) { /*{{{*/
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+} /*}}}*/
+
+#else /* ifdef QT_USE_LINUX_FUTEX */
+
+/* Without futexes, hash addresses onto a small table of condition variables.
+ * Waking has to broadcast, since unrelated addresses may share a bucket. */
+#define QT_FUTEX_BUCKETS 64
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} futex_buckets[QT_FUTEX_BUCKETS];
+static pthread_once_t futex_buckets_once = PTHREAD_ONCE_INIT;
+
+static void qt_futex_buckets_init(void) { /*{{{*/
+  for (int i = 0; i < QT_FUTEX_BUCKETS; i++) {
+    pthread_mutex_init(&futex_buckets[i].lock, NULL);
+    pthread_cond_init(&futex_buckets[i].cond, NULL);
+  }
+} /*}}}*/
+
+#define FUTEX_BUCKET(addr)                                                     \
+  (&futex_buckets[(((uintptr_t)(addr)) >> 2) % QT_FUTEX_BUCKETS])
+
+int INTERNAL qt_futex_wait(_Atomic uint32_t *addr,
+                           uint32_t val,
+                           struct timespec const *reltime) { /*{{{*/
+  int ret = 0;
+
+  pthread_once(&futex_buckets_once, qt_futex_buckets_init);
+  pthread_mutex_lock(&FUTEX_BUCKET(addr)->lock);
+  if (atomic_load_explicit(addr, memory_order_acquire) == val) {
+    if (reltime) {
+      struct timespec t;
+      struct timeval n;
+      gettimeofday(&n, NULL);
+      t.tv_sec = n.tv_sec + reltime->tv_sec;
+      t.tv_nsec = (n.tv_usec * 1000) + reltime->tv_nsec;
+      if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+      }
+      ret = pthread_cond_timedwait(
+        &FUTEX_BUCKET(addr)->cond, &FUTEX_BUCKET(addr)->lock, &t);
+    } else {
+      pthread_cond_wait(&FUTEX_BUCKET(addr)->cond, &FUTEX_BUCKET(addr)->lock);
+    }
+  }
+  pthread_mutex_unlock(&FUTEX_BUCKET(addr)->lock);
+  return (ret == ETIMEDOUT) ? ETIMEDOUT : 0;
+} /*}}}*/
+
+void INTERNAL qt_futex_wake(_Atomic uint32_t *addr, int count) { /*{{{*/
+  pthread_once(&futex_buckets_once, qt_futex_buckets_init);
+  pthread_mutex_lock(&FUTEX_BUCKET(addr)->lock);
+  pthread_cond_broadcast(&FUTEX_BUCKET(addr)->cond);
+  pthread_mutex_unlock(&FUTEX_BUCKET(addr)->lock);
+} /*}}}*/
+
+#endif /* ifdef QT_USE_LINUX_FUTEX */
+
+/* vim:set expandtab: */
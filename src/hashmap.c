@@ -10,6 +10,7 @@
 #include <qthread/hash.h>
 
 /* Internal Headers */
+#include "qt_affinity.h"
 #include "qt_alloc.h"
 #include "qt_asserts.h"
 #include "qt_atomics.h"
@@ -37,6 +38,10 @@ struct qt_hash_s {
   size_t grow_size, shrink_size, tidy_up_size; // cache for speed
   void *value[2];                              // handle out-of-bound values
   short has_key[2];
+  int node; // -1, or the NUMA node everything above is bound to
+#ifdef QTHREAD_COUNT_THREADS
+  size_t _Atomic contended; // lock acquisitions that had to wait
+#endif
 };
 
 static uint_fast8_t linesize = 0;
@@ -75,8 +80,14 @@ static inline void qt_hash_internal_create(qt_hash ret,
     ret->shrink_size = entries * 0.030f;
   }
   /* data storage */
-  ret->entries =
-    qt_internal_aligned_alloc(sizeof(hash_entry) * entries, linesize);
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+  if (ret->node >= 0) {
+    ret->entries =
+      qt_affinity_alloc_onnode(sizeof(hash_entry) * entries, ret->node);
+  } else
+#endif
+    ret->entries =
+      qt_internal_aligned_alloc(sizeof(hash_entry) * entries, linesize);
   assert(ret->entries);
   if (ret->entries) {
     memset(ret->entries, 0, sizeof(hash_entry) * entries);
@@ -86,6 +97,29 @@ static inline void qt_hash_internal_create(qt_hash ret,
   }
 } /*}}}*/
 
+static inline void qt_hash_internal_free_entries(qt_hash h) { /*{{{*/
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+  if (h->node >= 0) {
+    qt_affinity_free(h->entries, sizeof(hash_entry) * h->num_entries);
+    return;
+  }
+#endif
+  qt_internal_aligned_free(h->entries, linesize);
+} /*}}}*/
+
+static inline void qt_hash_internal_lock(qt_hash h) { /*{{{*/
+  if (h->lock) {
+#ifdef QTHREAD_COUNT_THREADS
+    /* racy, but good enough to tell a hot stripe from a cold one */
+    if (atomic_load_explicit(&h->lock->enter, memory_order_relaxed) !=
+        atomic_load_explicit(&h->lock->exit, memory_order_relaxed)) {
+      atomic_fetch_add_explicit(&h->contended, 1u, memory_order_relaxed);
+    }
+#endif
+    QTHREAD_FASTLOCK_LOCK(h->lock);
+  }
+} /*}}}*/
+
 static inline void **qt_hash_internal_find(qt_hash h, qt_key_t key) { /*{{{*/
   assert(h);
 
@@ -139,12 +173,35 @@ void INTERNAL qt_hash_initialize_subsystem(void) {
 }
 
 qt_hash INTERNAL qt_hash_create(int needSync) { /*{{{*/
-  qt_hash ret;
+  return qt_hash_create_onnode(needSync, -1);
+} /*}}}*/
 
-  ret = qt_calloc(1, sizeof(struct qt_hash_s));
+qt_hash INTERNAL qt_hash_create_onnode(int needSync, int node) { /*{{{*/
+  qt_hash ret = NULL;
+
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+  if (node >= 0) {
+    /* the lock rides along in the same (page-granular) allocation, so
+     * neighbouring hashes never share its cacheline */
+    ret = qt_affinity_alloc_onnode(
+      sizeof(struct qt_hash_s) + sizeof(QTHREAD_FASTLOCK_TYPE), node);
+    if (ret) {
+      memset(ret, 0, sizeof(struct qt_hash_s));
+      ret->node = node;
+    }
+  }
+#endif
+  if (ret == NULL) {
+    ret = qt_calloc(1, sizeof(struct qt_hash_s));
+    if (ret) { ret->node = -1; }
+  }
   if (ret) {
     if (needSync) {
-      ret->lock = MALLOC(sizeof(QTHREAD_FASTLOCK_TYPE));
+      if (ret->node >= 0) {
+        ret->lock = (QTHREAD_FASTLOCK_TYPE *)(ret + 1);
+      } else {
+        ret->lock = MALLOC(sizeof(QTHREAD_FASTLOCK_TYPE));
+      }
       QTHREAD_FASTLOCK_INIT_PTR(ret->lock);
       QTHREAD_FASTLOCK_LOCK(ret->lock);
       qt_hash_internal_create(ret, 100);
@@ -161,10 +218,19 @@ void INTERNAL qt_hash_destroy(qt_hash h) { /*{{{*/
   assert(h);
   if (h->lock) {
     QTHREAD_FASTLOCK_DESTROY_PTR(h->lock);
-    FREE((void *)h->lock, sizeof(QTHREAD_FASTLOCK_TYPE));
+    if (h->node < 0) {
+      FREE((void *)h->lock, sizeof(QTHREAD_FASTLOCK_TYPE));
+    }
   }
   assert(h->entries);
-  qt_internal_aligned_free(h->entries, linesize);
+  qt_hash_internal_free_entries(h);
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+  if (h->node >= 0) {
+    qt_affinity_free(h,
+                     sizeof(struct qt_hash_s) + sizeof(QTHREAD_FASTLOCK_TYPE));
+    return;
+  }
+#endif
   FREE(h, sizeof(struct qt_hash_s));
 } /*}}}*/
 
@@ -175,7 +241,7 @@ void INTERNAL qt_hash_destroy_deallocate(qt_hash h,
   size_t visited = 0;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   if (h->has_key[0] == 1) {
     ++visited;
     f(h->value[0]);
@@ -207,7 +273,7 @@ int INTERNAL qt_hash_put(qt_hash h, qt_key_t key, void *value) { /*{{{*/
   int ret;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   ret = qt_hash_put_locked(h, key, value);
   if (h->lock) { QTHREAD_FASTLOCK_UNLOCK(h->lock); }
   return ret;
@@ -218,6 +284,7 @@ static void brehash(qt_hash h, size_t len) { /*{{{*/
   size_t i, copied;
 
   assert(d);
+  d->node = h->node;
   qt_hash_internal_create(d, len);
   memcpy(d->has_key, h->has_key, sizeof(short) * 2);
   memcpy(d->value, h->value, sizeof(void *) * 2);
@@ -242,7 +309,7 @@ static void brehash(qt_hash h, size_t len) { /*{{{*/
   }
   assert(atomic_load_explicit(&h->population, memory_order_relaxed) ==
          atomic_load_explicit(&d->population, memory_order_relaxed));
-  qt_internal_aligned_free(h->entries, linesize);
+  qt_hash_internal_free_entries(h);
   h->entries = d->entries;
   h->mask = d->mask;
   h->num_entries = d->num_entries;
@@ -355,7 +422,7 @@ int INTERNAL qt_hash_remove(qt_hash h, qt_key_t const key) { /*{{{*/
   int ret;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   ret = qt_hash_remove_locked(h, key);
   if (h->lock) { QTHREAD_FASTLOCK_UNLOCK(h->lock); }
   return ret;
@@ -395,7 +462,7 @@ void INTERNAL *qt_hash_get(qt_hash h, qt_key_t const key) { /*{{{*/
   void *ret;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   ret = qt_hash_get_locked(h, key);
   if (h->lock) { QTHREAD_FASTLOCK_UNLOCK(h->lock); }
   return (void *)ret;
@@ -419,7 +486,7 @@ void INTERNAL qt_hash_callback(qt_hash h,
   size_t visited = 0;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   if (h->has_key[0] == 1) {
     ++visited;
     f(KEY_NULL, h->value[0], arg);
@@ -448,7 +515,7 @@ size_t INTERNAL qt_hash_count(qt_hash h) { /*{{{*/
   size_t ct;
 
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
   ct = h->population + h->has_key[0] + h->has_key[1];
   if (h->lock) { QTHREAD_FASTLOCK_UNLOCK(h->lock); }
   return ct;
@@ -456,7 +523,7 @@ size_t INTERNAL qt_hash_count(qt_hash h) { /*{{{*/
 
 void INTERNAL qt_hash_lock(qt_hash h) { /*{{{*/
   assert(h);
-  if (h->lock) { QTHREAD_FASTLOCK_LOCK(h->lock); }
+  qt_hash_internal_lock(h);
 } /*}}}*/
 
 void INTERNAL qt_hash_unlock(qt_hash h) { /*{{{*/
@@ -464,4 +531,13 @@ void INTERNAL qt_hash_unlock(qt_hash h) { /*{{{*/
   if (h->lock) { QTHREAD_FASTLOCK_UNLOCK(h->lock); }
 } /*}}}*/
 
+size_t INTERNAL qt_hash_contended(qt_hash h) { /*{{{*/
+  assert(h);
+#ifdef QTHREAD_COUNT_THREADS
+  return atomic_load_explicit(&h->contended, memory_order_relaxed);
+#else
+  return 0;
+#endif
+} /*}}}*/
+
 /* vim:set expandtab: */
@@ -0,0 +1,83 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* System Headers */
+#include <stdint.h>
+#include <stdio.h> /* for fprintf() */
+#include <strings.h> /* for strcasecmp() */
+#include <sys/mman.h>
+
+/* Internal Headers */
+#include "qt_asserts.h"
+#include "qt_envariables.h"
+#include "qt_hugepages.h"
+#include "qt_visibility.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+enum qt_hugepages_mode qt_hugepages = QT_HUGEPAGES_OFF;
+
+void INTERNAL qt_hugepages_init(void) { /*{{{*/
+  char const *mode = qt_internal_get_env_str("HUGE_PAGES", "no");
+
+  qt_hugepages = QT_HUGEPAGES_OFF;
+  if ((mode == NULL) || !strcasecmp(mode, "no") || !strcasecmp(mode, "0")) {
+    return;
+  } else if (!strcasecmp(mode, "explicit")) {
+    qt_hugepages = QT_HUGEPAGES_EXPLICIT;
+  } else if (!strcasecmp(mode, "yes") || !strcasecmp(mode, "transparent") ||
+             !strcasecmp(mode, "1")) {
+    qt_hugepages = QT_HUGEPAGES_TRANSPARENT;
+  } else {
+    fprintf(stderr, "unknown QT_HUGE_PAGES \"%s\"; using \"no\"\n", mode);
+  }
+} /*}}}*/
+
+void INTERNAL *qt_hugepage_map(size_t bytes, int *huge) { /*{{{*/
+  uint8_t *raw, *ret;
+  size_t head;
+
+  assert(bytes % QT_HUGEPAGE_SIZE == 0);
+#ifdef MAP_HUGETLB
+  if (qt_hugepages == QT_HUGEPAGES_EXPLICIT) {
+    ret = mmap(NULL,
+               bytes,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+               -1,
+               0);
+    if (ret != MAP_FAILED) {
+      *huge = 1;
+      return ret;
+    }
+  }
+#endif
+  /* over-allocate by one huge page and trim to alignment */
+  raw = mmap(NULL,
+             bytes + QT_HUGEPAGE_SIZE,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS,
+             -1,
+             0);
+  if (raw == MAP_FAILED) { return NULL; }
+  ret = (uint8_t *)(((uintptr_t)raw + QT_HUGEPAGE_SIZE - 1) &
+                    ~(uintptr_t)(QT_HUGEPAGE_SIZE - 1));
+  head = (size_t)(ret - raw);
+  if (head) { munmap(raw, head); }
+  munmap(ret + bytes, QT_HUGEPAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+  *huge = (madvise(ret, bytes, MADV_HUGEPAGE) == 0);
+#else
+  *huge = 0;
+#endif
+  return ret;
+} /*}}}*/
+
+void INTERNAL qt_hugepage_unmap(void *addr, size_t bytes) { /*{{{*/
+  munmap(addr, bytes);
+} /*}}}*/
+
+/* vim:set expandtab: */
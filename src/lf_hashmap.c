@@ -344,6 +344,12 @@ qt_hash INTERNAL qt_hash_create(int needSync) {
   return tmp;
 }
 
+/* lock-free, and its entries are allocated one at a time from a pool, so there
+ * is nothing to bind */
+qt_hash INTERNAL qt_hash_create_onnode(int needSync, int node) {
+  return qt_hash_create(needSync);
+}
+
 void INTERNAL qt_hash_destroy(qt_hash h) {
   marked_ptr_t cursor;
 
@@ -385,6 +391,11 @@ size_t INTERNAL qt_hash_count(qt_hash h) {
   return h->size;
 }
 
+size_t INTERNAL qt_hash_contended(qt_hash h) {
+  assert(h);
+  return 0;
+}
+
 void INTERNAL qt_hash_callback(qt_hash h, qt_hash_callback_fn f, void *arg) {
   marked_ptr_t cursor;
 
@@ -0,0 +1,192 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* The API */
+#include "qthread/qthread.h"
+
+/* System Headers */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h> /* for fprintf() */
+#include <time.h>  /* for nanosleep() */
+
+/* Internal Headers */
+#include "maestro_sched.h"
+#include "qt_asserts.h"
+#include "qt_envariables.h"
+#include "qt_shepherd_innards.h"
+#include "qt_subsystems.h"
+#include "qt_threadqueues.h"
+#include "qt_visibility.h"
+#include "qthread_innards.h" /* for qlib */
+
+/* Elastic worker count. Workers are numbered the way qthread_disable_worker()
+ * numbers them (worker w is worker w / nshepherds of shepherd w % nshepherds),
+ * and only the first `allowed` of them run; the rest sleep on a futex in
+ * qt_worker_wait_enabled(). The first worker of each shepherd always runs, so
+ * that no shepherd's queue is ever stranded.
+ *
+ * With QT_ELASTIC, a controller thread samples the ready queues every
+ * QT_ELASTIC_INTERVAL milliseconds. If more tasks are waiting than there are
+ * running workers, it allows one more; once the queues have been empty for
+ * QT_ELASTIC_IDLE milliseconds, it allows one fewer. A disabled worker
+ * finishes the task it is running before it goes to sleep. */
+static int elastic_min = 0;
+static int elastic_max = 0;
+static _Atomic int elastic_allowed = 0;
+static pthread_mutex_t elastic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t elastic_thread;
+static _Atomic int elastic_exit = 0;
+static unsigned long elastic_interval = 10; /* ms */
+static unsigned long elastic_idle = 100;    /* ms */
+
+static int qt_elastic_clamp(int n) { /*{{{*/
+  if (n < elastic_min) { return elastic_min; }
+  if (n > elastic_max) { return elastic_max; }
+  return n;
+} /*}}}*/
+
+/* Bring the workers in line with the allowed count. */
+static void qt_elastic_apply(int allowed) { /*{{{*/
+  int const total = (int)(qlib->nshepherds * qlib->nworkerspershep);
+
+  for (int w = (int)qlib->nshepherds; w < total; ++w) {
+    qthread_worker_t *const wkr =
+      &qlib->shepherds[w % qlib->nshepherds].workers[w / qlib->nshepherds];
+    int const active = atomic_load_explicit(&wkr->active, memory_order_relaxed);
+
+    if ((w < allowed) && !active) {
+      qthread_enable_worker((qthread_worker_id_t)w);
+    } else if ((w >= allowed) && active) {
+      qthread_disable_worker((qthread_worker_id_t)w);
+    }
+  }
+} /*}}}*/
+
+int INTERNAL maestro_current_workers(int val) { /*{{{*/
+  int allowed;
+
+  pthread_mutex_lock(&elastic_lock);
+  allowed = qt_elastic_clamp(val);
+  if (allowed != atomic_load_explicit(&elastic_allowed, memory_order_relaxed)) {
+    atomic_store_explicit(&elastic_allowed, allowed, memory_order_relaxed);
+    qt_elastic_apply(allowed);
+  }
+  pthread_mutex_unlock(&elastic_lock);
+  return allowed;
+} /*}}}*/
+
+void INTERNAL maestro_sched(enum trigger_type Q_UNUSED(type),
+                            enum trigger_action action,
+                            int val) { /*{{{*/
+  int const allowed =
+    atomic_load_explicit(&elastic_allowed, memory_order_relaxed);
+
+  switch (action) {
+    case MTA_LOWER_STREAM_COUNT:
+      maestro_current_workers(allowed - val);
+      break;
+    case MTA_RAISE_STREAM_COUNT:
+      maestro_current_workers(allowed + val);
+      break;
+    default: break;
+  }
+} /*}}}*/
+
+int INTERNAL maestro_allowed_workers(void) { /*{{{*/
+  return atomic_load_explicit(&elastic_allowed, memory_order_relaxed);
+} /*}}}*/
+
+int64_t INTERNAL maestro_size(void) { /*{{{*/
+  int64_t size = 0;
+
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; ++s) {
+    if (atomic_load_explicit(&qlib->shepherds[s].active,
+                             memory_order_relaxed)) {
+      ssize_t const len =
+        qt_threadqueue_advisory_queuelen(qlib->shepherds[s].ready);
+      if (len > 0) { size += len; }
+    }
+  }
+  return size;
+} /*}}}*/
+
+static void *qt_elastic_controller(void *Q_UNUSED(arg)) { /*{{{*/
+  struct timespec const interval = {elastic_interval / 1000,
+                                    (elastic_interval % 1000) * 1000000};
+  unsigned long idle = 0;
+
+  while (!atomic_load_explicit(&elastic_exit, memory_order_relaxed)) {
+    int64_t const waiting = maestro_size();
+    int const allowed = maestro_allowed_workers();
+
+    nanosleep(&interval, NULL);
+    if (waiting > allowed) {
+      idle = 0;
+      if (allowed < elastic_max) {
+        maestro_sched(MTT_SYSTEM, MTA_RAISE_STREAM_COUNT, 1);
+      }
+    } else if (waiting == 0) {
+      idle += elastic_interval;
+      if ((idle >= elastic_idle) && (allowed > elastic_min)) {
+        maestro_sched(MTT_SYSTEM, MTA_LOWER_STREAM_COUNT, 1);
+        idle = 0;
+      }
+    } else {
+      idle = 0;
+    }
+  }
+  return NULL;
+} /*}}}*/
+
+static void qt_elastic_subsystem_shutdown(void) { /*{{{*/
+  int const total = (int)(qlib->nshepherds * qlib->nworkerspershep);
+
+  atomic_store_explicit(&elastic_exit, 1, memory_order_relaxed);
+  qassert(pthread_join(elastic_thread, NULL), 0);
+  /* qthread_finalize() has already woken every worker to hand it its
+   * termination task; make sure the controller did not put any back to
+   * sleep in the meantime */
+  pthread_mutex_lock(&elastic_lock);
+  for (int w = (int)qlib->nshepherds; w < total; ++w) {
+    qthread_enable_worker((qthread_worker_id_t)w);
+  }
+  pthread_mutex_unlock(&elastic_lock);
+} /*}}}*/
+
+void INTERNAL qt_elastic_subsystem_init(void) { /*{{{*/
+  int const total = (int)(qlib->nshepherds * qlib->nworkerspershep);
+  int r;
+
+  elastic_allowed = (int)qlib->nworkers_active;
+  elastic_min = qt_internal_get_env_num("ELASTIC_MIN", qlib->nshepherds, 0);
+  elastic_max = qt_internal_get_env_num("ELASTIC_MAX", total, 0);
+  if (elastic_min < (int)qlib->nshepherds) {
+    elastic_min = (int)qlib->nshepherds;
+  }
+  if (elastic_max > total) { elastic_max = total; }
+  if (elastic_max < elastic_min) { elastic_max = elastic_min; }
+
+  if (!qt_internal_get_env_bool("ELASTIC", 0) || (elastic_min == total)) {
+    /* nothing to control; maestro_*() still work within the range */
+    return;
+  }
+  elastic_interval = qt_internal_get_env_num("ELASTIC_INTERVAL", 10, 1);
+  elastic_idle = qt_internal_get_env_num("ELASTIC_IDLE", 100, 0);
+  maestro_current_workers(elastic_allowed);
+  atomic_store_explicit(&elastic_exit, 0, memory_order_relaxed);
+  if ((r = pthread_create(
+         &elastic_thread, NULL, qt_elastic_controller, NULL)) != 0) {
+    fprintf(
+      stderr, "qt_elastic_subsystem_init: pthread_create() failed (%d)\n", r);
+    return;
+  }
+  /* must stop before the shepherds are joined, which happens right after the
+   * early cleanup functions run */
+  qthread_internal_cleanup_early(qt_elastic_subsystem_shutdown);
+} /*}}}*/
+
+/* vim:set expandtab: */
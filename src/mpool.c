@@ -30,6 +30,7 @@
 #include "qt_envariables.h"
 #include "qt_expect.h"
 #include "qt_gcd.h" /* for qt_lcm() */
+#include "qt_hugepages.h"
 #include "qt_macros.h"
 #include "qt_mpool.h"
 #include "qt_subsystems.h"
@@ -68,8 +69,22 @@ struct qt_mpool_s {
   QTHREAD_FASTLOCK_TYPE pool_lock;
   void **alloc_list;
   size_t _Atomic alloc_list_pos;
+
+  /* huge-page arenas (see qt_mpool_create_huge()), protected by pool_lock */
+  int huge;
+  struct qt_mpool_arena_s *arenas;
+  uint8_t *arena_next;
+  size_t arena_left;
+  size_t arena_bytes;     /* mapped for arenas */
+  size_t arena_huge_bytes; /* ...of which on huge pages */
 };
 
+typedef struct qt_mpool_arena_s {
+  struct qt_mpool_arena_s *next;
+  void *base;
+  size_t bytes;
+} qt_mpool_arena_t;
+
 typedef struct qt_mpool_cache_entry_s {
   struct qt_mpool_cache_entry_s *_Atomic next;
   struct qt_mpool_cache_entry_s *_Atomic block_tail;
@@ -114,6 +129,42 @@ static inline void *qt_mpool_internal_aligned_alloc(size_t alloc_size,
   return ret;
 } /*}}} */
 
+/* Carve the next block out of the pool's current huge-page arena, mapping a
+ * new one when it runs out; NULL if no arena could be mapped. */
+static void *qt_mpool_internal_huge_alloc(qt_mpool pool) { /*{{{ */
+  size_t const step =
+    (pool->alloc_size + pool->alignment - 1) & ~(pool->alignment - 1);
+  void *ret = NULL;
+
+  QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+  if (pool->arena_left < step) {
+    size_t const bytes =
+      (step + QT_HUGEPAGE_SIZE - 1) & ~(QT_HUGEPAGE_SIZE - 1);
+    qt_mpool_arena_t *arena = qt_malloc(sizeof(qt_mpool_arena_t));
+    int huge = 0;
+
+    if (arena) { arena->base = qt_hugepage_map(bytes, &huge); }
+    if ((arena == NULL) || (arena->base == NULL)) {
+      if (arena) { qt_free(arena); }
+      QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+      return NULL;
+    }
+    arena->bytes = bytes;
+    arena->next = pool->arenas;
+    pool->arenas = arena;
+    pool->arena_next = arena->base;
+    pool->arena_left = bytes;
+    pool->arena_bytes += bytes;
+    if (huge) { pool->arena_huge_bytes += bytes; }
+    VALGRIND_MAKE_MEM_NOACCESS(arena->base, bytes);
+  }
+  ret = pool->arena_next;
+  pool->arena_next += step;
+  pool->arena_left -= step;
+  QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+  return ret;
+} /*}}} */
+
 static inline void qt_mpool_internal_aligned_free(void *freeme,
                                                   size_t alignment) { /*{{{ */
   qt_internal_aligned_free(freeme, alignment);
@@ -122,8 +173,9 @@ static inline void qt_mpool_internal_aligned_free(void *freeme,
 // sync means lock-protected
 // item_size is how many bytes to return
 // ...memory is always allocated in multiples of getpagesize()
-qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
-                                          size_t alignment) { /*{{{ */
+static qt_mpool qt_mpool_internal_create(size_t item_size,
+                                         size_t alignment,
+                                         int huge) { /*{{{ */
   qt_mpool pool = (qt_mpool)MALLOC(sizeof(struct qt_mpool_s));
 
   size_t alloc_size = 0;
@@ -192,6 +244,12 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
   QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
   pool->alloc_size = alloc_size;
   pool->items_per_alloc = alloc_size / item_size;
+  pool->huge = huge && (qt_hugepages != QT_HUGEPAGES_OFF);
+  pool->arenas = NULL;
+  pool->arena_next = NULL;
+  pool->arena_left = 0;
+  pool->arena_bytes = 0;
+  pool->arena_huge_bytes = 0;
 #ifdef TLS
   pool->offset = qthread_incr(&pool_cache_global_max, 1);
 #else
@@ -213,6 +271,31 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
   return NULL;
 } /*}}} */
 
+qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
+                                          size_t alignment) { /*{{{ */
+  return qt_mpool_internal_create(item_size, alignment, 0);
+} /*}}} */
+
+/* Like qt_mpool_create_aligned(), but with QT_HUGE_PAGES the pool's blocks
+ * are carved out of huge-page arenas. Meant for the few pools that hold a
+ * lot of hot memory (task descriptors); arenas are only returned to the
+ * system when the pool is destroyed. */
+qt_mpool INTERNAL qt_mpool_create_huge(size_t item_size,
+                                       size_t alignment) { /*{{{ */
+  return qt_mpool_internal_create(item_size, alignment, 1);
+} /*}}} */
+
+/* How many bytes of huge-page arenas the pool has mapped, and how many of
+ * those are backed by huge pages. */
+void INTERNAL qt_mpool_hugepage_usage(qt_mpool pool,
+                                      size_t *mapped,
+                                      size_t *huge) { /*{{{ */
+  QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+  *mapped = pool->arena_bytes;
+  *huge = pool->arena_huge_bytes;
+  QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+} /*}}} */
+
 static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool) {
   qt_mpool_threadlocal_cache_t *tc;
 
@@ -327,30 +410,36 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool) { /*{{{*/
       QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
     }
     if (NULL == cache) {
-      uint8_t *p;
+      uint8_t *p = NULL;
       // const size_t item_size = pool->item_size;
 
-      /* need to allocate a new block and record that I did so in the central
-       * pool */
-      p = qt_mpool_internal_aligned_alloc(pool->alloc_size, pool->alignment);
-      qassert_ret((p != NULL), NULL);
-      assert(pool->alignment == 0 ||
-             (((uintptr_t)p) & (pool->alignment - 1)) == 0);
-      QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
-      if (atomic_load_explicit(&pool->alloc_list_pos, memory_order_relaxed) ==
-          (pagesize / sizeof(void *) - 1)) {
-        void **tmp = qt_internal_aligned_alloc(pagesize, pagesize);
-        qassert_ret((tmp != NULL), NULL);
-        memset(tmp, 0, pagesize);
-        tmp[pagesize / sizeof(void *) - 1] = pool->alloc_list;
-        pool->alloc_list = tmp;
-        atomic_store_explicit(&pool->alloc_list_pos, 0, memory_order_relaxed);
+      /* blocks carved from huge-page arenas are freed with the arenas */
+      if (pool->huge) { p = qt_mpool_internal_huge_alloc(pool); }
+      if (p == NULL) {
+        /* need to allocate a new block and record that I did so in the
+         * central pool */
+        p = qt_mpool_internal_aligned_alloc(pool->alloc_size, pool->alignment);
+        qassert_ret((p != NULL), NULL);
+        assert(pool->alignment == 0 ||
+               (((uintptr_t)p) & (pool->alignment - 1)) == 0);
+        QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+        if (atomic_load_explicit(&pool->alloc_list_pos,
+                                 memory_order_relaxed) ==
+            (pagesize / sizeof(void *) - 1)) {
+          void **tmp = qt_internal_aligned_alloc(pagesize, pagesize);
+          qassert_ret((tmp != NULL), NULL);
+          memset(tmp, 0, pagesize);
+          tmp[pagesize / sizeof(void *) - 1] = pool->alloc_list;
+          pool->alloc_list = tmp;
+          atomic_store_explicit(
+            &pool->alloc_list_pos, 0, memory_order_relaxed);
+        }
+        pool->alloc_list[atomic_load_explicit(&pool->alloc_list_pos,
+                                              memory_order_relaxed)] = p;
+        atomic_fetch_add_explicit(
+          &pool->alloc_list_pos, 1u, memory_order_relaxed);
+        QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
       }
-      pool->alloc_list[atomic_load_explicit(&pool->alloc_list_pos,
-                                            memory_order_relaxed)] = p;
-      atomic_fetch_add_explicit(
-        &pool->alloc_list_pos, 1u, memory_order_relaxed);
-      QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
       /* store the block for later allocation */
       tc->block = p;
       tc->i = 1;
@@ -365,6 +454,34 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool) { /*{{{*/
   }
 } /*}}}*/
 
+/* Fills items[0..n) with fresh items, looking up the thread-local cache only
+ * once. Returns how many were allocated (fewer than n only if memory ran
+ * out). */
+size_t INTERNAL qt_mpool_alloc_bulk(qt_mpool pool,
+                                    void **items,
+                                    size_t n) { /*{{{*/
+  qt_mpool_threadlocal_cache_t *tc;
+  size_t i;
+
+  qassert_ret((pool != NULL), 0);
+
+  tc = qt_mpool_internal_getcache(pool);
+  for (i = 0; i < n; ++i) {
+    if (tc->cache) {
+      qt_mpool_cache_t *cache = tc->cache;
+      tc->cache = atomic_load_explicit(&cache->next, memory_order_relaxed);
+      --tc->count;
+      items[i] = cache;
+    } else if (tc->block) {
+      items[i] = &(tc->block[tc->i * pool->item_size]);
+      if (++tc->i == pool->items_per_alloc) { tc->block = NULL; }
+    } else if ((items[i] = qt_mpool_alloc(pool)) == NULL) {
+      break;
+    }
+  }
+  return i;
+} /*}}}*/
+
 void INTERNAL qt_mpool_free(qt_mpool pool, void *mem) { /*{{{*/
   qt_mpool_threadlocal_cache_t *tc;
   qt_mpool_cache_t *cache = NULL;
@@ -437,6 +554,13 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool) { /*{{{ */
     pool->alloc_list = pool->alloc_list[pagesize / sizeof(void *) - 1];
     qt_internal_aligned_free(p, pagesize);
   }
+  while (pool->arenas) {
+    qt_mpool_arena_t *const arena = pool->arenas;
+
+    pool->arenas = arena->next;
+    qt_hugepage_unmap(arena->base, arena->bytes);
+    qt_free(arena);
+  }
   qt_mpool_threadlocal_cache_t *freeme;
   while ((freeme = atomic_load_explicit(&pool->caches, memory_order_relaxed))) {
     atomic_store_explicit(
@@ -62,12 +62,14 @@
 #ifdef QTHREAD_OMP_AFFINITY
 #include "omp_affinity.h"
 #endif
+#include "maestro_sched.h"
 #include "qt_affinity.h"
 #include "qt_alloc.h"
 #include "qt_blocking_structs.h"
 #include "qt_envariables.h"
 #include "qt_feb.h"
 #include "qt_hash.h"
+#include "qt_hugepages.h"
 #include "qt_int_log.h"
 #include "qt_io.h"
 #include "qt_locks.h"
@@ -77,11 +79,13 @@
 #include "qt_queue.h"
 #include "qt_shepherd_innards.h"
 #include "qt_spawncache.h"
+#include "qt_stacks.h"
 #include "qt_subsystems.h"
 #include "qt_syncvar.h"
 #include "qt_teams.h"
 #include "qt_threadqueue_scheduler.h"
 #include "qt_threadqueues.h"
+#include "qt_timers.h"
 
 #define QTHREAD_STACK_ALIGNMENT 16u
 
@@ -139,55 +143,52 @@ static inline qthread_t *qthread_thread_new(qthread_f f,
 void qthread_thread_free(qthread_t *t);
 
 qt_mpool generic_qthread_pool = NULL;
-qt_mpool generic_big_qthread_pool = NULL;
+/* Tasks with copied arguments come from one of several pools, one per size
+ * class of inline argument space (64 bytes, then doubling up to
+ * QT_ARGCOPY_SIZE), so that a task with a 16-byte argument does not take a
+ * descriptor with room for a kilobyte. Larger arguments are malloc'd. */
+static qt_mpool argcopy_qthread_pools[QTHREAD_ARGCOPY_NCLASSES];
 #define ALLOC_QTHREAD() (qthread_t *)qt_mpool_alloc(generic_qthread_pool)
-#define ALLOC_BIG_QTHREAD()                                                    \
-  (qthread_t *)qt_mpool_alloc(generic_big_qthread_pool)
+#define ALLOC_BIG_QTHREAD(c)                                                   \
+  (qthread_t *)qt_mpool_alloc(argcopy_qthread_pools[c])
 #define FREE_QTHREAD(t) qt_mpool_free(generic_qthread_pool, t)
-#define FREE_BIG_QTHREAD(t) qt_mpool_free(generic_big_qthread_pool, t)
+#define FREE_BIG_QTHREAD(t) qt_mpool_free(argcopy_qthread_pools[(t)->argclass], t)
 
-static qt_mpool generic_stack_pool = NULL;
-#ifdef QTHREAD_GUARD_PAGES
-static inline void *ALLOC_STACK(void) { /*{{{ */
-  if (GUARD_PAGES) {
-    uint8_t *tmp = qt_mpool_alloc(generic_stack_pool);
+/* The smallest size class with room for arg_size bytes of arguments, which
+ * must be no more than qthread_argcopy_size. */
+static inline unsigned qthread_argcopy_class(size_t arg_size) { /*{{{*/
+  unsigned c = 0;
 
-    assert(tmp);
-    if (tmp == NULL) { return NULL; }
-    if (mprotect(tmp, getpagesize(), PROT_NONE) != 0) {
-      perror("mprotect in ALLOC_STACK (1)");
-    }
-    if (mprotect(tmp + qlib->qthread_stack_size + getpagesize(),
-                 getpagesize(),
-                 PROT_NONE) != 0) {
-      perror("mprotect in ALLOC_STACK (2)");
-    }
-    return tmp + getpagesize();
-  } else {
-    return qt_mpool_alloc(generic_stack_pool);
-  }
-} /*}}} */
+  assert(arg_size <= qlib->qthread_argcopy_size);
+  while (qlib->qthread_argcopy_classes[c] < arg_size) { c++; }
+  return c;
+} /*}}}*/
 
-static inline void FREE_STACK(void *t) { /*{{{ */
-  if (GUARD_PAGES) {
-    assert(t);
-    t = (uint8_t *)t - getpagesize();
-    if (mprotect(t, getpagesize(), PROT_READ | PROT_WRITE) != 0) {
-      perror("mprotect in FREE_STACK (1)");
-    }
-    if (mprotect(((uint8_t *)t) + qlib->qthread_stack_size + getpagesize(),
-                 getpagesize(),
-                 PROT_READ | PROT_WRITE) != 0) {
-      perror("mprotect in FREE_STACK (2)");
-    }
-  }
-  qt_mpool_free(generic_stack_pool, t);
-} /*}}} */
+/* Switching to and from a task that leaves the floating-point control state
+ * alone (QTHREAD_FIXED_FPENV) does not need to save and restore it. */
+#if !defined(HAVE_NATIVE_MAKECONTEXT) && defined(NEEDLEANSWAPCONTEXT)
+#define QT_SWAPCTXT(t, o, n)                                                   \
+  ((atomic_load_explicit(&(t)->flags, memory_order_relaxed) &                  \
+    QTHREAD_FIXED_FPENV)                                                       \
+     ? qt_swapctxt_lean((o), (n))                                              \
+     : qt_swapctxt((o), (n)))
+#else
+#define QT_SWAPCTXT(t, o, n) qt_swapctxt((o), (n))
+#endif
+/* With QT_FIXED_FPENV, every task is treated as QTHREAD_SPAWN_FIXED_FPENV */
+static uint16_t fixed_fpenv_flag = 0;
+
+/* The stack size of a task's class */
+#define TASK_STACK_SIZE(t) (qlib->qthread_stack_sizes[(t)->stackclass])
 
-#else /* ifdef QTHREAD_GUARD_PAGES */
-#define ALLOC_STACK() qt_mpool_alloc(generic_stack_pool)
-#define FREE_STACK(t) qt_mpool_free(generic_stack_pool, t)
-#endif /* ifdef QTHREAD_GUARD_PAGES */
+/* The stack class named by the QTHREAD_SPAWN_STACK_* bits of a spawn's
+ * feature flags; anything out of range means the default. */
+static inline uint8_t qthread_stack_class(unsigned int feature_flag) { /*{{{*/
+  unsigned int const c =
+    (feature_flag & QTHREAD_SPAWN_STACK_MASK) >> QTHREAD_SPAWN_STACK_SHIFT;
+
+  return (c < QTHREAD_NUM_STACK_CLASSES) ? (uint8_t)c : 0;
+} /*}}}*/
 
 static qt_mpool generic_rdata_pool = NULL;
 #define ALLOC_RDATA()                                                          \
@@ -201,23 +202,27 @@ int qthread_library_initialized = 0;
 void *shep0arg = NULL;
 #endif
 
-static inline void alloc_rdata(qthread_shepherd_t *me, qthread_t *t) { /*{{{*/
+static inline void alloc_rdata(qthread_shepherd_t *me,
+                               qthread_worker_t *me_worker,
+                               qthread_t *t) { /*{{{*/
   void *stack = NULL;
   struct qthread_runtime_data_s *rdata;
 
   if (atomic_load_explicit(&t->flags, memory_order_relaxed) & QTHREAD_SIMPLE) {
     rdata = t->rdata = ALLOC_RDATA();
   } else {
-    stack = ALLOC_STACK();
+    /* preferably the stack of a task that just finished on this worker (see
+     * keep_stack()) */
+    stack = qt_stack_alloc(me_worker, t->stackclass);
     assert(stack);
     if (GUARD_PAGES) {
       rdata = t->rdata =
         (struct qthread_runtime_data_s *)(((uint8_t *)stack) + getpagesize() +
-                                          qlib->qthread_stack_size);
+                                          TASK_STACK_SIZE(t));
     } else {
       rdata = t->rdata =
         (struct qthread_runtime_data_s *)(((uint8_t *)stack) +
-                                          qlib->qthread_stack_size);
+                                          TASK_STACK_SIZE(t));
     }
   }
   rdata->tasklocal_size = 0;
@@ -228,7 +233,7 @@ static inline void alloc_rdata(qthread_shepherd_t *me, qthread_t *t) { /*{{{*/
 #ifdef QTHREAD_USE_VALGRIND
   if (stack) {
     rdata->valgrind_stack_id =
-      VALGRIND_STACK_REGISTER(stack, qlib->qthread_stack_size);
+      VALGRIND_STACK_REGISTER(stack, TASK_STACK_SIZE(t));
   }
 #endif
 #if defined(__has_feature)
@@ -240,6 +245,17 @@ static inline void alloc_rdata(qthread_shepherd_t *me, qthread_t *t) { /*{{{*/
 #endif
 } /*}}}*/
 
+/* Takes the stack of a task that just terminated on this worker, so that a
+ * later new task can run on it while it is still warm in cache, without
+ * going back to the stack pool. */
+static inline void keep_stack(qthread_worker_t *me_worker,
+                              qthread_t *t) { /*{{{*/
+  if (t->rdata && t->rdata->stack &&
+      qt_stack_keep(me_worker, t->rdata->stack, t->stackclass)) {
+    t->rdata->stack = NULL;
+  }
+} /*}}}*/
+
 #if defined(__has_feature)
 #if __has_feature(thread_sanitizer)
 #define qthread_before_swap_to_qthread(t)                                      \
@@ -367,13 +383,20 @@ static void *qthread_master(void *arg) {
   threadqueue = me->ready;
   assert(threadqueue);
   while (!done) {
-    while (!atomic_load_explicit(&me_worker->active, memory_order_relaxed)) {
-      SPINLOCK_BODY();
+    if (!atomic_load_explicit(&me_worker->active, memory_order_relaxed)) {
+      qt_worker_wait_enabled(me_worker);
+    }
+    qt_timer_poll();
+    if (me_worker->handoff) {
+      /* direct swap into a task the last one woke up (see feb.c) */
+      t = me_worker->handoff;
+      me_worker->handoff = NULL;
+    } else {
+      t = qt_scheduler_get_thread(
+        threadqueue,
+        localqueue,
+        atomic_load_explicit(&me->active, memory_order_relaxed));
     }
-    t = qt_scheduler_get_thread(
-      threadqueue,
-      localqueue,
-      atomic_load_explicit(&me->active, memory_order_relaxed));
     assert(t);
 
     // Process input preconditions if this is a NASCENT thread
@@ -400,7 +423,7 @@ static void *qthread_master(void *arg) {
              atomic_load_explicit(&t->flags, memory_order_relaxed) &
                QTHREAD_REAL_MCCOY);
       if (t->rdata == NULL) {
-        alloc_rdata(me, t);
+        alloc_rdata(me, me_worker, t);
       } else {
         assert(t->rdata->shepherd_ptr != NULL);
         if (t->rdata->shepherd_ptr != me) { t->rdata->shepherd_ptr = me; }
@@ -476,6 +499,12 @@ static void *qthread_master(void *arg) {
             assert(me->ready != NULL);
             qt_threadqueue_enqueue_yielded(me->ready, t);
             break;
+          case QTHREAD_STATE_HANDOFF: /* reschedule it; the wakee runs next */
+            atomic_store_explicit(
+              &t->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
+            assert(me_worker->handoff != NULL);
+            qt_threadqueue_enqueue(me->ready, t);
+            break;
 
           case QTHREAD_STATE_QUEUE: {
             qthread_queue_t q = t->rdata->blockedon.queue;
@@ -510,9 +539,32 @@ static void *qthread_master(void *arg) {
               &t->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
             qt_blocking_subsystem_enqueue(t->rdata->blockedon.io);
             break;
+          case QTHREAD_STATE_SLEEPING:
+            /* it may be woken as soon as it is on the wheel */
+            atomic_store_explicit(
+              &t->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
+            qt_timer_insert(t->rdata->blockedon.timer);
+            break;
+          case QTHREAD_STATE_MULTI_BLOCKED:
+            /* its nodes are all queued; from here on the last fill it needs
+             * can release it, unless that has happened already */
+            atomic_store_explicit(&t->thread_state,
+                                  QTHREAD_STATE_FEB_BLOCKED,
+                                  memory_order_relaxed);
+            if (qt_multiwait_arm(t->rdata->blockedon.multi)) {
+              atomic_store_explicit(
+                &t->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
+              qt_threadqueue_enqueue(me->ready, t);
+            }
+            break;
           case QTHREAD_STATE_TERMINATED:
             /* we can remove the stack etc. */
             Q_PREFETCH(threadqueue);
+            if (QTHREAD_UNLIKELY(qt_stack_profiling) && t->rdata &&
+                t->rdata->stack) {
+              qt_stack_profile_record(t->f, t->rdata->stack, t->stackclass);
+            }
+            keep_stack(me_worker, t);
             qthread_thread_free(t);
             break;
         }
@@ -628,7 +680,20 @@ int API_FUNC qthread_initialize(void) { /*{{{ */
   qt_topology_init(&nshepherds, &nworkerspershep, &hw_par);
 
   if ((nshepherds == 1) && (nworkerspershep == 1)) { need_sync = 0; }
-  QTHREAD_LOCKING_STRIPES = 2 << (QT_INT_LOG(nshepherds * nworkerspershep) + 1);
+  {
+    /* a few stripes per worker keeps the FEB/syncvar hash locks cool; the
+     * count must be a power of two, since the stripe is picked by masking */
+    size_t stripes = qt_internal_get_env_num(
+      "LOCKING_STRIPES",
+      2 << (QT_INT_LOG(nshepherds * nworkerspershep) + 1),
+      1);
+
+    QTHREAD_LOCKING_STRIPES = 1;
+    while (QTHREAD_LOCKING_STRIPES < stripes &&
+           QTHREAD_LOCKING_STRIPES < (1u << 20)) {
+      QTHREAD_LOCKING_STRIPES <<= 1;
+    }
+  }
 
 #ifdef QTHREAD_COUNT_THREADS
   threadcount = 1;
@@ -654,22 +719,49 @@ int API_FUNC qthread_initialize(void) { /*{{{ */
   qassert_ret(qlib->shepherds, QTHREAD_MALLOC_ERROR);
 
   qt_mpool_subsystem_init();
+  qt_hugepages_init();
 
   qlib->qthread_stack_size = qt_internal_get_env_num(
     "STACK_SIZE", QTHREAD_DEFAULT_STACK_SIZE, QTHREAD_DEFAULT_STACK_SIZE);
 #ifdef QTHREAD_GUARD_PAGES
   GUARD_PAGES = qt_internal_get_env_bool("GUARD_PAGES", 1);
 #endif
+  fixed_fpenv_flag =
+    qt_internal_get_env_bool("FIXED_FPENV", 0) ? QTHREAD_FIXED_FPENV : 0;
+  {
+    unsigned const small = qlib->qthread_stack_size / 4;
+    unsigned const large = (qlib->qthread_stack_size > (1024 * 1024))
+                             ? qlib->qthread_stack_size
+                             : (1024 * 1024);
+
+    qlib->qthread_stack_sizes[0] = qlib->qthread_stack_size;
+    qlib->qthread_stack_sizes[QTHREAD_SPAWN_STACK_SMALL >>
+                              QTHREAD_SPAWN_STACK_SHIFT] =
+      qt_internal_get_env_num("STACK_SIZE_SMALL", small, small);
+    qlib->qthread_stack_sizes[QTHREAD_SPAWN_STACK_LARGE >>
+                              QTHREAD_SPAWN_STACK_SHIFT] =
+      qt_internal_get_env_num("STACK_SIZE_LARGE", large, large);
+  }
   if (GUARD_PAGES) {
     if (print_info) { print_status("Guard Pages Enabled\n"); }
-    /* round stack size to nearest page */
-    if (qlib->qthread_stack_size % pagesize) {
-      qlib->qthread_stack_size +=
-        pagesize - (qlib->qthread_stack_size % pagesize);
+  }
+  for (i = 0; i < QTHREAD_NUM_STACK_CLASSES; i++) {
+    unsigned *const size = &qlib->qthread_stack_sizes[i];
+
+    if (GUARD_PAGES) {
+      /* round stack size to nearest page */
+      if (*size % pagesize) { *size += pagesize - (*size % pagesize); }
+    } else {
+      *size = (*size + QTHREAD_STACK_ALIGNMENT - 1) &
+              ~(QTHREAD_STACK_ALIGNMENT - 1);
     }
   }
+  qlib->qthread_stack_size = qlib->qthread_stack_sizes[0];
   if (print_info) {
-    print_status("Using %u byte stack size.\n", qlib->qthread_stack_size);
+    print_status("Using %u byte stack size (%u small, %u large).\n",
+                 qlib->qthread_stack_size,
+                 qlib->qthread_stack_sizes[1],
+                 qlib->qthread_stack_sizes[2]);
   }
 
   qlib->max_thread_id = 1;
@@ -718,22 +810,28 @@ int API_FUNC qthread_initialize(void) { /*{{{ */
   qlib->qthread_tasklocal_size = qt_internal_get_env_num(
     "TASKLOCAL_SIZE", TASKLOCAL_DEFAULT, sizeof(void *));
 
-  generic_qthread_pool = qt_mpool_create_aligned(
+  generic_qthread_pool = qt_mpool_create_huge(
     sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size,
     qthread_cacheline());
-  generic_big_qthread_pool =
-    qt_mpool_create(sizeof(qthread_t) + qlib->qthread_argcopy_size +
-                    qlib->qthread_tasklocal_size);
-  if (GUARD_PAGES) {
-    generic_stack_pool = qt_mpool_create_aligned(
-      qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) +
-        (2 * getpagesize()),
-      getpagesize());
-  } else {
-    generic_stack_pool = qt_mpool_create_aligned(
-      qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s),
-      QTHREAD_STACK_ALIGNMENT);
+  {
+    unsigned c = 0;
+    unsigned class_size = QTHREAD_ARGCOPY_MIN_CLASS;
+
+    while ((class_size < qlib->qthread_argcopy_size) &&
+           (c < QTHREAD_ARGCOPY_NCLASSES - 1)) {
+      qlib->qthread_argcopy_classes[c++] = class_size;
+      class_size *= 2;
+    }
+    qlib->qthread_argcopy_classes[c++] = qlib->qthread_argcopy_size;
+    qlib->qthread_argcopy_nclasses = c;
+    for (c = 0; c < qlib->qthread_argcopy_nclasses; ++c) {
+      argcopy_qthread_pools[c] = qt_mpool_create_huge(
+        sizeof(qthread_t) + qlib->qthread_argcopy_classes[c] +
+          qlib->qthread_tasklocal_size,
+        qthread_cacheline());
+    }
   }
+  qt_stack_subsystem_init(GUARD_PAGES);
   generic_rdata_pool = qt_mpool_create(sizeof(struct qthread_runtime_data_s));
   initialize_hazardptrs();
   qt_internal_teams_init();
@@ -742,6 +840,7 @@ int API_FUNC qthread_initialize(void) { /*{{{ */
   qt_syncvar_subsystem_init(need_sync);
   qt_threadqueue_subsystem_init();
   qt_blocking_subsystem_init();
+  qt_timer_subsystem_init();
 
   /* Set up agg methods*/
   qlib->agg_cost = qthread_default_agg_cost;
@@ -901,6 +1000,8 @@ int API_FUNC qthread_initialize(void) { /*{{{ */
     }
   }
 
+  qt_elastic_subsystem_init();
+
   atexit(qthread_finalize);
 
   qt_barrier_internal_init();
@@ -988,6 +1089,33 @@ void INTERNAL qthread_internal_cleanup_early(void (*function)(void)) { /*{{{*/
   qt_cleanup_early_funcs = ng;
 } /*}}}*/
 
+/* with QT_HUGE_PAGES and QT_INFO, how well the huge-page arenas took */
+static void qthread_hugepage_report(void) { /*{{{*/
+  size_t mapped, huge;
+
+  qt_mpool_hugepage_usage(generic_qthread_pool, &mapped, &huge);
+  print_status("task descriptors: %lu of %lu bytes on huge pages\n",
+               (unsigned long)huge,
+               (unsigned long)mapped);
+  for (unsigned c = 0; c < qlib->qthread_argcopy_nclasses; ++c) {
+    qt_mpool_hugepage_usage(argcopy_qthread_pools[c], &mapped, &huge);
+    if (mapped == 0) { continue; }
+    print_status("task descriptors (%u-byte args): %lu of %lu bytes on huge "
+                 "pages\n",
+                 qlib->qthread_argcopy_classes[c],
+                 (unsigned long)huge,
+                 (unsigned long)mapped);
+  }
+  for (unsigned c = 0; c < QTHREAD_NUM_STACK_CLASSES; ++c) {
+    qt_stack_hugepage_usage(c, &mapped, &huge);
+    if (mapped == 0) { continue; }
+    print_status("%u-byte stacks: %lu of %lu bytes on huge pages\n",
+                 qlib->qthread_stack_sizes[c],
+                 (unsigned long)huge,
+                 (unsigned long)mapped);
+  }
+} /*}}}*/
+
 void API_FUNC qthread_finalize(void) { /*{{{ */
   int r;
   qthread_shepherd_id_t i;
@@ -1052,6 +1180,7 @@ void API_FUNC qthread_finalize(void) { /*{{{ */
       if (!atomic_load_explicit(&qlib->shepherds[i].workers[j].active,
                                 memory_order_relaxed)) {
         (void)QT_CAS(qlib->shepherds[i].workers[j].active, 0, 1);
+        qt_worker_wake(&qlib->shepherds[i].workers[j]);
       }
     }
   }
@@ -1105,12 +1234,14 @@ void API_FUNC qthread_finalize(void) { /*{{{ */
            STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
       FREE(shep->workers[j].stealbuffer,
            STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
+      qt_stack_worker_flush(&shep->workers[j]);
     }
     if (i == 0) {
       FREE(shep0->workers[0].nostealbuffer,
            STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
       FREE(shep0->workers[0].stealbuffer,
            STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
+      qt_stack_worker_flush(&shep0->workers[0]);
     }
     FREE(qlib->shepherds[i].workers,
          qlib->nworkerspershep * sizeof(qthread_worker_t));
@@ -1188,12 +1319,17 @@ void API_FUNC qthread_finalize(void) { /*{{{ */
     }
   }
 
+  if ((qt_hugepages != QT_HUGEPAGES_OFF) &&
+      qt_internal_get_env_num("INFO", 0, 1)) {
+    qthread_hugepage_report();
+  }
   qt_mpool_destroy(generic_qthread_pool);
   generic_qthread_pool = NULL;
-  qt_mpool_destroy(generic_big_qthread_pool);
-  generic_big_qthread_pool = NULL;
-  qt_mpool_destroy(generic_stack_pool);
-  generic_stack_pool = NULL;
+  for (unsigned c = 0; c < qlib->qthread_argcopy_nclasses; ++c) {
+    qt_mpool_destroy(argcopy_qthread_pools[c]);
+    argcopy_qthread_pools[c] = NULL;
+  }
+  qt_stack_subsystem_fini();
   qt_mpool_destroy(generic_rdata_pool);
   generic_rdata_pool = NULL;
   FREE(qlib->shepherds, qlib->nshepherds * sizeof(qthread_shepherd_t));
@@ -1232,7 +1368,7 @@ void API_FUNC *qthread_get_tasklocal(unsigned int size) { /*{{{*/
       // Use default space
       if (atomic_load_explicit(&f->flags, memory_order_relaxed) &
           QTHREAD_BIG_STRUCT) {
-        return &f->data[qlib->qthread_argcopy_size];
+        return &f->data[qlib->qthread_argcopy_classes[f->argclass]];
       } else {
         return &f->data;
       }
@@ -1240,7 +1376,8 @@ void API_FUNC *qthread_get_tasklocal(unsigned int size) { /*{{{*/
       void **data_blob;
       if (atomic_load_explicit(&f->flags, memory_order_relaxed) &
           QTHREAD_BIG_STRUCT) {
-        data_blob = (void **)&f->data[qlib->qthread_argcopy_size];
+        data_blob =
+          (void **)&f->data[qlib->qthread_argcopy_classes[f->argclass]];
       } else {
         data_blob = (void **)&f->data[0];
       }
@@ -1287,7 +1424,7 @@ API_FUNC void *qthread_tos(void) {
 API_FUNC void *qthread_bos(void) {
   qthread_t const *f = qthread_internal_self();
 
-  return f->rdata->stack + qlib->qthread_stack_size;
+  return f->rdata->stack + TASK_STACK_SIZE(f);
 }
 
 size_t API_FUNC qthread_stackleft(void) { /*{{{ */
@@ -1300,15 +1437,15 @@ size_t API_FUNC qthread_stackleft(void) { /*{{{ */
     size_t current = (size_t)__builtin_frame_address(0);
 #endif
     assert(current > (size_t)f->rdata->stack &&
-           current < ((size_t)f->rdata->stack + qlib->qthread_stack_size));
+           current < ((size_t)f->rdata->stack + TASK_STACK_SIZE(f)));
 #ifdef STACK_GROWS_DOWN
     /* not tested */
-    assert(((size_t)(f->rdata->stack) + qlib->qthread_stack_size) - current <
-           qlib->qthread_stack_size);
-    return ((size_t)(f->rdata->stack) + qlib->qthread_stack_size) - current;
+    assert(((size_t)(f->rdata->stack) + TASK_STACK_SIZE(f)) - current <
+           TASK_STACK_SIZE(f));
+    return ((size_t)(f->rdata->stack) + TASK_STACK_SIZE(f)) - current;
 
 #else
-    assert(current - (size_t)(f->rdata->stack) < qlib->qthread_stack_size);
+    assert(current - (size_t)(f->rdata->stack) < TASK_STACK_SIZE(f));
     return current - (size_t)(f->rdata->stack);
 #endif
   } else {
@@ -1420,20 +1557,13 @@ aligned_t API_FUNC *qthread_retloc(void) { /*{{{ */
 /************************************************************/
 /* functions to manage thread stack allocation/deallocation */
 /************************************************************/
-static inline qthread_t *qthread_thread_new(qthread_f const f,
-                                            void const *arg,
-                                            size_t arg_size,
-                                            void *ret,
-                                            qt_team_t *team,
-                                            int team_leader) { /*{{{ */
-  qthread_t *t;
-
-  if ((arg_size > 0) && (arg_size <= qlib->qthread_argcopy_size)) {
-    t = ALLOC_BIG_QTHREAD();
-  } else {
-    t = ALLOC_QTHREAD();
-  }
-
+static inline void qthread_thread_init(qthread_t *t,
+                                       qthread_f const f,
+                                       void const *arg,
+                                       size_t arg_size,
+                                       void *ret,
+                                       qt_team_t *team,
+                                       int team_leader) { /*{{{ */
   t->f = f;
   t->arg = (void *)arg;
   t->ret = ret;
@@ -1443,11 +1573,14 @@ static inline qthread_t *qthread_thread_new(qthread_f const f,
   t->thread_id = QTHREAD_NON_TASK_ID;
 
   t->target_shepherd = NO_SHEPHERD;
+  t->priority = 0;
+  t->stackclass = 0;
 
   // should I use the builtin block for args?
   if (arg_size > 0) {
     if (arg_size <= qlib->qthread_argcopy_size) {
       t->arg = (void *)(&t->data);
+      t->argclass = (uint8_t)qthread_argcopy_class(arg_size);
       atomic_store_explicit(
         &t->flags, QTHREAD_BIG_STRUCT, memory_order_relaxed);
     } else {
@@ -1468,6 +1601,22 @@ static inline qthread_t *qthread_thread_new(qthread_f const f,
 
   atomic_store_explicit(
     &t->thread_state, QTHREAD_STATE_NEW, memory_order_relaxed);
+} /*}}} */
+
+static inline qthread_t *qthread_thread_new(qthread_f const f,
+                                            void const *arg,
+                                            size_t arg_size,
+                                            void *ret,
+                                            qt_team_t *team,
+                                            int team_leader) { /*{{{ */
+  qthread_t *t;
+
+  if ((arg_size > 0) && (arg_size <= qlib->qthread_argcopy_size)) {
+    t = ALLOC_BIG_QTHREAD(qthread_argcopy_class(arg_size));
+  } else {
+    t = ALLOC_QTHREAD();
+  }
+  qthread_thread_init(t, f, arg, arg_size, ret, team, team_leader);
 
   return t;
 } /*}}} */
@@ -1479,9 +1628,10 @@ void qthread_thread_free(qthread_t *t) { /*{{{ */
     if (t->rdata->tasklocal_size > 0) {
       if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
           QTHREAD_BIG_STRUCT) {
-        FREE(*(void **)&t->data[qlib->qthread_argcopy_size],
-             t->rdata->tasklocal_size);
-        *(void **)&t->data[qlib->qthread_argcopy_size] = NULL;
+        void **const data_blob =
+          (void **)&t->data[qlib->qthread_argcopy_classes[t->argclass]];
+        FREE(*data_blob, t->rdata->tasklocal_size);
+        *data_blob = NULL;
       } else {
         FREE(*(void **)&t->data[0], t->rdata->tasklocal_size);
         *(void **)&t->data[0] = NULL;
@@ -1499,9 +1649,8 @@ void qthread_thread_free(qthread_t *t) { /*{{{ */
     if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
         QTHREAD_SIMPLE) {
       FREE_RDATA(t->rdata);
-    } else {
-      assert(t->rdata->stack);
-      FREE_STACK(t->rdata->stack);
+    } else if (t->rdata->stack) { /* unless kept by the worker */
+      qt_stack_free(t->rdata->stack, t->stackclass);
     }
 
     t->rdata = NULL;
@@ -1557,6 +1706,22 @@ void API_FUNC qthread_call_method(qthread_f f,
   } else (f)(arg);
 }
 
+/* Run the task's function and, for as long as it ends by calling
+ * qthread_replace(), its replacements; the last one's return value is the
+ * task's. */
+static inline aligned_t qthread_call(qthread_t *t) { /*{{{ */
+  aligned_t ret = (t->f)(t->arg);
+
+  while (QTHREAD_UNLIKELY(
+    atomic_load_explicit(&t->flags, memory_order_relaxed) &
+    QTHREAD_REPLACED)) {
+    atomic_fetch_and_explicit(
+      &t->flags, (uint16_t)~QTHREAD_REPLACED, memory_order_relaxed);
+    ret = (t->f)(t->arg);
+  }
+  return ret;
+} /*}}} */
+
 /* this function runs a thread until it completes or yields */
 #ifdef QTHREAD_MAKECONTEXT_SPLIT
 static void qthread_wrapper(unsigned int high, unsigned int low) { /*{{{ */
@@ -1592,7 +1757,7 @@ static void qthread_wrapper(void *ptr) {
   if ((atomic_load_explicit(&t->flags, memory_order_relaxed) &
        QTHREAD_SIMPLE) == 0) {
     assert((size_t)&t > (size_t)t->rdata->stack &&
-           (size_t)&t < ((size_t)t->rdata->stack + qlib->qthread_stack_size));
+           (size_t)&t < ((size_t)t->rdata->stack + TASK_STACK_SIZE(t)));
   }
 #ifdef QTHREAD_COUNT_THREADS
   QTHREAD_FASTLOCK_LOCK(&effconcurrentthreads_lock);
@@ -1638,14 +1803,14 @@ static void qthread_wrapper(void *ptr) {
         QTHREAD_RET_IS_SINC) {
       if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
           QTHREAD_RET_IS_VOID_SINC) {
-        (t->f)(t->arg);
+        qthread_call(t);
         if (NULL != t->team) {
           qt_internal_teamfinish(
             t->team, atomic_load_explicit(&t->flags, memory_order_relaxed));
         }
         qt_sinc_submit((qt_sinc_t *)t->ret, NULL);
       } else {
-        aligned_t retval = (t->f)(t->arg);
+        aligned_t retval = qthread_call(t);
         if (NULL != t->team) {
           qt_internal_teamfinish(
             t->team, atomic_load_explicit(&t->flags, memory_order_relaxed));
@@ -1655,7 +1820,7 @@ static void qthread_wrapper(void *ptr) {
     } else if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
                QTHREAD_RET_IS_SYNCVAR) {
       /* this should avoid problems with irresponsible return values */
-      uint64_t retval = INT64TOINT60((t->f)(t->arg));
+      uint64_t retval = INT64TOINT60(qthread_call(t));
       if (NULL != t->team) {
         qt_internal_teamfinish(
           t->team, atomic_load_explicit(&t->flags, memory_order_relaxed));
@@ -1663,7 +1828,7 @@ static void qthread_wrapper(void *ptr) {
       qassert(qthread_syncvar_writeEF_const((syncvar_t *)t->ret, retval),
               QTHREAD_SUCCESS);
     } else {
-      aligned_t retval = (t->f)(t->arg);
+      aligned_t retval = qthread_call(t);
       if (NULL != t->team) {
         qt_internal_teamfinish(
           t->team, atomic_load_explicit(&t->flags, memory_order_relaxed));
@@ -1673,7 +1838,7 @@ static void qthread_wrapper(void *ptr) {
     }
   } else {
     assert(t->f);
-    (t->f)(t->arg);
+    qthread_call(t);
     if (NULL != t->team) {
       qt_internal_teamfinish(
         t->team, atomic_load_explicit(&t->flags, memory_order_relaxed));
@@ -1737,7 +1902,7 @@ void INTERNAL qthread_exec(qthread_t *t, qt_context_t *c) { /*{{{ */
         &t->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
       qthread_makecontext(&t->rdata->context,
                           t->rdata->stack,
-                          qlib->qthread_stack_size,
+                          TASK_STACK_SIZE(t),
                           (void (*)(void))qthread_wrapper,
                           t,
                           c);
@@ -1770,7 +1935,8 @@ void INTERNAL qthread_exec(qthread_t *t, qt_context_t *c) { /*{{{ */
                         &t->rdata->context),
             0);
 #else
-    qassert(qt_swapctxt(atomic_load_explicit(&t->rdata->return_context,
+    qassert(QT_SWAPCTXT(t,
+                        atomic_load_explicit(&t->rdata->return_context,
                                              memory_order_relaxed),
                         &t->rdata->context),
             0);
@@ -1851,6 +2017,34 @@ void API_FUNC qthread_flushsc(void){
 #define QTHREAD_SPAWN_MASK_TEAMS                                               \
   (QTHREAD_SPAWN_NEW_TEAM | QTHREAD_SPAWN_NEW_SUBTEAM)
 
+/* A work-first spawn (QTHREAD_SPAWN_WORK_FIRST) runs the child straight
+ * away on the spawning worker, and puts the parent back in the worker's
+ * queue, where its continuation can be stolen; this is the same switch as
+ * the FEB direct hand-off (QTHREAD_STATE_HANDOFF). It needs a parent that
+ * can be switched away from, i.e. a non-simple task running on a worker,
+ * and a child that may run here; otherwise the spawn is help-first as
+ * usual. Returns the worker to hand the child to, or NULL. */
+static inline qthread_worker_t *qthread_work_first_worker(qthread_t *me,
+                                                          qthread_t *t) { /*{{{*/
+  qthread_worker_t *w;
+
+  if ((me == NULL) || (t->preconds != NULL) ||
+      (atomic_load_explicit(&me->flags, memory_order_relaxed) &
+       QTHREAD_SIMPLE)) {
+    return NULL;
+  }
+  w = qthread_internal_getworker();
+  if ((w == NULL) || (w->current != me) || (w->handoff != NULL)) {
+    return NULL;
+  }
+  if ((atomic_load_explicit(&t->flags, memory_order_relaxed) &
+       QTHREAD_UNSTEALABLE) &&
+      (t->target_shepherd != w->shepherd->shepherd_id)) {
+    return NULL;
+  }
+  return w;
+} /*}}}*/
+
 int API_FUNC qthread_spawn(qthread_f f,
                            void const *arg,
                            size_t arg_size,
@@ -1865,6 +2059,7 @@ int API_FUNC qthread_spawn(qthread_f f,
                                            // multithreaded shepherds
   qthread_shepherd_t *myshep;
   qthread_shepherd_id_t dest_shep;
+  qthread_worker_t *work_first = NULL;
 
 #ifdef QTHREAD_OMP_AFFINITY
   if (target_shep == NO_SHEPHERD) {
@@ -1954,6 +2149,13 @@ int API_FUNC qthread_spawn(qthread_f f,
   if (feature_flag & QTHREAD_SPAWN_SIMPLE) {
     atomic_fetch_or_explicit(&t->flags, QTHREAD_SIMPLE, memory_order_relaxed);
   }
+  if ((feature_flag & QTHREAD_SPAWN_FIXED_FPENV) || fixed_fpenv_flag) {
+    atomic_fetch_or_explicit(
+      &t->flags, QTHREAD_FIXED_FPENV, memory_order_relaxed);
+  }
+  t->priority = (uint8_t)((feature_flag & QTHREAD_SPAWN_PRIORITY_MASK) >>
+                          QTHREAD_SPAWN_PRIORITY_SHIFT);
+  t->stackclass = qthread_stack_class(feature_flag);
   /* Step 4: Prepare the return value location (if necessary) */
   if (ret) {
     int test = QTHREAD_SUCCESS;
@@ -1988,6 +2190,9 @@ int API_FUNC qthread_spawn(qthread_f f,
       return test;
     }
   }
+  if (feature_flag & QTHREAD_SPAWN_WORK_FIRST) {
+    work_first = qthread_work_first_worker(me, t);
+  }
   /* Step 5: Prepare the input preconditions (if necessary) */
   if (QTHREAD_LIKELY(!preconds) || (qthread_check_feb_preconds(t) == 0)) {
     /* Step 6: Set it going */
@@ -2004,13 +2209,206 @@ int API_FUNC qthread_spawn(qthread_f f,
       ((double)concurrentthreads / threadcount);
     QTHREAD_FASTLOCK_UNLOCK(&concurrentthreads_lock);
 #endif /* ifdef QTHREAD_COUNT_THREADS */
-    { qt_threadqueue_enqueue(qlib->threadqueues[dest_shep], t); }
+    if (work_first) {
+      work_first->handoff = t;
+    } else {
+      qt_threadqueue_enqueue(qlib->threadqueues[dest_shep], t);
+    }
+  } else {
+    work_first = NULL;
   }
 
   if (feature_flag & QTHREAD_SPAWN_NETWORK)
     atomic_fetch_or_explicit(&t->flags, QTHREAD_NETWORK, memory_order_relaxed);
 
+  if (work_first) {
+    /* requeue ourselves (where we can be stolen); the child runs next */
+    atomic_store_explicit(
+      &me->thread_state, QTHREAD_STATE_HANDOFF, memory_order_relaxed);
+    qthread_back_to_master(me);
+  }
+  return QTHREAD_SUCCESS;
+} /*}}}*/
+
+/* Spawns n tasks running f, as if by n calls to qthread_spawn() without
+ * preconditions, but allocates the task structures in batches and hands
+ * each batch to the destination queue in a single operation.
+ *
+ * If arg_size is nonzero, args is an array of n arguments of arg_size bytes
+ * each, which are copied; otherwise it is an array of n pointers (or NULL).
+ * rets is NULL, an array of n aligned_t's (or syncvar_t's with
+ * QTHREAD_SPAWN_RET_SYNCVAR_T), or a single qt_sinc_t shared by all of the
+ * tasks (QTHREAD_SPAWN_RET_SINC/_SINC_VOID). Without a target shepherd,
+ * each batch goes wherever the scheduler would put a single task. Team
+ * flags are not supported.
+ *
+ * Every task structure is allocated, and every return location emptied,
+ * before the first batch is queued; so on failure none of the tasks has
+ * been started (though some return locations may have been emptied). */
+#define QTHREAD_SPAWN_BULK_BATCH 256
+
+int API_FUNC qthread_spawn_bulk(qthread_f f,
+                                void const *args,
+                                size_t arg_size,
+                                void *rets,
+                                size_t n,
+                                qthread_shepherd_id_t target_shep,
+                                unsigned int feature_flag) { /*{{{*/
+  assert(qthread_library_initialized);
+  qthread_t *me = qthread_internal_self();
+  qthread_shepherd_t *myshep = me ? me->rdata->shepherd_ptr : NULL;
+  qt_team_t *team = (me && me->team) ? me->team : NULL;
+  qt_mpool const pool =
+    ((arg_size > 0) && (arg_size <= qlib->qthread_argcopy_size))
+      ? argcopy_qthread_pools[qthread_argcopy_class(arg_size)]
+      : generic_qthread_pool;
+  uint8_t const priority = (uint8_t)(
+    (feature_flag & QTHREAD_SPAWN_PRIORITY_MASK) >> QTHREAD_SPAWN_PRIORITY_SHIFT);
+  uint8_t const stackclass = qthread_stack_class(feature_flag);
+  uint16_t flags = 0;
+  size_t ret_stride = sizeof(aligned_t);
+  qthread_t **tasks;
+  size_t nalloc = 0;
+  int rc = QTHREAD_SUCCESS;
+
+  qassert_ret(f, QTHREAD_BADARGS);
+  if (feature_flag & (QTHREAD_SPAWN_MASK_TEAMS | QTHREAD_SPAWN_PC_SYNCVAR_T)) {
+    return QTHREAD_BADARGS;
+  }
+  if (n == 0) { return QTHREAD_SUCCESS; }
+#ifdef QTHREAD_OMP_AFFINITY
+  if ((target_shep == NO_SHEPHERD) && me &&
+      (me->rdata->child_affinity != OMP_NO_CHILD_TASK_AFFINITY)) {
+    target_shep = me->rdata->child_affinity;
+  }
+#endif
+  if (target_shep != NO_SHEPHERD) {
+    target_shep %= qlib->nshepherds;
+    flags |= QTHREAD_UNSTEALABLE;
+  }
+  if (feature_flag & QTHREAD_SPAWN_SIMPLE) { flags |= QTHREAD_SIMPLE; }
+  if (feature_flag & QTHREAD_SPAWN_NETWORK) { flags |= QTHREAD_NETWORK; }
+  if (feature_flag & QTHREAD_SPAWN_FIXED_FPENV) {
+    flags |= QTHREAD_FIXED_FPENV;
+  }
+  flags |= fixed_fpenv_flag;
+  if (rets) {
+    switch (feature_flag & (QTHREAD_SPAWN_RET_SYNCVAR_T |
+                            QTHREAD_SPAWN_RET_SINC |
+                            QTHREAD_SPAWN_RET_SINC_VOID)) {
+      case QTHREAD_SPAWN_RET_SYNCVAR_T:
+        flags |= QTHREAD_RET_IS_SYNCVAR;
+        ret_stride = sizeof(syncvar_t);
+        break;
+      case QTHREAD_SPAWN_RET_SINC:
+        flags |= QTHREAD_RET_IS_SINC;
+        ret_stride = 0;
+        break;
+      case QTHREAD_SPAWN_RET_SINC_VOID:
+        flags |= QTHREAD_RET_IS_VOID_SINC;
+        ret_stride = 0;
+        break;
+      default: // QTHREAD_SPAWN_RET_ALIGNED
+        break;
+    }
+  }
+
+  tasks = MALLOC(sizeof(qthread_t *) * n);
+  qassert_ret(tasks, QTHREAD_MALLOC_ERROR);
+  while (nalloc < n) {
+    size_t const got =
+      qt_mpool_alloc_bulk(pool, (void **)tasks + nalloc, n - nalloc);
+
+    if (got == 0) {
+      rc = QTHREAD_MALLOC_ERROR;
+      goto fail;
+    }
+    nalloc += got;
+  }
+  if (rets && ret_stride) {
+    for (size_t i = 0; i < n; ++i) {
+      if (flags & QTHREAD_RET_IS_SYNCVAR) {
+        syncvar_t *r = (syncvar_t *)rets + i;
+        rc = qthread_syncvar_status(r) ? qthread_syncvar_empty(r)
+                                       : QTHREAD_SUCCESS;
+      } else {
+        rc = qthread_empty((aligned_t *)rets + i);
+      }
+      if (QTHREAD_UNLIKELY(rc != QTHREAD_SUCCESS)) { goto fail; }
+    }
+  }
+
+  /* nothing can fail from here on */
+  for (size_t done = 0; done < n;) {
+    qthread_t **const batch = tasks + done;
+    size_t count = n - done;
+    qthread_shepherd_id_t dest_shep;
+
+    if (count > QTHREAD_SPAWN_BULK_BATCH) { count = QTHREAD_SPAWN_BULK_BATCH; }
+    if (team) { qt_sinc_expect(team->sinc, count); }
+
+    dest_shep = (target_shep != NO_SHEPHERD)
+                  ? target_shep
+                  : qt_threadqueue_choose_dest(myshep);
+    for (size_t i = 0; i < count; ++i) {
+      qthread_t *const t = batch[i];
+      void const *arg;
+      void *ret = NULL;
+
+      if (arg_size > 0) {
+        arg = (uint8_t const *)args + (done + i) * arg_size;
+      } else {
+        arg = args ? ((void *const *)args)[done + i] : NULL;
+      }
+      if (rets) { ret = (uint8_t *)rets + (done + i) * ret_stride; }
+      qthread_thread_init(t, f, arg, arg_size, ret, team, 0);
+      t->priority = priority;
+      t->stackclass = stackclass;
+      t->preconds = NULL;
+      if (target_shep != NO_SHEPHERD) { t->target_shepherd = dest_shep; }
+      if (flags) {
+        atomic_fetch_or_explicit(&t->flags, flags, memory_order_relaxed);
+      }
+    }
+#ifdef QTHREAD_COUNT_THREADS
+    QTHREAD_FASTLOCK_LOCK(&concurrentthreads_lock);
+    for (size_t i = 0; i < count; ++i) {
+      threadcount++;
+      concurrentthreads++;
+      if (concurrentthreads > maxconcurrentthreads) {
+        maxconcurrentthreads = concurrentthreads;
+      }
+      avg_concurrent_threads =
+        (avg_concurrent_threads * (double)(threadcount - 1.0) / threadcount) +
+        ((double)concurrentthreads / threadcount);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&concurrentthreads_lock);
+#endif /* ifdef QTHREAD_COUNT_THREADS */
+    qt_threadqueue_enqueue_bulk(qlib->threadqueues[dest_shep], batch, count);
+    done += count;
+  }
+  FREE(tasks, sizeof(qthread_t *) * n);
   return QTHREAD_SUCCESS;
+
+fail:
+  for (size_t i = 0; i < nalloc; ++i) { qt_mpool_free(pool, tasks[i]); }
+  FREE(tasks, sizeof(qthread_t *) * n);
+  return rc;
+} /*}}}*/
+
+unsigned int API_FUNC qthread_spawn_stack_flag(size_t stack_size) { /*{{{*/
+  unsigned int const classes[] = {QTHREAD_SPAWN_STACK_SMALL,
+                                  0,
+                                  QTHREAD_SPAWN_STACK_LARGE};
+
+  assert(qthread_library_initialized);
+  for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); ++i) {
+    if (qlib->qthread_stack_sizes[classes[i] >> QTHREAD_SPAWN_STACK_SHIFT] >=
+        stack_size) {
+      return classes[i];
+    }
+  }
+  return QTHREAD_SPAWN_STACK_LARGE;
 } /*}}}*/
 
 int API_FUNC qthread_fork(qthread_f f,
@@ -2240,7 +2638,8 @@ void INTERNAL qthread_back_to_master(qthread_t *t) { /*{{{ */
                                            memory_order_relaxed)),
           0);
 #else
-  qassert(qt_swapctxt(&t->rdata->context,
+  qassert(QT_SWAPCTXT(t,
+                      &t->rdata->context,
                       atomic_load_explicit(&t->rdata->return_context,
                                            memory_order_relaxed)),
           0);
@@ -2266,12 +2665,65 @@ void INTERNAL qthread_back_to_master2(qthread_t *t) { /*{{{ */
 #ifdef HAVE_NATIVE_MAKECONTEXT
   setcontext(
     atomic_load_explicit(&t->rdata->return_context, memory_order_relaxed));
+#elif defined(NEEDLEANSWAPCONTEXT)
+  if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
+      QTHREAD_FIXED_FPENV) {
+    qt_setmctxt_lean(
+      &atomic_load_explicit(&t->rdata->return_context, memory_order_relaxed)
+         ->mc);
+  } else {
+    qt_setmctxt(
+      &atomic_load_explicit(&t->rdata->return_context, memory_order_relaxed)
+         ->mc);
+  }
 #else
   qt_setmctxt(
     &atomic_load_explicit(&t->rdata->return_context, memory_order_relaxed)->mc);
 #endif
 } /*}}} */
 
+int API_FUNC qthread_replace(qthread_f f,
+                             void const *arg,
+                             size_t arg_size) { /*{{{ */
+  assert(qthread_library_initialized);
+  qthread_t *me = qthread_internal_self();
+  uint_fast16_t const flags =
+    me ? atomic_load_explicit(&me->flags, memory_order_relaxed) : 0;
+
+  qassert_ret(f, QTHREAD_BADARGS);
+  if ((me == NULL) || (flags & (QTHREAD_REAL_MCCOY | QTHREAD_AGGREGATED))) {
+    return QTHREAD_NOT_ALLOWED;
+  }
+  if (arg_size == 0) {
+    if (flags & QTHREAD_HAS_ARGCOPY) { qt_free(me->arg); }
+    atomic_fetch_and_explicit(
+      &me->flags, (uint16_t)~QTHREAD_HAS_ARGCOPY, memory_order_relaxed);
+    me->arg = (void *)arg;
+  } else if ((flags & QTHREAD_BIG_STRUCT) &&
+             (arg_size <= qlib->qthread_argcopy_classes[me->argclass])) {
+    /* fits in the descriptor; arg may well point at the current argument */
+    memmove(&me->data, arg, arg_size);
+    if (flags & QTHREAD_HAS_ARGCOPY) {
+      qt_free(me->arg);
+      atomic_fetch_and_explicit(
+        &me->flags, (uint16_t)~QTHREAD_HAS_ARGCOPY, memory_order_relaxed);
+    }
+    me->arg = (void *)&me->data;
+  } else {
+    void *const copy = MALLOC(arg_size);
+
+    qassert_ret(copy, QTHREAD_MALLOC_ERROR);
+    memcpy(copy, arg, arg_size);
+    if (flags & QTHREAD_HAS_ARGCOPY) { qt_free(me->arg); }
+    atomic_fetch_or_explicit(
+      &me->flags, QTHREAD_HAS_ARGCOPY, memory_order_relaxed);
+    me->arg = copy;
+  }
+  me->f = f;
+  atomic_fetch_or_explicit(&me->flags, QTHREAD_REPLACED, memory_order_relaxed);
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
 /* function to move a qthread from one shepherd to another */
 int API_FUNC qthread_migrate_to(qthread_shepherd_id_t const shepherd) { /*{{{ */
   assert(qthread_library_initialized);
@@ -182,6 +182,44 @@ qthread_internal_shep_to_node(qthread_shepherd_id_t const shep) { /*{{{ */
   return qlib->shepherds[shep].node;
 } /*}}} */
 
+/* The lowest node that a shepherd is bound to and that is above after (or
+ * the lowest at all, if after is QTHREAD_NO_NODE); QTHREAD_NO_NODE if none */
+static unsigned int
+qthread_internal_next_node(unsigned int const after) { /*{{{ */
+  unsigned int next = QTHREAD_NO_NODE;
+
+  for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+    unsigned int const node = qlib->shepherds[i].node;
+
+    if ((node == QTHREAD_NO_NODE) ||
+        ((after != QTHREAD_NO_NODE) && (node <= after))) {
+      continue;
+    }
+    if ((next == QTHREAD_NO_NODE) || (node < next)) { next = node; }
+  }
+  return next;
+} /*}}} */
+
+/* Spread per-stripe tables round-robin over the distinct nodes that the
+ * shepherds are bound to, so every node gets the same share of stripes no
+ * matter how many shepherds it has. If the shepherds span fewer than two
+ * nodes, binding buys nothing. */
+unsigned int INTERNAL
+qthread_internal_stripe_to_node(size_t const stripe) { /*{{{ */
+  size_t nnodes = 0;
+  size_t pick;
+  unsigned int node = QTHREAD_NO_NODE;
+
+  while ((node = qthread_internal_next_node(node)) != QTHREAD_NO_NODE) {
+    nnodes++;
+  }
+  if (nnodes < 2) { return QTHREAD_NO_NODE; }
+  pick = stripe % nnodes;
+  node = qthread_internal_next_node(QTHREAD_NO_NODE);
+  while (pick--) { node = qthread_internal_next_node(node); }
+  return node;
+} /*}}} */
+
 qthread_shepherd_t INTERNAL *
 qthread_find_active_shepherd(qthread_shepherd_id_t *l,
                              unsigned int *d) { /*{{{ */
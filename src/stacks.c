@@ -0,0 +1,582 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* The API */
+#include "qthread/qthread.h"
+
+/* System Headers */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h> /* for perror() and fprintf() */
+#include <string.h> /* for memset() */
+#include <sys/mman.h>
+#include <sys/time.h> /* for gettimeofday() */
+#include <time.h>
+#include <unistd.h> /* for getpagesize() */
+
+/* Public Headers */
+#include "qthread/qtimer.h"
+
+/* Internal Headers */
+#include "qt_affinity.h"
+#include "qt_alloc.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_envariables.h"
+#include "qt_expect.h"
+#include "qt_hugepages.h"
+#include "qt_output_macros.h"
+#include "qt_qthread_struct.h"
+#include "qt_shepherd_innards.h"
+#include "qt_stacks.h"
+#include "qt_visibility.h"
+#include "qthread_innards.h" /* for qlib */
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* MADV_FREE lets the kernel take the pages lazily, and costs nothing if the
+ * stack is reused first; MADV_DONTNEED is the portable fallback. */
+#ifdef MADV_FREE
+#define QT_STACK_MADV_TRIM MADV_FREE
+#else
+#define QT_STACK_MADV_TRIM MADV_DONTNEED
+#endif
+
+/* Pools grow by roughly this much at a time */
+#define QT_STACK_CHUNK_BYTES (1024 * 1024)
+/* Stacks trimmed per pass before the pool lock is dropped */
+#define QT_STACK_TRIM_BATCH 32
+
+/* A stack block is
+ *     [guard page] stack [guard page] runtime data, header
+ * (without the guard pages when they are off). Blocks are page aligned and
+ * carved out of larger chunks; the guard pages are protected once, when the
+ * block is carved, and stay protected for as long as the pool lives. */
+typedef struct qt_stack_hdr_s {
+  struct qt_stack_hdr_s *next;
+  double idle_since;  /* when the stack was last returned to its pool */
+  unsigned int pool;  /* the pool the stack belongs to */
+  uint8_t sclass;     /* its size class */
+  uint8_t trimmed;    /* pages given back to the OS since then */
+} qt_stack_hdr_t;
+
+typedef struct qt_stack_chunk_s {
+  struct qt_stack_chunk_s *next;
+  void *base;
+  size_t bytes;
+  int onnode;  /* from qt_affinity_alloc_onnode() rather than mmap() */
+  int hugemap; /* from qt_hugepage_map() */
+} qt_stack_chunk_t;
+
+/* There is a pool per size class and node; pool (c * stack_nnodes + n) holds
+ * stacks of class c on node n. Free stacks are kept most recently freed first,
+ * so the ones idle longest are at the end of the list, and the ones already
+ * trimmed are at the very end. */
+typedef struct {
+  QTHREAD_FASTLOCK_TYPE lock;
+  qt_stack_hdr_t *free;
+  qt_stack_chunk_t *chunks;
+  unsigned int node; /* QTHREAD_NO_NODE if memory is not bound */
+  size_t bytes;      /* mapped in chunks */
+  size_t huge_bytes; /* ...of which on huge pages */
+} qt_stack_pool_t;
+
+static qt_stack_pool_t *stack_pools = NULL;
+static unsigned int stack_nnodes = 0;
+static unsigned int stack_npools = 0;
+
+static size_t stack_pagesize = 0;
+static size_t stack_guard = 0; /* bytes below and above each stack */
+static size_t stack_hdr_offset[QTHREAD_NUM_STACK_CLASSES];
+static size_t stack_block_size[QTHREAD_NUM_STACK_CLASSES];
+
+static unsigned int stack_cache_depth = 4;
+static unsigned long stack_trim_ms = 0;
+static int stack_huge = 0; /* chunks come from qt_hugepage_map() */
+
+/* Stack profiling. Every stack is painted with QT_STACK_PAINT when it is
+ * handed out; when its task ends, the stack is scanned from the bottom (they
+ * all grow down) for the first word that was written. The profiles live in a
+ * small open-addressed table keyed by task function. */
+#define QT_STACK_PAINT UINT64_C(0xa5a5a5a5a5a5a5a5)
+
+int qt_stack_profiling = 0;
+static qthread_stack_profile_t *stack_profiles = NULL;
+static size_t stack_profiles_size = 0; /* slots; a power of two */
+static size_t stack_profiles_count = 0;
+static QTHREAD_FASTLOCK_TYPE stack_profile_lock;
+
+static pthread_t stack_trimmer;
+static int stack_trimmer_running = 0;
+static int stack_trim_exit = 0;
+static pthread_mutex_t stack_trim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stack_trim_cond = PTHREAD_COND_INITIALIZER;
+
+static inline qt_stack_hdr_t *qt_stack_hdr(void *stack,
+                                           unsigned int sclass) { /*{{{*/
+  return (qt_stack_hdr_t *)((uint8_t *)stack + stack_hdr_offset[sclass]);
+} /*}}}*/
+
+static inline void *qt_stack_of(qt_stack_hdr_t *hdr) { /*{{{*/
+  return (uint8_t *)hdr - stack_hdr_offset[hdr->sclass];
+} /*}}}*/
+
+static inline unsigned int qt_stack_pool_of(qthread_worker_t *worker,
+                                            unsigned int sclass) { /*{{{*/
+  unsigned int node = 0;
+
+  if (worker && (worker->shepherd->node < stack_nnodes)) {
+    node = worker->shepherd->node;
+  }
+  return (sclass * stack_nnodes) + node;
+} /*}}}*/
+
+/* Carve a new chunk into stacks; all but the returned one go on the free
+ * list. */
+static qt_stack_hdr_t *qt_stack_pool_grow(unsigned int pool) { /*{{{*/
+  qt_stack_pool_t *const p = &stack_pools[pool];
+  unsigned int const sclass = pool / stack_nnodes;
+  size_t const block_size = stack_block_size[sclass];
+  size_t const stack_size = qlib->qthread_stack_sizes[sclass];
+  size_t nblocks = QT_STACK_CHUNK_BYTES / block_size;
+  size_t bytes;
+  uint8_t *base = NULL;
+  qt_stack_chunk_t *chunk;
+  qt_stack_hdr_t *ret = NULL, *head = NULL, **tail = &head;
+  int huge = 0;
+
+  if (nblocks == 0) { nblocks = 1; }
+  bytes = nblocks * block_size;
+  chunk = qt_malloc(sizeof(qt_stack_chunk_t));
+  if (chunk == NULL) { return NULL; }
+  chunk->onnode = 0;
+  chunk->hugemap = 0;
+  if (stack_huge) {
+    /* Whole huge pages, as many blocks as fit; node placement is left to
+     * first touch, which is normally a worker of the pool's node. */
+    bytes = (bytes + QT_HUGEPAGE_SIZE - 1) & ~(QT_HUGEPAGE_SIZE - 1);
+    base = qt_hugepage_map(bytes, &huge);
+    if (base != NULL) {
+      chunk->hugemap = 1;
+      nblocks = bytes / block_size;
+    } else {
+      bytes = nblocks * block_size;
+    }
+  }
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+  if ((base == NULL) && (p->node != QTHREAD_NO_NODE)) {
+    base = qt_affinity_alloc_onnode(bytes, (int)p->node);
+    chunk->onnode = (base != NULL);
+  }
+#endif
+  if (base == NULL) {
+    base = mmap(
+      NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      qt_free(chunk);
+      return NULL;
+    }
+  }
+  chunk->base = base;
+  chunk->bytes = bytes;
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    uint8_t *block = base + (i * block_size);
+    qt_stack_hdr_t *hdr = qt_stack_hdr(block + stack_guard, sclass);
+
+    if (stack_guard) {
+      if (mprotect(block, stack_pagesize, PROT_NONE) != 0) {
+        perror("mprotect in qt_stack_pool_grow (1)");
+      }
+      if (mprotect(block + stack_guard + stack_size,
+                   stack_pagesize,
+                   PROT_NONE) != 0) {
+        perror("mprotect in qt_stack_pool_grow (2)");
+      }
+    }
+    hdr->pool = pool;
+    hdr->sclass = (uint8_t)sclass;
+    hdr->trimmed = 0;
+    hdr->next = NULL;
+    if (ret == NULL) {
+      ret = hdr;
+    } else {
+      *tail = hdr;
+      tail = &hdr->next;
+    }
+  }
+
+  QTHREAD_FASTLOCK_LOCK(&p->lock);
+  chunk->next = p->chunks;
+  p->chunks = chunk;
+  p->bytes += bytes;
+  if (huge) { p->huge_bytes += bytes; }
+  if (head) {
+    double const now = stack_trimmer_running ? qtimer_wtime() : 0.0;
+
+    for (qt_stack_hdr_t *h = head; h; h = h->next) { h->idle_since = now; }
+    *tail = p->free;
+    p->free = head;
+  }
+  QTHREAD_FASTLOCK_UNLOCK(&p->lock);
+  return ret;
+} /*}}}*/
+
+/* Give the pages of stacks idle since before cutoff back to the OS. Between
+ * calls, every stack older than the cutoff is trimmed, so the walk stops at
+ * the first trimmed stack it finds past the ones it trimmed itself. */
+static void qt_stack_pool_trim(unsigned int pool, double cutoff) { /*{{{*/
+  qt_stack_pool_t *const p = &stack_pools[pool];
+  size_t const stack_size = qlib->qthread_stack_sizes[pool / stack_nnodes];
+  int more;
+  int batches = 0;
+
+  do {
+    int n = 0;
+    qt_stack_hdr_t *h;
+
+    QTHREAD_FASTLOCK_LOCK(&p->lock);
+    for (h = p->free; h && h->idle_since > cutoff; h = h->next) {}
+    if (batches++) {
+      /* skip what the previous batches did */
+      while (h && h->trimmed) { h = h->next; }
+    }
+    for (; h && !h->trimmed && n < QT_STACK_TRIM_BATCH; h = h->next, ++n) {
+      uintptr_t const lo = (uintptr_t)qt_stack_of(h);
+      uintptr_t const start =
+        (lo + stack_pagesize - 1) & ~(uintptr_t)(stack_pagesize - 1);
+      uintptr_t const end =
+        (lo + stack_size) & ~(uintptr_t)(stack_pagesize - 1);
+
+      if (end > start) {
+        madvise((void *)start, end - start, QT_STACK_MADV_TRIM);
+      }
+      h->trimmed = 1;
+    }
+    more = (h && !h->trimmed);
+    QTHREAD_FASTLOCK_UNLOCK(&p->lock);
+  } while (more);
+} /*}}}*/
+
+static void *qt_stack_trimmer(void *arg) { /*{{{*/
+  unsigned long const period = (stack_trim_ms > 1) ? (stack_trim_ms / 2) : 1;
+
+  pthread_mutex_lock(&stack_trim_lock);
+  while (!stack_trim_exit) {
+    struct timeval now;
+    struct timespec deadline;
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec + (time_t)(period / 1000);
+    deadline.tv_nsec = (now.tv_usec * 1000L) + (long)(period % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&stack_trim_cond, &stack_trim_lock, &deadline);
+    if (stack_trim_exit) { break; }
+    pthread_mutex_unlock(&stack_trim_lock);
+    {
+      double const cutoff = qtimer_wtime() - (stack_trim_ms / 1000.0);
+
+      for (unsigned int i = 0; i < stack_npools; ++i) {
+        qt_stack_pool_trim(i, cutoff);
+      }
+    }
+    pthread_mutex_lock(&stack_trim_lock);
+  }
+  pthread_mutex_unlock(&stack_trim_lock);
+  return NULL;
+} /*}}}*/
+
+static inline size_t qt_stack_profile_slot(qthread_f f, size_t size) { /*{{{*/
+  return (((uintptr_t)f >> 4) * 0x9e3779b97f4a7c15ull) & (size - 1);
+} /*}}}*/
+
+/* The profile of f; the profile lock must be held. */
+static qthread_stack_profile_t *qt_stack_profile_of(qthread_f f) { /*{{{*/
+  size_t i;
+
+  if (2 * (stack_profiles_count + 1) > stack_profiles_size) {
+    size_t const newsize = stack_profiles_size ? 2 * stack_profiles_size : 64;
+    qthread_stack_profile_t *const table =
+      qt_calloc(newsize, sizeof(qthread_stack_profile_t));
+
+    assert(table);
+    for (size_t j = 0; j < stack_profiles_size; ++j) {
+      if (stack_profiles[j].f == NULL) { continue; }
+      i = qt_stack_profile_slot(stack_profiles[j].f, newsize);
+      while (table[i].f) { i = (i + 1) & (newsize - 1); }
+      table[i] = stack_profiles[j];
+    }
+    qt_free(stack_profiles);
+    stack_profiles = table;
+    stack_profiles_size = newsize;
+  }
+  i = qt_stack_profile_slot(f, stack_profiles_size);
+  while (stack_profiles[i].f != f) {
+    if (stack_profiles[i].f == NULL) {
+      stack_profiles[i].f = f;
+      stack_profiles_count++;
+      break;
+    }
+    i = (i + 1) & (stack_profiles_size - 1);
+  }
+  return &stack_profiles[i];
+} /*}}}*/
+
+void INTERNAL qt_stack_profile_record(qthread_f f,
+                                      void *stack,
+                                      unsigned int sclass) { /*{{{*/
+  size_t const size = qlib->qthread_stack_sizes[sclass];
+  uint64_t const *word = stack;
+  uint64_t const *const top = (uint64_t const *)((uint8_t *)stack + size);
+  size_t used;
+  unsigned int bucket = 0;
+  qthread_stack_profile_t *prof;
+
+  while (word < top && *word == QT_STACK_PAINT) { word++; }
+  used = (size_t)((uint8_t const *)top - (uint8_t const *)word);
+  while ((bucket < QTHREAD_STACK_PROFILE_BUCKETS - 1) &&
+         (used > ((size_t)256 << bucket))) {
+    bucket++;
+  }
+
+  QTHREAD_FASTLOCK_LOCK(&stack_profile_lock);
+  prof = qt_stack_profile_of(f);
+  prof->ntasks++;
+  prof->total_used += used;
+  if (used > prof->max_used) { prof->max_used = used; }
+  if (size > prof->stack_size) { prof->stack_size = size; }
+  prof->histogram[bucket]++;
+  QTHREAD_FASTLOCK_UNLOCK(&stack_profile_lock);
+} /*}}}*/
+
+size_t API_FUNC qthread_stack_profile(qthread_stack_profile_t *profiles,
+                                      size_t max) { /*{{{*/
+  size_t n = 0, count;
+
+  if (!qt_stack_profiling) { return 0; }
+  QTHREAD_FASTLOCK_LOCK(&stack_profile_lock);
+  for (size_t i = 0; i < stack_profiles_size && n < max; ++i) {
+    if (stack_profiles[i].f) { profiles[n++] = stack_profiles[i]; }
+  }
+  count = stack_profiles_count;
+  QTHREAD_FASTLOCK_UNLOCK(&stack_profile_lock);
+  return count;
+} /*}}}*/
+
+static void qt_stack_profile_report(void) { /*{{{*/
+  for (size_t i = 0; i < stack_profiles_size; ++i) {
+    qthread_stack_profile_t const *const prof = &stack_profiles[i];
+
+    if (prof->f == NULL) { continue; }
+    print_status("stack profile of %p: %lu tasks used at most %lu bytes "
+                 "(mean %lu) of %lu\n",
+                 (void *)(uintptr_t)prof->f,
+                 (unsigned long)prof->ntasks,
+                 (unsigned long)prof->max_used,
+                 (unsigned long)(prof->total_used / prof->ntasks),
+                 (unsigned long)prof->stack_size);
+    for (unsigned int b = 0; b < QTHREAD_STACK_PROFILE_BUCKETS; ++b) {
+      if (prof->histogram[b]) {
+        print_status("    <= %8lu bytes: %lu\n",
+                     (unsigned long)256 << b,
+                     (unsigned long)prof->histogram[b]);
+      }
+    }
+  }
+} /*}}}*/
+
+void INTERNAL qt_stack_subsystem_init(int guard_pages) { /*{{{*/
+  size_t const rdata_size =
+    (sizeof(struct qthread_runtime_data_s) + 15) & ~(size_t)15;
+  unsigned int maxnode = 0;
+  int bound = 0;
+
+  stack_pagesize = (size_t)getpagesize();
+  stack_guard = guard_pages ? stack_pagesize : 0;
+  for (unsigned int c = 0; c < QTHREAD_NUM_STACK_CLASSES; ++c) {
+    stack_hdr_offset[c] =
+      ((qlib->qthread_stack_sizes[c] + stack_guard + 15) & ~(size_t)15) +
+      rdata_size;
+    stack_block_size[c] = (stack_guard + stack_hdr_offset[c] +
+                           sizeof(qt_stack_hdr_t) + stack_pagesize - 1) &
+                          ~(stack_pagesize - 1);
+  }
+
+  stack_cache_depth =
+    qt_internal_get_env_num("STACK_CACHE", stack_cache_depth, 0);
+  if (stack_cache_depth > QT_STACK_CACHE_MAX) {
+    stack_cache_depth = QT_STACK_CACHE_MAX;
+  }
+  if (!qt_internal_get_env_bool("LAZY_STACKS", 1)) { stack_cache_depth = 0; }
+  /* Huge pages don't mix with guard pages (mprotect() would split them
+   * again), and trimming a stack splits the huge page under it, so that is
+   * off by default with them. */
+  stack_huge = 0;
+  if (qt_hugepages != QT_HUGEPAGES_OFF) {
+    if (guard_pages) {
+      print_warning("QT_HUGE_PAGES does not apply to stacks when guard pages "
+                    "are enabled\n");
+    } else {
+      stack_huge = 1;
+    }
+  }
+  stack_trim_ms =
+    qt_internal_get_env_num("STACK_TRIM", stack_huge ? 0 : 1000, 0);
+  qt_stack_profiling = qt_internal_get_env_bool("STACK_PROFILE", 0);
+  QTHREAD_FASTLOCK_INIT(stack_profile_lock);
+
+  for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+    unsigned int const node = qlib->shepherds[i].node;
+
+    if (node != QTHREAD_NO_NODE) {
+      bound = 1;
+      if (node > maxnode) { maxnode = node; }
+    }
+  }
+  stack_nnodes = maxnode + 1;
+  stack_npools = QTHREAD_NUM_STACK_CLASSES * stack_nnodes;
+  stack_pools = qt_calloc(stack_npools, sizeof(qt_stack_pool_t));
+  assert(stack_pools);
+  for (unsigned int i = 0; i < stack_npools; ++i) {
+    QTHREAD_FASTLOCK_INIT(stack_pools[i].lock);
+    stack_pools[i].node = bound ? (i % stack_nnodes) : QTHREAD_NO_NODE;
+  }
+
+  stack_trim_exit = 0;
+  if (stack_trim_ms > 0) {
+    int const r = pthread_create(&stack_trimmer, NULL, qt_stack_trimmer, NULL);
+
+    if (r != 0) {
+      fprintf(stderr,
+              "qt_stack_subsystem_init: pthread_create() failed (%d)\n",
+              r);
+    } else {
+      stack_trimmer_running = 1;
+    }
+  }
+} /*}}}*/
+
+void INTERNAL qt_stack_hugepage_usage(unsigned int sclass,
+                                      size_t *mapped,
+                                      size_t *huge) { /*{{{*/
+  *mapped = *huge = 0;
+  for (unsigned int n = 0; n < stack_nnodes; ++n) {
+    qt_stack_pool_t *const p = &stack_pools[(sclass * stack_nnodes) + n];
+
+    QTHREAD_FASTLOCK_LOCK(&p->lock);
+    *mapped += p->bytes;
+    *huge += p->huge_bytes;
+    QTHREAD_FASTLOCK_UNLOCK(&p->lock);
+  }
+} /*}}}*/
+
+void INTERNAL qt_stack_subsystem_fini(void) { /*{{{*/
+  if (stack_trimmer_running) {
+    pthread_mutex_lock(&stack_trim_lock);
+    stack_trim_exit = 1;
+    pthread_cond_signal(&stack_trim_cond);
+    pthread_mutex_unlock(&stack_trim_lock);
+    pthread_join(stack_trimmer, NULL);
+    stack_trimmer_running = 0;
+  }
+  if (qt_stack_profiling) {
+    qt_stack_profile_report();
+    qt_free(stack_profiles);
+    stack_profiles = NULL;
+    stack_profiles_size = stack_profiles_count = 0;
+    qt_stack_profiling = 0;
+  }
+  for (unsigned int i = 0; i < stack_npools; ++i) {
+    qt_stack_chunk_t *chunk = stack_pools[i].chunks;
+
+    while (chunk) {
+      qt_stack_chunk_t *const next = chunk->next;
+
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+      if (chunk->hugemap) {
+        qt_hugepage_unmap(chunk->base, chunk->bytes);
+      } else if (chunk->onnode) {
+        qt_affinity_free(chunk->base, chunk->bytes);
+      } else
+#endif
+      {
+        munmap(chunk->base, chunk->bytes);
+      }
+      qt_free(chunk);
+      chunk = next;
+    }
+    QTHREAD_FASTLOCK_DESTROY(stack_pools[i].lock);
+  }
+  qt_free(stack_pools);
+  stack_pools = NULL;
+  stack_npools = 0;
+  stack_nnodes = 0;
+} /*}}}*/
+
+void INTERNAL *qt_stack_alloc(qthread_worker_t *worker,
+                              unsigned int sclass) { /*{{{*/
+  void *stack;
+
+  assert(sclass < QTHREAD_NUM_STACK_CLASSES);
+  if (worker && worker->nstack_cache[sclass]) {
+    stack = worker->stack_cache[sclass][--worker->nstack_cache[sclass]];
+  } else {
+    unsigned int const pool = qt_stack_pool_of(worker, sclass);
+    qt_stack_pool_t *const p = &stack_pools[pool];
+    qt_stack_hdr_t *hdr;
+
+    QTHREAD_FASTLOCK_LOCK(&p->lock);
+    hdr = p->free;
+    if (hdr) { p->free = hdr->next; }
+    QTHREAD_FASTLOCK_UNLOCK(&p->lock);
+    if (hdr == NULL) {
+      hdr = qt_stack_pool_grow(pool);
+      if (hdr == NULL) { return NULL; }
+    }
+    stack = qt_stack_of(hdr);
+  }
+  if (QTHREAD_UNLIKELY(qt_stack_profiling)) {
+    memset(stack, QT_STACK_PAINT & 0xff, qlib->qthread_stack_sizes[sclass]);
+  }
+  return stack;
+} /*}}}*/
+
+void INTERNAL qt_stack_free(void *stack, unsigned int sclass) { /*{{{*/
+  qt_stack_hdr_t *const hdr = qt_stack_hdr(stack, sclass);
+  qt_stack_pool_t *const p = &stack_pools[hdr->pool];
+
+  hdr->trimmed = 0;
+  QTHREAD_FASTLOCK_LOCK(&p->lock);
+  /* stamped under the lock, so the list stays in order */
+  hdr->idle_since = stack_trimmer_running ? qtimer_wtime() : 0.0;
+  hdr->next = p->free;
+  p->free = hdr;
+  QTHREAD_FASTLOCK_UNLOCK(&p->lock);
+} /*}}}*/
+
+int INTERNAL qt_stack_keep(qthread_worker_t *worker,
+                           void *stack,
+                           unsigned int sclass) { /*{{{*/
+  if ((worker->nstack_cache[sclass] >= stack_cache_depth) ||
+      (qt_stack_hdr(stack, sclass)->pool != qt_stack_pool_of(worker, sclass))) {
+    return 0;
+  }
+  worker->stack_cache[sclass][worker->nstack_cache[sclass]++] = stack;
+  return 1;
+} /*}}}*/
+
+void INTERNAL qt_stack_worker_flush(qthread_worker_t *worker) { /*{{{*/
+  for (unsigned int c = 0; c < QTHREAD_NUM_STACK_CLASSES; ++c) {
+    while (worker->nstack_cache[c]) {
+      qt_stack_free(worker->stack_cache[c][--worker->nstack_cache[c]], c);
+    }
+  }
+} /*}}}*/
+
+/* vim:set expandtab: */
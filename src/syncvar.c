@@ -17,13 +17,17 @@
 #include "qt_alloc.h"
 #include "qt_asserts.h"
 #include "qt_blocking_structs.h"
+#include "qt_feb.h" /* for qt_multiwait_block() and _wake() */
 #include "qt_hash.h"
 #include "qt_initialized.h" // for qthread_library_initialized
+#include "qt_output_macros.h"
 #include "qt_profiling.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_qthread_struct.h"
+#include "qt_shepherd_innards.h"
 #include "qt_subsystems.h"
 #include "qt_threadqueues.h"
+#include "qt_timers.h" /* for qt_timer_block() */
 #include "qthread_innards.h"
 
 /* Internal Prototypes */
@@ -46,29 +50,6 @@ typedef struct {
   unsigned int sf : 1;
 } eflags_t;
 
-typedef enum bt {
-  WRITEEF,
-  WRITEEF_NB,
-  WRITEF,
-  READFF,
-  READFF_NB,
-  READFE,
-  READFE_NB,
-  FILL,
-  EMPTY,
-  INCR
-} blocker_type;
-
-typedef struct {
-  pthread_mutex_t lock;
-  pthread_cond_t condition;
-  uint32_t completed;
-  void *a;
-  void *b;
-  blocker_type type;
-  int retval;
-} qthread_syncvar_blocker_t;
-
 /* Internal Variables */
 static qt_hash *syncvars;
 #ifdef QTHREAD_COUNT_THREADS
@@ -217,6 +198,11 @@ errexit:
 
 static void qt_syncvar_subsystem_shutdown(void) {
   for (unsigned i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
+#ifdef QTHREAD_COUNT_THREADS
+    print_status("bin %i contended %u times for syncvars\n",
+                 i,
+                 (unsigned int)qt_hash_contended(syncvars[i]));
+#endif
     qt_hash_destroy_deallocate(syncvars[i],
                                (qt_hash_deallocator_fn)qthread_addrstat_delete);
   }
@@ -227,7 +213,8 @@ void INTERNAL qt_syncvar_subsystem_init(uint_fast8_t need_sync) {
   syncvars = MALLOC(sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
   assert(syncvars);
   for (unsigned i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
-    syncvars[i] = qt_hash_create(need_sync);
+    syncvars[i] = qt_hash_create_onnode(
+      need_sync, (int)qthread_internal_stripe_to_node(i));
     assert(syncvars[i]);
   }
   qthread_internal_cleanup_late(qt_syncvar_subsystem_shutdown);
@@ -261,75 +248,6 @@ int qthread_syncvar_status(syncvar_t *const v) { /*{{{ */
   return (realret & 0x2) ? 0 : 1;
 } /*}}} */
 
-static aligned_t qthread_syncvar_nonblocker_thread(void *arg) { /*{{{ */
-  qthread_syncvar_blocker_t *restrict const a =
-    (qthread_syncvar_blocker_t *)arg;
-
-  switch (a->type) {
-    case WRITEF: a->retval = qthread_syncvar_writeF(a->a, a->b); break;
-    case FILL: a->retval = qthread_syncvar_fill(a->a); break;
-    case EMPTY: a->retval = qthread_syncvar_empty(a->a); break;
-    default: return 1;
-  }
-  return 0;
-} /*}}} */
-
-static aligned_t qthread_syncvar_blocker_thread(void *arg) { /*{{{ */
-  qthread_syncvar_blocker_t *restrict const a =
-    (qthread_syncvar_blocker_t *)arg;
-
-  switch (a->type) {
-    case READFE: a->retval = qthread_syncvar_readFE(a->a, a->b); break;
-    case READFE_NB: a->retval = qthread_syncvar_readFE_nb(a->a, a->b); break;
-    case READFF: a->retval = qthread_syncvar_readFF(a->a, a->b); break;
-    case READFF_NB: a->retval = qthread_syncvar_readFF_nb(a->a, a->b); break;
-    case WRITEEF: a->retval = qthread_syncvar_writeEF(a->a, a->b); break;
-    case WRITEEF_NB: a->retval = qthread_syncvar_writeEF_nb(a->a, a->b); break;
-    case WRITEF: a->retval = qthread_syncvar_writeF(a->a, a->b); break;
-    case FILL: a->retval = qthread_syncvar_fill(a->a); break;
-    case EMPTY: a->retval = qthread_syncvar_empty(a->a); break;
-    case INCR: a->retval = qthread_syncvar_incrF(a->a, *(int64_t *)a->b); break;
-  }
-  pthread_mutex_lock(&a->lock);
-  a->completed = 1u;
-  pthread_cond_signal(&a->condition);
-  pthread_mutex_unlock(&a->lock);
-  return 0;
-} /*}}} */
-
-static int
-qthread_syncvar_nonblocker_func(void *dest, void *src, blocker_type t) { /*{{{*/
-  qthread_syncvar_blocker_t args = {PTHREAD_MUTEX_INITIALIZER,
-                                    PTHREAD_COND_INITIALIZER,
-                                    0u,
-                                    dest,
-                                    src,
-                                    t,
-                                    QTHREAD_SUCCESS};
-
-  qthread_fork(qthread_syncvar_nonblocker_thread, &args, NULL);
-  return args.retval;
-} /*}}}*/
-
-static int
-qthread_syncvar_blocker_func(void *dest, void *src, blocker_type t) { /*{{{*/
-  qthread_syncvar_blocker_t args = {PTHREAD_MUTEX_INITIALIZER,
-                                    PTHREAD_COND_INITIALIZER,
-                                    0u,
-                                    dest,
-                                    src,
-                                    t,
-                                    QTHREAD_SUCCESS};
-
-  pthread_mutex_lock(&args.lock);
-  qthread_fork(qthread_syncvar_blocker_thread, &args, NULL);
-  while (!args.completed) pthread_cond_wait(&args.condition, &args.lock);
-  pthread_mutex_unlock(&args.lock);
-  pthread_cond_destroy(&args.condition);
-  pthread_mutex_destroy(&args.lock);
-  return args.retval;
-} /*}}}*/
-
 /* state 0: full, no waiters
  * state 1: full, queued waiters (who are waiting for it to be empty)
  * state 2: empty, no waiters
@@ -359,8 +277,6 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict dest,
   qthread_t *me = qthread_internal_self();
   assert(src);
 
-  if (!me) { return qthread_syncvar_blocker_func(dest, src, READFF); }
-
 #if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) ||                                \
   (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC64) ||                              \
   (QTHREAD_ASSEMBLY_ARCH == QTHREAD_ARM) ||                                    \
@@ -437,6 +353,10 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict dest,
     QTHREAD_FASTLOCK_LOCK(&(m->lock));
 #endif /* ifdef LOCK_FREE_FEBS */
     UNLOCK_THIS_MODIFIED_SYNCVAR(src, ret, SYNCFEB_STATE_EMPTY_WITH_WAITERS);
+    if (!me) {
+      qt_addrres_external_wait(m, &m->FFQ, (aligned_t *)dest);
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     assert(X);
     if (!X) {
@@ -465,12 +385,9 @@ int API_FUNC qthread_syncvar_readFF_nb(uint64_t *restrict dest,
                                        syncvar_t *restrict src) { /*{{{ */
   eflags_t e = {0, 0, 0, 0, 0};
   uint64_t ret;
-  qthread_t *me = qthread_internal_self();
 
   assert(src);
 
-  if (!me) { return qthread_syncvar_blocker_func(dest, src, READFF_NB); }
-
 #if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) ||                                \
   (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC64) ||                              \
   (QTHREAD_ASSEMBLY_ARCH == QTHREAD_ARM) ||                                    \
@@ -505,6 +422,193 @@ int API_FUNC qthread_syncvar_readFF_nb(uint64_t *restrict dest,
   return QTHREAD_SUCCESS;
 } /*}}} */
 
+/* Find (or make) and lock the addrstat of addr, which must be locked */
+static inline qthread_addrstat_t *
+qthread_syncvar_getlocked(syncvar_t *addr) { /*{{{ */
+  int const lockbin = QTHREAD_CHOOSE_STRIPE(addr);
+  qthread_addrstat_t *m;
+
+  QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
+#ifdef LOCK_FREE_FEBS
+  do {
+    m = (qthread_addrstat_t *)qt_hash_get(syncvars[lockbin], (void *)addr);
+  got_m:
+    if (!m) {
+      m = qthread_addrstat_new();
+      if (!m) { return NULL; }
+      QTHREAD_FASTLOCK_LOCK(&m->lock);
+      qassertnot(qt_hash_put(syncvars[lockbin], (void *)addr, m), 0);
+    } else {
+      qthread_addrstat_t *m2;
+      hazardous_ptr(0, m);
+      if (m != (m2 = qt_hash_get(syncvars[lockbin], (void *)addr))) {
+        m = m2;
+        goto got_m;
+      }
+      if (!m->valid) { continue; }
+      QTHREAD_FASTLOCK_LOCK(&m->lock);
+      if (!m->valid) {
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        continue;
+      }
+    }
+    break;
+  } while (1);
+#else  /* ifdef LOCK_FREE_FEBS */
+  m = (qthread_addrstat_t *)qt_hash_get(syncvars[lockbin], (void *)addr);
+  if (!m) {
+    m = qthread_addrstat_new();
+    if (!m) { return NULL; }
+    qassertnot(qt_hash_put(syncvars[lockbin], (void *)addr, m), 0);
+  }
+  QTHREAD_FASTLOCK_LOCK(&(m->lock));
+#endif /* ifdef LOCK_FREE_FEBS */
+  return m;
+} /*}}} */
+
+/* Take whatever nodes of w are still queued on srcs[0..n-1] back out; returns
+ * how many there were */
+static size_t qthread_syncvar_multiwait_cancel(syncvar_t *const *srcs,
+                                               size_t n,
+                                               qthread_multiwait_t *w) { /*{{{ */
+  size_t found = 0;
+
+  for (size_t i = 0; i < n; ++i) {
+    eflags_t e = {0, 0, 0, 0, 0};
+    uint64_t ret = qthread_mwaitc(srcs[i], SYNCFEB_ANY, INT_MAX, &e);
+    qthread_addrstat_t *m;
+    qthread_addrres_t **queues[3];
+    int removeable = 0;
+
+    if (e.sf == 0) { /* nobody is waiting on it, us included */
+      UNLOCK_THIS_MODIFIED_SYNCVAR(srcs[i], ret, (e.pf << 1) | e.sf);
+      continue;
+    }
+    m = qthread_syncvar_getlocked(srcs[i]);
+    assert(m);
+    queues[0] = &m->FFQ;
+    queues[1] = &m->FEQ;
+    queues[2] = &m->EFQ;
+    for (int q = 0; q < 3; ++q) {
+      qthread_addrres_t **base = queues[q];
+
+      while (*base) {
+        qthread_addrres_t *X = *base;
+        if (X->multi == w) {
+          *base = X->next;
+          FREE_ADDRRES(X);
+          found++;
+        } else {
+          base = &X->next;
+        }
+      }
+    }
+    if ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL)) {
+      e.sf = 0; /* we were the last ones */
+      removeable = 1;
+    }
+    UNLOCK_THIS_MODIFIED_SYNCVAR(srcs[i], ret, (e.pf << 1) | e.sf);
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    if (removeable) { qthread_syncvar_remove(srcs[i]); }
+  }
+  return found;
+} /*}}} */
+
+/* Queue one node of w on each of srcs[0..n-1] that is empty; for an "any"
+ * wait, stop at the first one that is full. Returns how many of srcs were
+ * looked at, or -1 if memory ran out. */
+static ssize_t qthread_syncvar_multiwait_queue(syncvar_t *const *srcs,
+                                               size_t n,
+                                               qthread_multiwait_t *w,
+                                               qthread_t *me) { /*{{{ */
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    eflags_t e = {0, 0, 0, 0, 0};
+    qthread_addrres_t *X = ALLOC_ADDRRES();
+    qthread_addrstat_t *m;
+    uint64_t ret;
+
+    if (X == NULL) {
+      qthread_syncvar_multiwait_cancel(srcs, i, w);
+      return -1;
+    }
+    ret = qthread_mwaitc(srcs[i], SYNCFEB_ANY, INT_MAX, &e);
+    if (e.pf == 0) { /* full */
+      UNLOCK_THIS_MODIFIED_SYNCVAR(srcs[i], ret, e.sf);
+      FREE_ADDRRES(X);
+      if (w->any) {
+        qt_multiwait_hit(w, srcs[i]);
+        return i;
+      }
+      continue;
+    }
+    m = qthread_syncvar_getlocked(srcs[i]);
+    if (m == NULL) {
+      UNLOCK_THIS_MODIFIED_SYNCVAR(srcs[i], ret, (e.pf << 1) | e.sf);
+      FREE_ADDRRES(X);
+      qthread_syncvar_multiwait_cancel(srcs, i, w);
+      return -1;
+    }
+    UNLOCK_THIS_MODIFIED_SYNCVAR(
+      srcs[i], ret, SYNCFEB_STATE_EMPTY_WITH_WAITERS);
+    X->addr = NULL;
+    X->waiter = me;
+    X->multi = w;
+    X->next = m->FFQ;
+    m->FFQ = X;
+    if (!w->any) {
+      atomic_fetch_add_explicit(&w->pending, 1, memory_order_relaxed);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  }
+  return i;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_readFF_any(syncvar_t *const *srcs,
+                                        size_t n,
+                                        size_t *index) { /*{{{ */
+  qthread_multiwait_t w;
+  qthread_t *me = qthread_internal_self();
+  ssize_t queued;
+  void const *hit;
+
+  assert(qthread_library_initialized);
+  qassert_ret(srcs && n > 0, QTHREAD_BADARGS);
+
+  qt_multiwait_init(&w, 1);
+  queued = qthread_syncvar_multiwait_queue(srcs, n, &w, me);
+  if (queued < 0) { return QTHREAD_MALLOC_ERROR; }
+  qt_multiwait_block(&w, me);
+  /* the fills that came too late left their nodes behind */
+  qthread_syncvar_multiwait_cancel(srcs, queued, &w);
+  hit = atomic_load_explicit(&w.hit, memory_order_relaxed);
+  assert(hit);
+  if (index) {
+    size_t i = 0;
+    while (srcs[i] != hit) { ++i; }
+    *index = i;
+  }
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_readFF_all(syncvar_t *const *srcs,
+                                        size_t n) { /*{{{ */
+  qthread_multiwait_t w;
+  qthread_t *me = qthread_internal_self();
+
+  assert(qthread_library_initialized);
+  qassert_ret(srcs || n == 0, QTHREAD_BADARGS);
+
+  qt_multiwait_init(&w, 0);
+  if (qthread_syncvar_multiwait_queue(srcs, n, &w, me) < 0) {
+    return QTHREAD_MALLOC_ERROR;
+  }
+  /* every node is taken off by the fill it was waiting for */
+  qt_multiwait_block(&w, me);
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
 int API_FUNC qthread_syncvar_fill(syncvar_t *restrict addr) { /*{{{ */
   assert(qthread_library_initialized);
   eflags_t e = {0, 0, 0, 0, 0};
@@ -513,7 +617,6 @@ int API_FUNC qthread_syncvar_fill(syncvar_t *restrict addr) { /*{{{ */
 
   assert(addr);
 
-  if (!shep) { return qthread_syncvar_nonblocker_func(addr, NULL, FILL); }
   ret = qthread_mwaitc(addr, SYNCFEB_ANY, INT_MAX, &e);
   qassert_ret(e.cf == 0,
               QTHREAD_TIMEOUT); /* there better not have been a timeout */
@@ -586,7 +689,6 @@ int API_FUNC qthread_syncvar_empty(syncvar_t *restrict addr) { /*{{{ */
 
   assert(addr);
 
-  if (!shep) { return qthread_syncvar_nonblocker_func(addr, NULL, EMPTY); }
   ret = qthread_mwaitc(addr, SYNCFEB_ANY, INT_MAX, &e);
   qassert_ret(e.cf == 0,
               QTHREAD_TIMEOUT); /* there better not have been a timeout */
@@ -658,12 +760,11 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict dest,
 
   assert(src);
 
-  if (!me) { return qthread_syncvar_blocker_func(dest, src, READFE); }
-
-  assert(me->rdata);
-  assert(me->rdata->shepherd_ptr);
-  assert(me->rdata->shepherd_ptr->ready);
-  assert(me->rdata->shepherd_ptr->shepherd_id < qthread_num_shepherds());
+  assert(!me || me->rdata);
+  assert(!me || me->rdata->shepherd_ptr);
+  assert(!me || me->rdata->shepherd_ptr->ready);
+  assert(!me ||
+         me->rdata->shepherd_ptr->shepherd_id < qthread_num_shepherds());
 
   ret = qthread_mwaitc(src, SYNCFEB_FULL, INITIAL_TIMEOUT, &e);
   if (e.cf) { /* there was a timeout */
@@ -724,6 +825,11 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict dest,
     qt_hash_unlock(syncvars[lockbin]);
 #endif /* ifdef LOCK_FREE_FEBS */
     UNLOCK_THIS_MODIFIED_SYNCVAR(src, ret, SYNCFEB_STATE_EMPTY_WITH_WAITERS);
+    if (!me) {
+      qt_addrres_external_wait(m, &m->FEQ, (aligned_t *)&ret);
+      if (dest) { *dest = ret; }
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     assert(X);
     if (!X) {
@@ -784,7 +890,8 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict dest,
     }
     // src->u.w = BUILD_UNLOCKED_SYNCVAR(ret, e.sf); // this must be done by
     // gotlock_empty so we know what value to write
-    qthread_syncvar_gotlock_empty(me->rdata->shepherd_ptr, m, src, e.sf);
+    qthread_syncvar_gotlock_empty(
+      me ? me->rdata->shepherd_ptr : NULL, m, src, e.sf);
   } else {
   locked_full:
     assert(e.pf == 0); // otherwise this isn't really full
@@ -803,12 +910,11 @@ int API_FUNC qthread_syncvar_readFE_nb(uint64_t *restrict dest,
 
   assert(src);
 
-  if (!me) { return qthread_syncvar_blocker_func(dest, src, READFE_NB); }
-
-  assert(me->rdata);
-  assert(me->rdata->shepherd_ptr);
-  assert(me->rdata->shepherd_ptr->ready);
-  assert(me->rdata->shepherd_ptr->shepherd_id < qthread_num_shepherds());
+  assert(!me || me->rdata);
+  assert(!me || me->rdata->shepherd_ptr);
+  assert(!me || me->rdata->shepherd_ptr->ready);
+  assert(!me ||
+         me->rdata->shepherd_ptr->shepherd_id < qthread_num_shepherds());
 
   ret = qthread_mwaitc(src, SYNCFEB_FULL, 1, &e);
   if (e.cf) { /* there was a timeout */
@@ -859,7 +965,8 @@ int API_FUNC qthread_syncvar_readFE_nb(uint64_t *restrict dest,
     }
     // src->u.w = BUILD_UNLOCKED_SYNCVAR(ret, e.sf); // this must be done by
     // gotlock_empty so we know what value to write
-    qthread_syncvar_gotlock_empty(me->rdata->shepherd_ptr, m, src, e.sf);
+    qthread_syncvar_gotlock_empty(
+      me ? me->rdata->shepherd_ptr : NULL, m, src, e.sf);
   } else {
     assert(e.pf == 0); // otherwise this isn't really full
     UNLOCK_THIS_MODIFIED_SYNCVAR(src, ret, SYNCFEB_STATE_EMPTY_NO_WAITERS);
@@ -868,20 +975,52 @@ int API_FUNC qthread_syncvar_readFE_nb(uint64_t *restrict dest,
   return QTHREAD_SUCCESS;
 } /*}}} */
 
+/* shep is NULL when the syncvar operation was done by a plain pthread; then
+ * the waiter goes back to the shepherd it last ran on */
 static inline void qthread_syncvar_schedule(qthread_t *waiter,
                                             qthread_shepherd_t *shep) { /*{{{*/
   assert(waiter);
-  assert(shep);
   atomic_store_explicit(
     &waiter->thread_state, QTHREAD_STATE_RUNNING, memory_order_relaxed);
-  if (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
-      QTHREAD_UNSTEALABLE) {
+  if ((shep == NULL) ||
+      (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
+       QTHREAD_UNSTEALABLE)) {
     qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
   } else {
     qt_threadqueue_enqueue(shep->ready, waiter);
   }
 } /*}}}*/
 
+/* X has been dequeued and its operation done; let its waiter go. As with
+ * FEBs, pthreads are collected and only woken (by
+ * qthread_syncvar_release_externals()) once the addrstat lock is dropped. */
+static inline void
+qthread_syncvar_release(qthread_addrres_t *X,
+                        qthread_shepherd_t *shep,
+                        qthread_addrres_t **externals) { /*{{{*/
+  if (X->multi && !qt_multiwait_drop(X->multi)) {
+    /* its waiter has yet to block, or still needs other fills */
+    FREE_ADDRRES(X);
+    return;
+  }
+  if (X->waiter == NULL) {
+    X->next = *externals;
+    *externals = X;
+  } else {
+    qthread_syncvar_schedule(X->waiter, shep);
+    FREE_ADDRRES(X);
+  }
+} /*}}}*/
+
+static inline void
+qthread_syncvar_release_externals(qthread_addrres_t *X) { /*{{{*/
+  while (X) {
+    qthread_addrres_t *next = X->next;
+    qt_addrres_external_release(X);
+    X = next;
+  }
+} /*}}}*/
+
 static inline void qthread_syncvar_remove(void *maddr) { /*{{{*/
   int const lockbin = QTHREAD_CHOOSE_STRIPE(maddr);
   qthread_addrstat_t *m;
@@ -939,6 +1078,7 @@ static inline void qthread_syncvar_gotlock_empty(qthread_shepherd_t *shep,
                                                  syncvar_t *maddr,
                                                  uint64_t const sf) { /*{{{ */
   qthread_addrres_t *X = NULL;
+  qthread_addrres_t *externals = NULL;
   int removeable;
 
   m->full = 0;
@@ -950,8 +1090,7 @@ static inline void qthread_syncvar_gotlock_empty(qthread_shepherd_t *shep,
     if (maddr && (maddr != (syncvar_t *)X->addr)) {
       UNLOCK_THIS_MODIFIED_SYNCVAR(maddr, *((uint64_t *)X->addr), sf);
     }
-    qthread_syncvar_schedule(X->waiter, shep);
-    FREE_ADDRRES(X);
+    qthread_syncvar_release(X, shep, &externals);
   }
   if ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL)) {
     removeable = 1;
@@ -959,6 +1098,7 @@ static inline void qthread_syncvar_gotlock_empty(qthread_shepherd_t *shep,
     removeable = 0;
   }
   QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  qthread_syncvar_release_externals(externals);
   if (removeable) { qthread_syncvar_remove(maddr); }
 } /*}}} */
 
@@ -967,6 +1107,7 @@ static inline void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
                                                 syncvar_t *maddr,
                                                 uint64_t const ret) { /*{{{ */
   qthread_addrres_t *X = NULL;
+  qthread_addrres_t *externals = NULL;
   int removeable;
 
   m->full = 1;
@@ -975,11 +1116,15 @@ static inline void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
     /* dQ */
     X = m->FFQ;
     m->FFQ = X->next;
+    if (X->multi && !qt_multiwait_claim(X->multi, maddr)) {
+      /* part of an "any" wait that is over already */
+      FREE_ADDRRES(X);
+      continue;
+    }
     /* op */
     if (X->addr) { *(uint64_t *)X->addr = ret; }
     /* schedule */
-    qthread_syncvar_schedule(X->waiter, shep);
-    FREE_ADDRRES(X);
+    qthread_syncvar_release(X, shep, &externals);
   }
   if (m->FEQ != NULL) {
     /* dequeue one FEQ, do their operation, and reschedule them */
@@ -987,8 +1132,7 @@ static inline void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
     m->FEQ = X->next;
     /* op */
     if (X->addr) { *(uint64_t *)X->addr = ret; }
-    qthread_syncvar_schedule(X->waiter, shep);
-    FREE_ADDRRES(X);
+    qthread_syncvar_release(X, shep, &externals);
   }
   if ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL)) {
     removeable = 1;
@@ -996,6 +1140,7 @@ static inline void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
     removeable = 0;
   }
   QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  qthread_syncvar_release_externals(externals);
   if (removeable) { qthread_syncvar_remove(maddr); }
 } /*}}} */
 
@@ -1008,9 +1153,6 @@ int API_FUNC qthread_syncvar_writeF(syncvar_t *restrict dest,
 
   qassert_ret((*src >> 60) == 0, QTHREAD_OVERFLOW);
 
-  if (!shep) {
-    return qthread_syncvar_nonblocker_func(dest, (void *)src, WRITEF);
-  }
   qthread_mwaitc(dest, SYNCFEB_ANY, INT_MAX, &e);
   qassert_ret(e.cf == 0,
               QTHREAD_TIMEOUT);     /* there better not have been a timeout */
@@ -1085,7 +1227,6 @@ int API_FUNC qthread_syncvar_writeEF(syncvar_t *restrict dest,
 
   qassert_ret((*src >> 60) == 0, QTHREAD_OVERFLOW);
 
-  if (!me) { return qthread_syncvar_blocker_func(dest, (void *)src, WRITEEF); }
   (void)qthread_mwaitc(dest, SYNCFEB_EMPTY, INITIAL_TIMEOUT, &e);
   if (e.cf) { /* there was a timeout */
     qthread_addrstat_t *m;
@@ -1145,6 +1286,10 @@ int API_FUNC qthread_syncvar_writeEF(syncvar_t *restrict dest,
     qt_hash_unlock(syncvars[lockbin]);
 #endif /* ifdef LOCK_FREE_FEBS */
     UNLOCK_THIS_MODIFIED_SYNCVAR(dest, ret, SYNCFEB_STATE_FULL_WITH_WAITERS);
+    if (!me) {
+      qt_addrres_external_wait(m, &m->EFQ, (aligned_t *)src);
+      return QTHREAD_SUCCESS;
+    }
     X = ALLOC_ADDRRES();
     assert(X);
     X->addr = (aligned_t *)src;
@@ -1203,7 +1348,8 @@ int API_FUNC qthread_syncvar_writeEF(syncvar_t *restrict dest,
     {
       uint64_t val = *src;
       UNLOCK_THIS_MODIFIED_SYNCVAR(dest, val, (e.pf << 1) | e.sf);
-      qthread_syncvar_gotlock_fill(me->rdata->shepherd_ptr, m, dest, val);
+      qthread_syncvar_gotlock_fill(
+        me ? me->rdata->shepherd_ptr : NULL, m, dest, val);
     }
   } else {
     uint64_t val;
@@ -1231,9 +1377,6 @@ int qthread_syncvar_writeEF_nb(syncvar_t *restrict dest,
 
   qassert_ret((*src >> 60) == 0, QTHREAD_OVERFLOW);
 
-  if (!me) {
-    return qthread_syncvar_blocker_func(dest, (void *)src, WRITEEF_NB);
-  }
   (void)qthread_mwaitc(dest, SYNCFEB_EMPTY, 1, &e);
   if (e.cf) { /* there was a timeout */
     return QTHREAD_OPFAIL;
@@ -1285,7 +1428,8 @@ int qthread_syncvar_writeEF_nb(syncvar_t *restrict dest,
     {
       uint64_t val = *src;
       UNLOCK_THIS_MODIFIED_SYNCVAR(dest, val, (e.pf << 1) | e.sf);
-      qthread_syncvar_gotlock_fill(me->rdata->shepherd_ptr, m, dest, val);
+      qthread_syncvar_gotlock_fill(
+        me ? me->rdata->shepherd_ptr : NULL, m, dest, val);
     }
   } else {
     uint64_t val;
@@ -1303,6 +1447,137 @@ int API_FUNC qthread_syncvar_writeEF_const_nb(syncvar_t *restrict dest,
   return qthread_syncvar_writeEF_nb(dest, &src);
 } /*}}} */
 
+/* The timed operations work as the FEB ones do (see qt_feb_timedwait_t):
+ * the node they block with is part of a single-node "any" multi-wait, which
+ * their timer can take back out and claim. */
+typedef struct {
+  qthread_multiwait_t w;
+  syncvar_t *addr;
+  qthread_t *waiter;
+} qthread_syncvar_timedwait_t;
+
+static aligned_t qthread_syncvar_timed_expire(void *arg) { /*{{{ */
+  qthread_syncvar_timedwait_t *tw = (qthread_syncvar_timedwait_t *)arg;
+
+  if (qthread_syncvar_multiwait_cancel(&tw->addr, 1, &tw->w) &&
+      qt_multiwait_hit(&tw->w, &tw->w)) {
+    qt_multiwait_wake(&tw->w, tw->waiter);
+  }
+  return 0;
+} /*}}} */
+
+/* Block on addr for at most nsecs: a writer (in the EFQ) while it is full,
+ * a reader (in the FEQ if it empties addr, or else the FFQ) while it is
+ * empty. val is what the operation that dequeues us works with. Returns
+ * QTHREAD_OPFAIL if addr turned out not to need waiting on after all. */
+static int qthread_syncvar_timed_block(syncvar_t *addr,
+                                       uint_fast8_t writer,
+                                       uint_fast8_t empties,
+                                       uint64_t *val,
+                                       uint64_t nsecs) { /*{{{ */
+  eflags_t e = {0, 0, 0, 0, 0};
+  qthread_syncvar_timedwait_t tw;
+  qthread_addrres_t *X = ALLOC_ADDRRES();
+  qthread_addrstat_t *m;
+  qthread_addrres_t **q;
+  uint64_t ret;
+
+  if (X == NULL) { return QTHREAD_MALLOC_ERROR; }
+  ret = qthread_mwaitc(addr, SYNCFEB_ANY, INT_MAX, &e);
+  if (e.pf == writer) { /* empty for a writer, full for a reader */
+    UNLOCK_THIS_MODIFIED_SYNCVAR(addr, ret, (e.pf << 1) | e.sf);
+    FREE_ADDRRES(X);
+    return QTHREAD_OPFAIL;
+  }
+  m = qthread_syncvar_getlocked(addr);
+  if (m == NULL) {
+    UNLOCK_THIS_MODIFIED_SYNCVAR(addr, ret, (e.pf << 1) | e.sf);
+    FREE_ADDRRES(X);
+    return QTHREAD_MALLOC_ERROR;
+  }
+  UNLOCK_THIS_MODIFIED_SYNCVAR(addr,
+                               ret,
+                               writer ? SYNCFEB_STATE_FULL_WITH_WAITERS
+                                      : SYNCFEB_STATE_EMPTY_WITH_WAITERS);
+  q = writer ? &m->EFQ : (empties ? &m->FEQ : &m->FFQ);
+  qt_multiwait_init(&tw.w, 1);
+  tw.addr = addr;
+  tw.waiter = qthread_internal_self();
+  X->addr = (aligned_t *)val;
+  X->waiter = tw.waiter;
+  X->multi = &tw.w;
+  X->next = *q;
+  *q = X;
+  QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+  qt_timer_block(&tw.w, tw.waiter, nsecs, qthread_syncvar_timed_expire, &tw);
+  if (atomic_load_explicit(&tw.w.hit, memory_order_relaxed) == &tw.w) {
+    return ETIMEDOUT;
+  }
+  return QTHREAD_SUCCESS;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_readFE_timed(uint64_t *restrict dest,
+                                          syncvar_t *restrict src,
+                                          uint64_t nsecs) { /*{{{ */
+  uint64_t val;
+  int rc;
+
+  assert(qthread_library_initialized);
+  assert(src);
+
+  do {
+    rc = qthread_syncvar_readFE_nb(dest, src);
+    if (rc != QTHREAD_OPFAIL) { return rc; }
+    if (nsecs == 0) { return ETIMEDOUT; }
+    rc = qthread_syncvar_timed_block(src, 0, 1, &val, nsecs);
+  } while (rc == QTHREAD_OPFAIL);
+  if ((rc == QTHREAD_SUCCESS) && dest) { *dest = val; }
+  return rc;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_readFF_timed(uint64_t *restrict dest,
+                                          syncvar_t *restrict src,
+                                          uint64_t nsecs) { /*{{{ */
+  uint64_t val;
+  int rc;
+
+  assert(qthread_library_initialized);
+  assert(src);
+
+  do {
+    rc = qthread_syncvar_readFF_nb(dest, src);
+    if (rc != QTHREAD_OPFAIL) { return rc; }
+    if (nsecs == 0) { return ETIMEDOUT; }
+    rc = qthread_syncvar_timed_block(src, 0, 0, &val, nsecs);
+  } while (rc == QTHREAD_OPFAIL);
+  if ((rc == QTHREAD_SUCCESS) && dest) { *dest = val; }
+  return rc;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_writeEF_timed(syncvar_t *restrict dest,
+                                           uint64_t const *restrict src,
+                                           uint64_t nsecs) { /*{{{ */
+  uint64_t val = *src;
+  int rc;
+
+  assert(qthread_library_initialized);
+  qassert_ret((val >> 60) == 0, QTHREAD_OVERFLOW);
+
+  do {
+    rc = qthread_syncvar_writeEF_nb(dest, &val);
+    if (rc != QTHREAD_OPFAIL) { return rc; }
+    if (nsecs == 0) { return ETIMEDOUT; }
+    rc = qthread_syncvar_timed_block(dest, 1, 0, &val, nsecs);
+  } while (rc == QTHREAD_OPFAIL);
+  return rc;
+} /*}}} */
+
+int API_FUNC qthread_syncvar_writeEF_const_timed(syncvar_t *restrict dest,
+                                                 uint64_t const src,
+                                                 uint64_t nsecs) { /*{{{ */
+  return qthread_syncvar_writeEF_timed(dest, &src, nsecs);
+} /*}}} */
+
 uint64_t API_FUNC qthread_syncvar_incrF(syncvar_t *restrict operand,
                                         uint64_t const inc) { /*{{{ */
   assert(qthread_library_initialized);
@@ -1311,7 +1586,6 @@ uint64_t API_FUNC qthread_syncvar_incrF(syncvar_t *restrict operand,
   qthread_t *me = qthread_internal_self();
 
   assert(operand);
-  if (!me) { return qthread_syncvar_blocker_func(operand, (void *)&inc, INCR); }
   qthread_mwaitc(operand, SYNCFEB_ANY, INT_MAX, &e);
   qassert_ret(e.cf == 0,
               QTHREAD_TIMEOUT);     /* there better not have been a timeout */
@@ -1364,7 +1638,8 @@ uint64_t API_FUNC qthread_syncvar_incrF(syncvar_t *restrict operand,
     UNLOCK_THIS_MODIFIED_SYNCVAR(operand, newv, (e.pf << 1) | e.sf);
     assert(m->FFQ || m->EFQ); // otherwise there weren't really any waiters
     assert(m->FEQ == NULL);   // someone snuck in!
-    qthread_syncvar_gotlock_fill(me->rdata->shepherd_ptr, m, operand, newv);
+    qthread_syncvar_gotlock_fill(
+      me ? me->rdata->shepherd_ptr : NULL, m, operand, newv);
   } else {
     newv = operand->u.s.data + inc;
     UNLOCK_THIS_MODIFIED_SYNCVAR(operand, newv, (e.pf << 1) | e.sf);
@@ -1383,14 +1658,15 @@ static filter_code qt_syncvar_tf_call_cb(qt_key_t const addr,
   if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
     if (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
         QTHREAD_BIG_STRUCT) {
-      tls = &waiter->data[qlib->qthread_argcopy_size];
+      tls = &waiter->data[qlib->qthread_argcopy_classes[waiter->argclass]];
     } else {
       tls = waiter->data;
     }
   } else {
     if (atomic_load_explicit(&waiter->flags, memory_order_relaxed) &
         QTHREAD_BIG_STRUCT) {
-      tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
+      tls = *(void **)&waiter
+               ->data[qlib->qthread_argcopy_classes[waiter->argclass]];
     } else {
       tls = *(void **)&waiter->data[0];
     }
@@ -1431,6 +1707,10 @@ static void qt_syncvar_call_tf(qt_key_t const addr,
     }
     for (; curs != NULL; curs = curs->next) {
       qthread_t *waiter = curs->waiter;
+      if (waiter == NULL) { /* a pthread, not a task */
+        base = &curs->next;
+        continue;
+      }
       switch (tf(addr, waiter, f_arg)) {
         case 0: // ignore, move to the next one
           base = &curs->next;
@@ -0,0 +1,601 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* System Headers */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Public Headers */
+#include "qthread/cacheline.h"
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_alloc.h"
+#include "qt_asserts.h"
+#include "qt_envariables.h"
+#include "qt_expect.h"
+#include "qt_qthread_mgmt.h"
+#include "qt_qthread_struct.h"
+#include "qt_shepherd_innards.h"
+#include "qt_subsystems.h"
+#include "qt_threadqueue_scheduler.h"
+#include "qt_threadqueues.h"
+#include "qt_visibility.h"
+#include "qthread_innards.h" /* for qlib */
+
+/* The Chase-Lev scheduler gives every worker its own growable circular-array
+ * deque (Chase & Lev, SPAA'05; memory orderings after Le et al., PPoPP'13).
+ * The owning worker pushes and pops at the bottom with plain loads and stores;
+ * only the last-element race and thieves (who take from the top) need a CAS.
+ *
+ * Anything that cannot go on the calling worker's own deque (enqueues from
+ * other shepherds or from external pthreads, yielded tasks, and unstealable
+ * tasks) goes on a small lock-protected FIFO "inbox" that belongs to the
+ * shepherd and is only drained by that shepherd's workers. */
+
+#define CL_INITIAL_LOG_SIZE 8
+/* how many local pops a worker may do before it looks at the inbox, so that
+ * woken and remotely-spawned tasks are not starved by a busy deque */
+#define CL_INBOX_INTERVAL 64
+
+/* Data Structures */
+typedef struct _qt_chaselev_array {
+  int64_t mask;
+  struct _qt_chaselev_array *prev; /* retired arrays, freed with the queue */
+  qthread_t *_Atomic buf[];
+} qt_chaselev_array_t;
+
+typedef struct {
+  _Atomic int64_t top;
+  uint8_t pad1[CACHELINE_WIDTH - sizeof(int64_t)];
+  _Atomic int64_t bottom;
+  qt_chaselev_array_t *_Atomic array;
+  uint_fast32_t since_inbox; /* owner only */
+  uint8_t pad2[CACHELINE_WIDTH - sizeof(int64_t) - sizeof(void *) -
+               sizeof(uint_fast32_t)];
+} qt_chaselev_deque_t;
+
+struct _qt_threadqueue_node {
+  struct _qt_threadqueue_node *next;
+  qthread_t *value;
+} /* qt_threadqueue_node_t */;
+
+struct _qt_threadqueue {
+  qt_chaselev_deque_t *deques;
+  qt_threadqueue_node_t *head;
+  qt_threadqueue_node_t *tail;
+  _Atomic long inbox_len;
+  QTHREAD_TRYLOCK_TYPE qlock;
+  /* idle workers of this shepherd sleep here */
+  QTHREAD_COND_DECL(cond);
+  _Atomic uint64_t numwaiters;
+} /* qt_threadqueue_t */;
+
+static aligned_t steal_disable = 0;
+static long condwait_backoff = 0;
+
+/* idle workers on all shepherds, so that a spawn can skip looking for one */
+static _Atomic uint64_t numwaiters;
+static _Atomic int finalizing;
+static qthread_t *_Atomic mccoy = NULL;
+
+/* Memory Management */
+qt_threadqueue_pools_t generic_threadqueue_pools;
+#define ALLOC_THREADQUEUE()                                                    \
+  (qt_threadqueue_t *)qt_mpool_alloc(generic_threadqueue_pools.queues)
+#define FREE_THREADQUEUE(t) qt_mpool_free(generic_threadqueue_pools.queues, t)
+#define ALLOC_TQNODE()                                                         \
+  (qt_threadqueue_node_t *)qt_mpool_alloc(generic_threadqueue_pools.nodes)
+#define FREE_TQNODE(t) qt_mpool_free(generic_threadqueue_pools.nodes, t)
+
+extern qt_mpool generic_qthread_pool;
+#define FREE_QTHREAD(t) qt_mpool_free(generic_qthread_pool, t)
+
+static qt_chaselev_array_t *cl_array_new(int64_t size) { /*{{{*/
+  qt_chaselev_array_t *a =
+    qt_malloc(sizeof(qt_chaselev_array_t) + size * sizeof(qthread_t *));
+
+  assert(a);
+  assert((size & (size - 1)) == 0);
+  a->mask = size - 1;
+  a->prev = NULL;
+  return a;
+} /*}}}*/
+
+static void qt_threadqueue_subsystem_shutdown(void) { /*{{{*/
+  qt_mpool_destroy(generic_threadqueue_pools.nodes);
+  qt_mpool_destroy(generic_threadqueue_pools.queues);
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_subsystem_init(void) { /*{{{*/
+  generic_threadqueue_pools.queues =
+    qt_mpool_create_aligned(sizeof(qt_threadqueue_t), qthread_cacheline());
+  generic_threadqueue_pools.nodes =
+    qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), qthread_cacheline());
+  condwait_backoff = qt_internal_get_env_num("CONDWAIT_BACKOFF", 2048, 0);
+  atomic_store_explicit(&numwaiters, 0, memory_order_relaxed);
+  atomic_store_explicit(&finalizing, 0, memory_order_relaxed);
+  atomic_store_explicit(&mccoy, NULL, memory_order_relaxed);
+  qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
+} /*}}}*/
+
+/*****************************************/
+/* Chase-Lev deque operations            */
+/*****************************************/
+
+/* owner only */
+static void cl_push(qt_chaselev_deque_t *d, qthread_t *t) { /*{{{*/
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+  qt_chaselev_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+  if (QTHREAD_UNLIKELY(b - top > a->mask)) {
+    /* grow; thieves may still be reading the old array, so it is kept
+     * around until the queue is freed */
+    qt_chaselev_array_t *n = cl_array_new((a->mask + 1) << 1);
+    for (int64_t i = top; i < b; i++) {
+      atomic_store_explicit(
+        &n->buf[i & n->mask],
+        atomic_load_explicit(&a->buf[i & a->mask], memory_order_relaxed),
+        memory_order_relaxed);
+    }
+    n->prev = a;
+    atomic_store_explicit(&d->array, n, memory_order_release);
+    a = n;
+  }
+  atomic_store_explicit(&a->buf[b & a->mask], t, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+} /*}}}*/
+
+/* owner only */
+static qthread_t *cl_take(qt_chaselev_deque_t *d) { /*{{{*/
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  qt_chaselev_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+  int64_t top;
+  qthread_t *t = NULL;
+
+  /* cheap early-out so that idle spinning doesn't hammer the fence */
+  if (atomic_load_explicit(&d->top, memory_order_relaxed) > b) { return NULL; }
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  top = atomic_load_explicit(&d->top, memory_order_relaxed);
+  if (top <= b) {
+    t = atomic_load_explicit(&a->buf[b & a->mask], memory_order_relaxed);
+    if (top == b) {
+      /* last element; race the thieves for it */
+      if (!atomic_compare_exchange_strong_explicit(&d->top,
+                                                   &top,
+                                                   top + 1,
+                                                   memory_order_seq_cst,
+                                                   memory_order_relaxed)) {
+        t = NULL;
+      }
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return t;
+} /*}}}*/
+
+static qthread_t *cl_steal(qt_chaselev_deque_t *d) { /*{{{*/
+  int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+  if (top < b) {
+    qt_chaselev_array_t *a =
+      atomic_load_explicit(&d->array, memory_order_acquire);
+    qthread_t *t =
+      atomic_load_explicit(&a->buf[top & a->mask], memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&d->top,
+                                                &top,
+                                                top + 1,
+                                                memory_order_seq_cst,
+                                                memory_order_relaxed)) {
+      return t;
+    }
+  }
+  return NULL;
+} /*}}}*/
+
+static inline int64_t cl_size(qt_chaselev_deque_t *d) { /*{{{*/
+  int64_t s = atomic_load_explicit(&d->bottom, memory_order_relaxed) -
+              atomic_load_explicit(&d->top, memory_order_relaxed);
+
+  return (s > 0) ? s : 0;
+} /*}}}*/
+
+/*****************************************/
+/* inbox operations                      */
+/*****************************************/
+
+static void inbox_enqueue(qt_threadqueue_t *restrict q,
+                          qthread_t *restrict t) { /*{{{*/
+  qt_threadqueue_node_t *node = ALLOC_TQNODE();
+
+  assert(node != NULL);
+  node->value = t;
+  node->next = NULL;
+  QTHREAD_TRYLOCK_LOCK(&q->qlock);
+  if (q->tail == NULL) {
+    q->head = node;
+  } else {
+    q->tail->next = node;
+  }
+  q->tail = node;
+  atomic_fetch_add_explicit(&q->inbox_len, 1, memory_order_relaxed);
+  QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+} /*}}}*/
+
+static qthread_t *inbox_dequeue(qt_threadqueue_t *q) { /*{{{*/
+  qt_threadqueue_node_t *node;
+  qthread_t *t;
+
+  if (atomic_load_explicit(&q->inbox_len, memory_order_relaxed) == 0) {
+    return NULL;
+  }
+  QTHREAD_TRYLOCK_LOCK(&q->qlock);
+  node = q->head;
+  if (node == NULL) {
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    return NULL;
+  }
+  q->head = node->next;
+  if (q->head == NULL) { q->tail = NULL; }
+  atomic_fetch_sub_explicit(&q->inbox_len, 1, memory_order_relaxed);
+  QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  t = node->value;
+  FREE_TQNODE(node);
+  return t;
+} /*}}}*/
+
+/*****************************************/
+/* functions to manage the thread queues */
+/*****************************************/
+
+qt_threadqueue_t INTERNAL *qt_threadqueue_new(void) { /*{{{*/
+  qt_threadqueue_t *q = ALLOC_THREADQUEUE();
+
+  if (q != NULL) {
+    q->deques = qt_internal_aligned_alloc(
+      qlib->nworkerspershep * sizeof(qt_chaselev_deque_t), CACHELINE_WIDTH);
+    assert(q->deques);
+    for (qthread_worker_id_t i = 0; i < qlib->nworkerspershep; i++) {
+      qt_chaselev_deque_t *d = &q->deques[i];
+      atomic_store_explicit(&d->top, 0, memory_order_relaxed);
+      atomic_store_explicit(&d->bottom, 0, memory_order_relaxed);
+      atomic_store_explicit(
+        &d->array, cl_array_new(1 << CL_INITIAL_LOG_SIZE), memory_order_relaxed);
+      d->since_inbox = 0;
+    }
+    q->head = NULL;
+    q->tail = NULL;
+    atomic_store_explicit(&q->inbox_len, 0, memory_order_relaxed);
+    QTHREAD_TRYLOCK_INIT(q->qlock);
+    QTHREAD_COND_INIT(q->cond);
+    atomic_store_explicit(&q->numwaiters, 0, memory_order_relaxed);
+  }
+  return q;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q) { /*{{{*/
+  qthread_t *t;
+
+  for (qthread_worker_id_t i = 0; i < qlib->nworkerspershep; i++) {
+    qt_chaselev_deque_t *d = &q->deques[i];
+    qt_chaselev_array_t *a =
+      atomic_load_explicit(&d->array, memory_order_relaxed);
+
+    while ((t = cl_steal(d)) != NULL) { FREE_QTHREAD(t); }
+    while (a) {
+      qt_chaselev_array_t *prev = a->prev;
+      qt_free(a);
+      a = prev;
+    }
+  }
+  qt_internal_aligned_free(q->deques, CACHELINE_WIDTH);
+  while ((t = inbox_dequeue(q)) != NULL) { FREE_QTHREAD(t); }
+  QTHREAD_TRYLOCK_DESTROY(q->qlock);
+  QTHREAD_COND_DESTROY(q->cond);
+  FREE_THREADQUEUE(q);
+} /*}}}*/
+
+ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q) { /*{{{*/
+  ssize_t len = atomic_load_explicit(&q->inbox_len, memory_order_relaxed);
+
+  for (qthread_worker_id_t i = 0; i < qlib->nworkerspershep; i++) {
+    len += cl_size(&q->deques[i]);
+  }
+  return len;
+} /*}}}*/
+
+static inline int qt_threadqueue_isstealable(qthread_t *t) { /*{{{*/
+  return ((atomic_load_explicit(&t->flags, memory_order_relaxed) &
+           (QTHREAD_UNSTEALABLE | QTHREAD_REAL_MCCOY)) == 0)
+           ? 1
+           : 0;
+} /*}}}*/
+
+static inline void qt_threadqueue_signal(qt_threadqueue_t *q,
+                                         int everyone) { /*{{{*/
+  if (atomic_load_explicit(&q->numwaiters, memory_order_relaxed)) {
+    QTHREAD_COND_LOCK(q->cond);
+    if (everyone) {
+      QTHREAD_COND_BCAST(q->cond);
+    } else if (atomic_load_explicit(&q->numwaiters, memory_order_relaxed)) {
+      QTHREAD_COND_SIGNAL(q->cond);
+    }
+    QTHREAD_COND_UNLOCK(q->cond);
+  }
+} /*}}}*/
+
+/* Wake a worker of this shepherd, or else of the nearest shepherd that has
+ * one asleep, to steal from the deque just pushed. This is only a plain load
+ * on the spawn path; the pushing worker is awake and will run the task
+ * itself, so a thief that falls asleep just then costs some parallelism for
+ * one timed wait, never progress. */
+static inline void qt_threadqueue_wake_thief(qthread_shepherd_t *shep) { /*{{{*/
+  qthread_shepherd_id_t *const sorted_sheplist = shep->sorted_sheplist;
+
+  if (QTHREAD_LIKELY(atomic_load_explicit(&numwaiters, memory_order_relaxed) ==
+                     0)) {
+    return;
+  }
+  if (atomic_load_explicit(&shep->ready->numwaiters, memory_order_relaxed)) {
+    qt_threadqueue_signal(shep->ready, 0);
+    return;
+  }
+  if (steal_disable || (sorted_sheplist == NULL)) { return; }
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds - 1; s++) {
+    qt_threadqueue_t *victim = qlib->shepherds[sorted_sheplist[s]].ready;
+    if (atomic_load_explicit(&victim->numwaiters, memory_order_relaxed)) {
+      qt_threadqueue_signal(victim, 0);
+      return;
+    }
+  }
+} /*}}}*/
+
+/* Only q's own workers drain its inbox, and they may all be asleep, so this
+ * must not miss one that is about to be: the fence pairs with the one a
+ * worker issues between counting itself a waiter and checking the inbox. */
+static inline void qt_threadqueue_wake_inbox(qt_threadqueue_t *q,
+                                             int everyone) { /*{{{*/
+  atomic_thread_fence(memory_order_seq_cst);
+  qt_threadqueue_signal(q, everyone);
+} /*}}}*/
+
+static void qt_threadqueue_wake_all(void) { /*{{{*/
+  atomic_thread_fence(memory_order_seq_cst);
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; s++) {
+    qt_threadqueue_signal(qlib->shepherds[s].ready, 1);
+  }
+} /*}}}*/
+
+static inline void qt_threadqueue_check_term(qthread_t *t) { /*{{{*/
+  if (QTHREAD_UNLIKELY(atomic_load_explicit(&t->thread_state,
+                                            memory_order_relaxed) ==
+                       QTHREAD_STATE_TERM_SHEP)) {
+    atomic_store_explicit(&finalizing, 1, memory_order_relaxed);
+  }
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
+                                     qthread_t *restrict t) { /*{{{*/
+  qthread_worker_t *worker;
+
+  assert(q != NULL);
+  assert(t != NULL);
+
+  qt_threadqueue_check_term(t);
+  worker = qthread_internal_getworker();
+  if (qt_threadqueue_isstealable(t) && worker && worker->shepherd &&
+      (worker->shepherd->ready == q)) {
+    cl_push(&q->deques[worker->worker_id], t);
+    qt_threadqueue_wake_thief(worker->shepherd);
+  } else {
+    inbox_enqueue(q, t);
+    if (atomic_load_explicit(&finalizing, memory_order_relaxed)) {
+      qt_threadqueue_wake_all();
+    } else {
+      qt_threadqueue_wake_inbox(q, 0);
+    }
+  }
+} /*}}}*/
+
+/* pushes onto the owner's deque are already lock-free */
+void INTERNAL qt_threadqueue_enqueue_bulk(qt_threadqueue_t *restrict q,
+                                          qthread_t **restrict t,
+                                          size_t n) { /*{{{*/
+  for (size_t i = 0; i < n; ++i) { qt_threadqueue_enqueue(q, t[i]); }
+} /*}}}*/
+
+/* yielded threads go behind everything else that is ready on this shepherd */
+void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
+                                             qthread_t *restrict t) { /*{{{*/
+  assert(q != NULL);
+  assert(t != NULL);
+
+  qt_threadqueue_check_term(t);
+  inbox_enqueue(q, t);
+  qt_threadqueue_wake_inbox(q, 0);
+} /*}}}*/
+
+/* Steal a single task, trying the other workers on this shepherd first and
+ * then the other shepherds in order of distance. */
+static qthread_t *qthread_steal(qthread_worker_t *thief) { /*{{{*/
+  qthread_shepherd_t *const my_shepherd = thief->shepherd;
+  qthread_shepherd_t *const shepherds = qlib->shepherds;
+  qthread_shepherd_id_t *const sorted_sheplist = my_shepherd->sorted_sheplist;
+  qthread_worker_id_t const nworkers = qlib->nworkerspershep;
+  qthread_t *t;
+
+  for (qthread_worker_id_t i = 1; i < nworkers; i++) {
+    qt_threadqueue_t *q = my_shepherd->ready;
+    t = cl_steal(&q->deques[(thief->worker_id + i) % nworkers]);
+    if (t) { return t; }
+  }
+  if (sorted_sheplist == NULL) { return NULL; }
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds - 1; s++) {
+    qt_threadqueue_t *victim = shepherds[sorted_sheplist[s]].ready;
+    for (qthread_worker_id_t i = 0; i < nworkers; i++) {
+      t = cl_steal(&victim->deques[(thief->worker_id + i) % nworkers]);
+      if (t) { return t; }
+    }
+    if (steal_disable) { break; }
+  }
+  return NULL;
+} /*}}}*/
+
+qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
+                                            qt_threadqueue_private_t *qc,
+                                            uint_fast8_t active) { /*{{{*/
+  qthread_worker_t *worker = qthread_internal_getworker();
+  qt_chaselev_deque_t *d;
+  qthread_t *t;
+
+  assert(q != NULL);
+  assert(worker);
+  assert(worker->shepherd->ready == q);
+  d = &q->deques[worker->worker_id];
+
+  for (long numwaits = 0;; numwaits++) {
+    if ((worker->packed_worker_id == 0) &&
+        atomic_load_explicit(&mccoy, memory_order_relaxed)) {
+      t = atomic_exchange_explicit(&mccoy, NULL, memory_order_acquire);
+      if (t) { return t; }
+    }
+    if (QTHREAD_UNLIKELY(++d->since_inbox >= CL_INBOX_INTERVAL)) {
+      d->since_inbox = 0;
+      if ((t = inbox_dequeue(q)) != NULL) { goto found_inbox; }
+    }
+    if ((t = cl_take(d)) != NULL) { return t; }
+    if ((t = inbox_dequeue(q)) != NULL) {
+      d->since_inbox = 0;
+      goto found_inbox;
+    }
+    if (active && !steal_disable) {
+      if ((t = qthread_steal(worker)) != NULL) { return t; }
+    }
+
+    if ((numwaits > condwait_backoff) &&
+        !atomic_load_explicit(&finalizing, memory_order_relaxed)) {
+      QTHREAD_COND_LOCK(q->cond);
+      atomic_fetch_add_explicit(&q->numwaiters, 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&numwaiters, 1, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (!atomic_load_explicit(&finalizing, memory_order_relaxed) &&
+          (cl_size(d) == 0) &&
+          (atomic_load_explicit(&q->inbox_len, memory_order_relaxed) == 0) &&
+          ((worker->packed_worker_id != 0) ||
+           (atomic_load_explicit(&mccoy, memory_order_relaxed) == NULL))) {
+        QTHREAD_COND_WAIT(q->cond);
+      }
+      atomic_fetch_sub_explicit(&numwaiters, 1, memory_order_relaxed);
+      atomic_fetch_sub_explicit(&q->numwaiters, 1, memory_order_relaxed);
+      QTHREAD_COND_UNLOCK(q->cond);
+      numwaits = 0;
+    } else {
+      SPINLOCK_BODY();
+    }
+    continue;
+
+  found_inbox:
+    /* The McCoy thread is unstealable, so it always comes through an inbox;
+     * it can only run on worker 0, so hand it over if we aren't that. */
+    if ((atomic_load_explicit(&t->flags, memory_order_relaxed) &
+         QTHREAD_REAL_MCCOY) &&
+        (worker->packed_worker_id != 0)) {
+      assert(atomic_load_explicit(&mccoy, memory_order_relaxed) == NULL);
+      atomic_store_explicit(&mccoy, t, memory_order_release);
+      qt_threadqueue_wake_inbox(qlib->shepherds[0].ready, 1);
+      continue;
+    }
+    return t;
+  }
+} /*}}}*/
+
+/* walk the inbox removing all tasks matching this description; tasks on the
+ * per-worker deques cannot be removed out of order */
+void INTERNAL qt_threadqueue_filter(qt_threadqueue_t *q,
+                                    qt_threadqueue_filter_f f) { /*{{{*/
+  qt_threadqueue_node_t **lp;
+  qt_threadqueue_node_t *prev = NULL;
+
+  assert(q != NULL);
+
+  QTHREAD_TRYLOCK_LOCK(&q->qlock);
+  lp = &q->head;
+  while (*lp) {
+    qt_threadqueue_node_t *node = *lp;
+    filter_code fc = f(node->value);
+    if ((fc == REMOVE_AND_CONTINUE) || (fc == REMOVE_AND_STOP)) {
+      *lp = node->next;
+      if (q->tail == node) { q->tail = prev; }
+      atomic_fetch_sub_explicit(&q->inbox_len, 1, memory_order_relaxed);
+      FREE_TQNODE(node);
+    } else {
+      prev = node;
+      lp = &node->next;
+    }
+    if ((fc == IGNORE_AND_STOP) || (fc == REMOVE_AND_STOP)) { break; }
+  }
+  QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+} /*}}}*/
+
+/* Unsupported operations */
+qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
+                                                    void *value) { /*{{{*/
+  return NULL;
+} /*}}}*/
+
+qthread_t INTERNAL *
+qt_threadqueue_private_dequeue(qt_threadqueue_private_t *c) { /*{{{*/
+  return NULL;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue_cache(
+  qt_threadqueue_t *q, qt_threadqueue_private_t *cache) { /*{{{*/
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_private_filter(
+  qt_threadqueue_private_t *restrict c, qt_threadqueue_filter_f f) { /*{{{*/
+} /*}}}*/
+
+int INTERNAL
+qt_threadqueue_private_enqueue(qt_threadqueue_private_t *restrict pq,
+                               qt_threadqueue_t *restrict q,
+                               qthread_t *restrict t) { /*{{{*/
+  return 0;
+} /*}}}*/
+
+int INTERNAL qt_threadqueue_private_enqueue_yielded(
+  qt_threadqueue_private_t *restrict q, qthread_t *restrict t) { /*{{{*/
+  return 0;
+} /*}}}*/
+
+void INTERNAL qthread_steal_enable(void) { /*{{{*/ steal_disable = 0; } /*}}}*/
+
+void INTERNAL qthread_steal_disable(void) { /*{{{*/ steal_disable = 1; } /*}}}*/
+
+qthread_shepherd_id_t INTERNAL
+qt_threadqueue_choose_dest(qthread_shepherd_t *curr_shep) {
+  if (curr_shep) {
+    return curr_shep->shepherd_id;
+  } else {
+    return (qthread_shepherd_id_t)0;
+  }
+}
+
+size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy) {
+  switch (policy) {
+    default: return THREADQUEUE_POLICY_UNSUPPORTED;
+  }
+}
+
+/* vim:set expandtab: */
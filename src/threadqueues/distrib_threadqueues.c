@@ -379,6 +379,12 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
   return qt_threadqueue_enqueue_head(q, t);
 }
 
+void INTERNAL qt_threadqueue_enqueue_bulk(qt_threadqueue_t *restrict q,
+                                          qthread_t **restrict t,
+                                          size_t n) {
+  for (size_t i = 0; i < n; ++i) { qt_threadqueue_enqueue(q, t[i]); }
+}
+
 /* Unsupported operations */
 qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
                                                     void *value) {
@@ -15,10 +15,12 @@
 /* Internal Headers */
 #include "qt_asserts.h"
 #include "qt_envariables.h"
+#include "qt_expect.h"
 #include "qt_macros.h"
 #include "qt_prefetch.h"
 #include "qt_qthread_mgmt.h" /* for qthread_thread_free() */
 #include "qt_qthread_struct.h"
+#include "qt_shepherd_innards.h" /* for qthread_internal_getshep() */
 #include "qt_subsystems.h"
 #include "qt_threadqueue_scheduler.h"
 #include "qt_threadqueues.h"
@@ -28,11 +30,29 @@
 /* This thread queueing uses the NEMESIS lock-free queue protocol from
  * http://www.mcs.anl.gov/~buntinas/papers/ccgrid06-nemesis.pdf
  * Note: it is NOT SAFE to use with multiple de-queuers, it is ONLY safe to use
- * with multiple enqueuers and a single de-queuer. */
+ * with multiple enqueuers and a single de-queuer.
+ *
+ * Work stealing therefore never touches the NEMESIS list itself. While some
+ * shepherd is idle, an owner with a backlog moves a batch of its oldest
+ * tasks into its queue's steal buffer, a short locked list that idle
+ * shepherds take half of at a time. If the batch has not all been stolen by
+ * the time the owner has run as many other tasks as it published, the owner
+ * takes the rest back, so publishing never delays a task by more than one
+ * batch. Tasks taken back, and tasks stolen, go on a private list that the
+ * owner runs before going back to its NEMESIS list. */
 
 int num_spins_before_condwait;
 #define DEFAULT_SPINCOUNT 300000
 
+/* Largest batch published at once when QT_STEAL_CHUNK is 0 (half of the
+ * backlog) */
+#define NEMESIS_STEAL_MAX 128
+
+static aligned_t steal_disable = 0;
+static saligned_t steal_chunksize = 0;
+/* shepherds waiting for work and willing to steal it */
+static _Atomic int nemesis_idle = 0;
+
 /* Data Structures */
 struct _qt_threadqueue_node {
   struct _qt_threadqueue_node *_Atomic next;
@@ -59,10 +79,19 @@ struct _qt_threadqueue {
   /* the following is for estimating a queue's "busy" level, and is not
    * guaranteed accurate (that would be a race condition) */
   saligned_t advisory_queuelen;
+  /* the owner's private list (see above), and how many more tasks it runs
+   * before taking back what is left in the steal buffer */
+  qt_threadqueue_node_t *local;
+  saligned_t steal_window;
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
   uint32_t frustration;
   QTHREAD_COND_DECL(trigger);
 #endif
+  /* The steal buffer */
+  alignas(CACHELINE_WIDTH) QTHREAD_TRYLOCK_TYPE steal_lock;
+  _Atomic saligned_t steal_len;
+  qt_threadqueue_node_t *steal_head;
+  qt_threadqueue_node_t *steal_tail;
 } /* qt_threadqueue_t */;
 
 /* Memory Management */
@@ -83,6 +112,7 @@ void INTERNAL qt_threadqueue_subsystem_init(void) { /*{{{*/
 
   num_spins_before_condwait =
     qt_internal_get_env_num("SPINCOUNT", DEFAULT_SPINCOUNT, 0);
+  steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
 
   generic_threadqueue_pools.queues = qt_mpool_create_aligned(
     sizeof(qt_threadqueue_t), _Alignof(qt_threadqueue_t));
@@ -103,6 +133,11 @@ qt_threadqueue_t INTERNAL *qt_threadqueue_new(void) { /*{{{ */
   q->q.shadow_head = NULL;
   q->advisory_queuelen = 0;
   q->q.nemesis_advisory_queuelen = 0; // redundant
+  q->local = NULL;
+  q->steal_window = 0;
+  QTHREAD_TRYLOCK_INIT(q->steal_lock);
+  atomic_init(&q->steal_len, 0);
+  q->steal_head = q->steal_tail = NULL;
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
   q->frustration = 0;
   QTHREAD_COND_INIT(q->trigger);
@@ -173,8 +208,188 @@ qt_internal_NEMESIS_dequeue_st(NEMESIS_queue *q) { /*{{{ */
   return retval;
 } /*}}} */
 
+static inline void
+qt_internal_NEMESIS_enqueue(NEMESIS_queue *q,
+                            qt_threadqueue_node_t *node) { /*{{{ */
+  qt_threadqueue_node_t *prev =
+    qt_internal_atomic_swap_ptr((void **)&(q->tail), node);
+
+  if (prev == NULL) {
+    atomic_store_explicit(&q->head, node, memory_order_relaxed);
+  } else {
+    atomic_store_explicit(&prev->next, node, memory_order_relaxed);
+  }
+} /*}}} */
+
+static inline int qt_threadqueue_isstealable(qthread_t *t) { /*{{{*/
+  return ((atomic_load_explicit(&t->flags, memory_order_relaxed) &
+           (QTHREAD_UNSTEALABLE | QTHREAD_REAL_MCCOY)) == 0)
+           ? 1
+           : 0;
+} /*}}}*/
+
+/* Owner only: the next task on the private list */
+static inline qt_threadqueue_node_t *
+qt_threadqueue_local_pop(qt_threadqueue_t *q) { /*{{{*/
+  qt_threadqueue_node_t *node = q->local;
+
+  if (node) {
+    q->local = atomic_load_explicit(&node->next, memory_order_relaxed);
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  }
+  return node;
+} /*}}}*/
+
+/* Owner only: take back whatever is left in the steal buffer, in front of
+ * the private list. */
+static void qt_threadqueue_reclaim(qt_threadqueue_t *q) { /*{{{*/
+  qt_threadqueue_node_t *head, *tail;
+
+  QTHREAD_TRYLOCK_LOCK(&q->steal_lock);
+  head = q->steal_head;
+  tail = q->steal_tail;
+  q->steal_head = q->steal_tail = NULL;
+  atomic_store_explicit(&q->steal_len, 0, memory_order_relaxed);
+  QTHREAD_TRYLOCK_UNLOCK(&q->steal_lock);
+  if (head) {
+    atomic_store_explicit(&tail->next, q->local, memory_order_relaxed);
+    q->local = head;
+  }
+} /*}}}*/
+
+#ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+/* An idle shepherd that gave up and went to sleep on its own trigger is still
+ * counted in nemesis_idle; wake one so that what was just published does not
+ * sit there until the owner takes it back. */
+static void qt_threadqueue_wake_thief(qt_threadqueue_t *q) { /*{{{*/
+  MACHINE_FENCE;
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; s++) {
+    qt_threadqueue_t *const r = qlib->shepherds[s].ready;
+
+    if ((r == q) || (r->frustration <= 1000)) { continue; }
+    QTHREAD_COND_LOCK(r->trigger);
+    if (r->frustration) {
+      r->frustration = 0;
+      QTHREAD_COND_SIGNAL(r->trigger);
+      QTHREAD_COND_UNLOCK(r->trigger);
+      return;
+    }
+    QTHREAD_COND_UNLOCK(r->trigger);
+  }
+} /*}}}*/
+#endif /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
+
+/* Owner only, with an empty private list: move up to n of the oldest tasks
+ * on the NEMESIS list into the steal buffer. Tasks that must stay put go on
+ * the private list instead, so they still run in order. */
+static void qt_threadqueue_publish(qt_threadqueue_t *q, saligned_t n) { /*{{{*/
+  qt_threadqueue_node_t *first = NULL, *last = NULL, *kept = NULL;
+  saligned_t count = 0;
+
+  assert(q->local == NULL);
+  for (saligned_t i = 0; i < n; ++i) {
+    qt_threadqueue_node_t *node = qt_internal_NEMESIS_dequeue(&q->q);
+
+    if (node == NULL) { break; }
+    if (!qt_threadqueue_isstealable(node->thread)) {
+      if (kept) {
+        atomic_store_explicit(&kept->next, node, memory_order_relaxed);
+      } else {
+        q->local = node;
+      }
+      kept = node;
+      continue;
+    }
+    if (last) {
+      atomic_store_explicit(&last->next, node, memory_order_relaxed);
+    } else {
+      first = node;
+    }
+    last = node;
+    count++;
+  }
+  if (count == 0) { return; }
+  QTHREAD_TRYLOCK_LOCK(&q->steal_lock);
+  if (q->steal_tail) {
+    atomic_store_explicit(&q->steal_tail->next, first, memory_order_relaxed);
+  } else {
+    q->steal_head = first;
+  }
+  q->steal_tail = last;
+  atomic_fetch_add_explicit(&q->steal_len, count, memory_order_release);
+  QTHREAD_TRYLOCK_UNLOCK(&q->steal_lock);
+  q->steal_window = count;
+#ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+  qt_threadqueue_wake_thief(q);
+#endif /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
+} /*}}}*/
+
+/* Take half of a victim's steal buffer (rounded up): the first task is
+ * returned, the rest go on the thief's private list. */
+static qt_threadqueue_node_t *qt_threadqueue_steal_from(
+  qt_threadqueue_t *thief, qt_threadqueue_t *victim) { /*{{{*/
+  qt_threadqueue_node_t *first, *last;
+  saligned_t n;
+
+  if (!QTHREAD_TRYLOCK_TRY(&victim->steal_lock)) { return NULL; }
+  n = (atomic_load_explicit(&victim->steal_len, memory_order_relaxed) + 1) / 2;
+  if (n == 0) {
+    QTHREAD_TRYLOCK_UNLOCK(&victim->steal_lock);
+    return NULL;
+  }
+  first = last = victim->steal_head;
+  for (saligned_t i = 1; i < n; ++i) {
+    last = atomic_load_explicit(&last->next, memory_order_relaxed);
+  }
+  victim->steal_head = atomic_load_explicit(&last->next, memory_order_relaxed);
+  if (victim->steal_head == NULL) { victim->steal_tail = NULL; }
+  atomic_fetch_sub_explicit(&victim->steal_len, n, memory_order_relaxed);
+  QTHREAD_TRYLOCK_UNLOCK(&victim->steal_lock);
+
+  (void)qthread_incr(&victim->advisory_queuelen, -n);
+  (void)qthread_incr(&thief->advisory_queuelen, n);
+  atomic_store_explicit(&last->next, NULL, memory_order_relaxed);
+  assert(thief->local == NULL);
+  thief->local = atomic_load_explicit(&first->next, memory_order_relaxed);
+  atomic_store_explicit(&first->next, NULL, memory_order_relaxed);
+  return first;
+} /*}}}*/
+
+/* Try the other shepherds, nearest first */
+static qt_threadqueue_node_t *qt_threadqueue_steal(qt_threadqueue_t *q) { /*{{{*/
+  qthread_shepherd_t *const me = qthread_internal_getshep();
+  qthread_shepherd_id_t *sorted_sheplist;
+
+  if ((me == NULL) || ((sorted_sheplist = me->sorted_sheplist) == NULL)) {
+    return NULL;
+  }
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds - 1; s++) {
+    qt_threadqueue_t *victim = qlib->shepherds[sorted_sheplist[s]].ready;
+
+    if (atomic_load_explicit(&victim->steal_len, memory_order_relaxed) > 0) {
+      qt_threadqueue_node_t *node = qt_threadqueue_steal_from(q, victim);
+
+      if (node) { return node; }
+    }
+  }
+  return NULL;
+} /*}}}*/
+
+static void qt_threadqueue_free_list(qt_threadqueue_node_t *node) { /*{{{*/
+  while (node) {
+    qt_threadqueue_node_t *next =
+      atomic_load_explicit(&node->next, memory_order_relaxed);
+
+    qthread_thread_free(node->thread);
+    FREE_TQNODE(node);
+    node = next;
+  }
+} /*}}}*/
+
 void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q) { /*{{{ */
   assert(q);
+  qt_threadqueue_free_list(q->local);
+  qt_threadqueue_free_list(q->steal_head);
   while (1) {
     qt_threadqueue_node_t *node = qt_internal_NEMESIS_dequeue_st(&q->q);
     if (node) {
@@ -193,9 +408,9 @@ void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q) { /*{{{ */
   FREE_THREADQUEUE(q);
 } /*}}} */
 
-void INTERNAL qthread_steal_enable(void) {}
+void INTERNAL qthread_steal_enable(void) { /*{{{*/ steal_disable = 0; } /*}}}*/
 
-void INTERNAL qthread_steal_disable(void) {}
+void INTERNAL qthread_steal_disable(void) { /*{{{*/ steal_disable = 1; } /*}}}*/
 
 #ifdef QTHREAD_PARANOIA
 static void sanity_check_tq(NEMESIS_queue *q) { /*{{{*/
@@ -255,7 +470,7 @@ qt_threadqueue_choose_dest(qthread_shepherd_t *curr_shep) {
 
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict t) { /*{{{ */
-  qt_threadqueue_node_t *node, *prev;
+  qt_threadqueue_node_t *node;
 
   assert(q);
   assert(t);
@@ -267,13 +482,7 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
   node->thread = t;
   atomic_store_explicit(&node->next, NULL, memory_order_release);
 
-  prev = qt_internal_atomic_swap_ptr((void **)&(q->q.tail), node);
-
-  if (prev == NULL) {
-    atomic_store_explicit(&q->q.head, node, memory_order_relaxed);
-  } else {
-    atomic_store_explicit(&prev->next, node, memory_order_relaxed);
-  }
+  qt_internal_NEMESIS_enqueue(&q->q, node);
   PARANOIA(sanity_check_tq(&q->q));
   (void)qthread_incr(&(q->advisory_queuelen), 1);
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
@@ -292,6 +501,52 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
 #endif /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
 } /*}}} */
 
+/* link the whole batch first, so that it takes a single swap of the tail */
+void INTERNAL qt_threadqueue_enqueue_bulk(qt_threadqueue_t *restrict q,
+                                          qthread_t **restrict t,
+                                          size_t n) { /*{{{ */
+  qt_threadqueue_node_t *first = NULL, *last = NULL, *prev;
+
+  assert(q);
+  if (n == 0) { return; }
+
+  PARANOIA(sanity_check_tq(&q->q));
+  for (size_t i = 0; i < n; ++i) {
+    qt_threadqueue_node_t *node = ALLOC_TQNODE();
+    assert(node != NULL);
+    node->thread = t[i];
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    if (last) {
+      atomic_store_explicit(&last->next, node, memory_order_relaxed);
+    } else {
+      first = node;
+    }
+    last = node;
+  }
+  atomic_thread_fence(memory_order_release);
+
+  prev = qt_internal_atomic_swap_ptr((void **)&(q->q.tail), last);
+
+  if (prev == NULL) {
+    atomic_store_explicit(&q->q.head, first, memory_order_relaxed);
+  } else {
+    atomic_store_explicit(&prev->next, first, memory_order_relaxed);
+  }
+  PARANOIA(sanity_check_tq(&q->q));
+  (void)qthread_incr(&(q->advisory_queuelen), n);
+#ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+  MACHINE_FENCE;
+  if (q->frustration) {
+    QTHREAD_COND_LOCK(q->trigger);
+    if (q->frustration) {
+      q->frustration = 0;
+      QTHREAD_COND_SIGNAL(q->trigger);
+    }
+    QTHREAD_COND_UNLOCK(q->trigger);
+  }
+#endif /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
+} /*}}} */
+
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict t) { /*{{{ */
   qt_threadqueue_enqueue(q, t);
@@ -306,28 +561,48 @@ qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q) { /*{{{ */
 qthread_t INTERNAL *
 qt_scheduler_get_thread(qt_threadqueue_t *q,
                         qt_threadqueue_private_t *Q_UNUSED(qc),
-                        uint_fast8_t Q_UNUSED(active)) { /*{{{ */
+                        uint_fast8_t active) { /*{{{ */
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
   int i;
 #endif /* QTHREAD_CONDWAIT_BLOCKING_QUEUE */
-  PARANOIA(sanity_check_tq(&q->q));
-  qt_threadqueue_node_t *node = qt_internal_NEMESIS_dequeue(&q->q);
+  qt_threadqueue_node_t *node;
   qthread_t *retval;
 
+  PARANOIA(sanity_check_tq(&q->q));
+  if (QTHREAD_UNLIKELY(
+        atomic_load_explicit(&q->steal_len, memory_order_relaxed) > 0) &&
+      (--q->steal_window <= 0)) {
+    qt_threadqueue_reclaim(q);
+  }
+  node = q->local ? qt_threadqueue_local_pop(q)
+                  : qt_internal_NEMESIS_dequeue(&q->q);
+  if ((node == NULL) &&
+      (atomic_load_explicit(&q->steal_len, memory_order_relaxed) > 0)) {
+    qt_threadqueue_reclaim(q);
+    node = qt_threadqueue_local_pop(q);
+  }
+
   PARANOIA(sanity_check_tq(&q->q));
   if (node == NULL) {
+    int const thief = active && !steal_disable && (qlib->nshepherds > 1);
+
+    if (thief) {
+      atomic_fetch_add_explicit(&nemesis_idle, 1, memory_order_relaxed);
+    }
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
     i = num_spins_before_condwait;
     while (q->q.shadow_head == NULL &&
            atomic_load_explicit(&q->q.head, memory_order_relaxed) == NULL &&
            i > 0) {
+      if (thief && ((node = qt_threadqueue_steal(q)) != NULL)) { break; }
       SPINLOCK_BODY();
       i--;
     }
 #endif /* QTHREAD_CONDWAIT_BLOCKING_QUEUE */
 
-    while (q->q.shadow_head == NULL &&
+    while (node == NULL && q->q.shadow_head == NULL &&
            atomic_load_explicit(&q->q.head, memory_order_relaxed) == NULL) {
+      if (thief && ((node = qt_threadqueue_steal(q)) != NULL)) { break; }
 #ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
       SPINLOCK_BODY();
 #else
@@ -338,10 +613,40 @@ qt_scheduler_get_thread(qt_threadqueue_t *q,
       }
 #endif /* ifdef USE_HARD_POLLING */
     }
-    node = qt_internal_NEMESIS_dequeue(&q->q);
+    if (thief) {
+      atomic_fetch_sub_explicit(&nemesis_idle, 1, memory_order_relaxed);
+    }
+    if (node == NULL) { node = qt_internal_NEMESIS_dequeue(&q->q); }
+  } else if (QTHREAD_UNLIKELY(atomic_load_explicit(
+                                &q->steal_len, memory_order_relaxed) > 0) &&
+             (atomic_load_explicit(&node->thread->thread_state,
+                                   memory_order_relaxed) ==
+              QTHREAD_STATE_TERM_SHEP)) {
+    /* run what was published before shutting down */
+    qt_internal_NEMESIS_enqueue(&q->q, node);
+    qt_threadqueue_reclaim(q);
+    node = qt_threadqueue_local_pop(q);
   }
   assert(node);
   assert(atomic_load_explicit(&node->next, memory_order_relaxed) == NULL);
+  /* share the backlog with whoever is idle */
+  if (QTHREAD_UNLIKELY(
+        atomic_load_explicit(&nemesis_idle, memory_order_relaxed) > 0) &&
+      !steal_disable && (q->local == NULL) &&
+      (atomic_load_explicit(&q->steal_len, memory_order_relaxed) == 0)) {
+    saligned_t const backlog = q->advisory_queuelen - 1;
+
+    if (backlog >= 2) {
+      saligned_t n = backlog / 2;
+
+      if (steal_chunksize > 0) {
+        if (n > steal_chunksize) { n = steal_chunksize; }
+      } else if (n > NEMESIS_STEAL_MAX) {
+        n = NEMESIS_STEAL_MAX;
+      }
+      qt_threadqueue_publish(q, n);
+    }
+  }
   (void)qthread_incr(&(q->advisory_queuelen), -1);
   retval = node->thread;
   FREE_TQNODE(node);
@@ -362,7 +667,11 @@ void INTERNAL qt_threadqueue_filter(qt_threadqueue_t *q,
   tmp.shadow_head = NULL;
   tmp.nemesis_advisory_queuelen = 0;
   PARANOIA(sanity_check_tq(&q->q));
-  while ((curs = qt_internal_NEMESIS_dequeue_st(&q->q))) {
+  if (atomic_load_explicit(&q->steal_len, memory_order_relaxed) > 0) {
+    qt_threadqueue_reclaim(q);
+  }
+  while ((curs = q->local ? qt_threadqueue_local_pop(q)
+                          : qt_internal_NEMESIS_dequeue_st(&q->q))) {
     qthread_t *t = curs->thread;
     PARANOIA(sanity_check_tq(&tmp));
     PARANOIA(sanity_check_tq(&q->q));
@@ -3,20 +3,24 @@
 #endif
 
 /* System Headers */
+#include <limits.h> /* for SSIZE_MAX */
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h> /* for strcasecmp() */
 #include <sys/types.h>
 
 /* Public Headers */
 #include "qthread/cacheline.h"
 #include "qthread/qthread.h"
+#include "qthread/qtimer.h"
 
 /* Internal Headers */
 #include "qt_alloc.h"
 #include "qt_asserts.h"
 #include "qt_envariables.h"
 #include "qt_expect.h"
+#include "qt_futex.h"
 #include "qt_prefetch.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_qthread_struct.h"
@@ -44,14 +48,99 @@ struct _qt_threadqueue {
                            * moved - 4/1/11 AKP
                            */
   QTHREAD_TRYLOCK_TYPE qlock;
+  /* idle workers park on park_seq; see qt_threadqueue_park() */
+  _Atomic uint32_t park_seq;
+  _Atomic uint32_t nparked;
+  qthread_shepherd_t *_Atomic shepherd; /* set by the first dequeuer */
+  /* Tasks spawned with a priority above 0 wait in FIFO lanes (lane p-1 holds
+   * priority p) that are served, highest first, before the list above. They
+   * are included in qlength and qlength_stealable. */
+  qt_threadqueue_node_t *prio_head[QTHREAD_NUM_PRIORITIES - 1];
+  qt_threadqueue_node_t *prio_tail[QTHREAD_NUM_PRIORITIES - 1];
+  long prio_qlength;
+  unsigned long prio_served; /* for QT_PRIORITY_AGING */
 } /* qt_threadqueue_t */;
 
+#define QT_PRIO_LANES (QTHREAD_NUM_PRIORITIES - 1)
+
 static aligned_t steal_disable = 0;
 static long steal_chunksize = 0;
+static long park_spincount = 0;
+static _Atomic long nparked_total = 0;
+static unsigned long prio_aging = 0;
+
+/* Victim selection for qthread_steal(). STEAL_SORTED walks the sorted_sheplist
+ * in order, exactly as it always has. The other two policies split that list
+ * into distance levels (runs of equal shep_dists: on hwloc, SMT siblings, then
+ * shared cache, then package/NUMA, then remote) and visit the victims of each
+ * level in a fresh random order on every pass, so that thieves on neighboring
+ * shepherds do not all hammer the same victim. STEAL_RANDOM uses a single
+ * level containing everyone. */
+enum qt_steal_policy {
+  STEAL_SORTED = 0,
+  STEAL_HIERARCHICAL,
+  STEAL_RANDOM
+};
+
+typedef struct {
+  qthread_shepherd_id_t *order; /* the victims for the current pass */
+  size_t order_len;
+  size_t *level_ends; /* exclusive end of each level in sorted_sheplist */
+  size_t nlevels;
+  uint32_t seed;
+} qt_steal_victims_t;
+
+static qt_steal_victims_t *steal_victims = NULL; /* NULL with STEAL_SORTED */
+
+/* Placement of NO_SHEPHERD spawns (QT_PLACEMENT_CHOICES). With k > 1, a spawn
+ * compares the spawner's own queue against k-1 shepherds sampled from the
+ * nearer half of its sorted_sheplist and goes to the shortest, staying home on
+ * ties; a spawn from outside the library samples k shepherds from everywhere.
+ * Queue lengths are read without the lock, so this is only a hint, but it
+ * keeps a burst of spawns on one shepherd from piling up there while everyone
+ * else waits to steal it. */
+static unsigned long placement_choices = 1;
+static TLS_DECL_INIT(uint32_t, placement_seed);
+
+/* Adaptive steal chunks (QT_STEAL_ADAPTIVE). Each thief shepherd keeps a
+ * chunk size and hit/miss counts for every victim, plus a running estimate of
+ * what a successful steal costs. When the thief comes back for more work, the
+ * time it took to drain the previous batch is compared against that cost: a
+ * batch that went by in a few steal-times was too small (fine-grained tasks,
+ * steal overhead dominates) and the chunk for that victim doubles; a batch
+ * that lasted hundreds of steal-times was bigger than needed (coarse tasks,
+ * better left for other thieves) and the chunk halves. Victims that miss more
+ * often than they hit are contended and also get smaller chunks. The chunk
+ * always stays within [QT_STEAL_CHUNK_MIN, QT_STEAL_CHUNK_MAX] and never
+ * exceeds half of what the victim has. All of this is only touched by the
+ * holder of the shepherd's stealing flag, so it needs no locking. */
+#define STEAL_DRAIN_GROW 16    /* drain < this many steal-times: grow */
+#define STEAL_DRAIN_SHRINK 256 /* drain > this many steal-times: shrink */
+#define STEAL_MISS_WINDOW 16   /* attempts between contention checks */
+
+typedef struct {
+  long chunk;
+  unsigned long hits;
+  unsigned long misses;
+} qt_victim_stats_t;
+
+typedef struct {
+  qt_victim_stats_t *victims; /* indexed by victim shepherd id */
+  double cost;                /* running average of a successful steal */
+  double last_time;           /* when the last batch arrived */
+  long last_amt;              /* size of that batch; 0 once accounted */
+  qthread_shepherd_id_t last_victim;
+} qt_steal_adapt_t;
+
+static qt_steal_adapt_t *steal_adapt = NULL; /* NULL unless adaptive */
+static long steal_chunk_min = 1;
+static long steal_chunk_max = 128;
 
 // Forward declarations
 qt_threadqueue_node_t INTERNAL *
-qt_threadqueue_dequeue_steal(qt_threadqueue_t *h, qt_threadqueue_t *v);
+qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
+                             qt_threadqueue_t *v,
+                             long desired_stolen);
 
 void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t *q,
                                               qt_threadqueue_node_t *first);
@@ -121,6 +210,7 @@ static inline void sanity_check_queue(qt_threadqueue_t *q) {
   size_t count_stealable = 0, count_total = 0;
 
   assert((q->head == NULL) || q->qlength);
+  assert(q->prio_qlength <= q->qlength);
   assert(q->qlength_stealable <= q->qlength);
   assert((q->head && q->tail) || (!q->head && !q->tail));
 
@@ -129,6 +219,12 @@ static inline void sanity_check_queue(qt_threadqueue_t *q) {
     count_stealable += cursor->stealable;
     cursor = cursor->next;
   }
+  for (int lane = 0; lane < QTHREAD_NUM_PRIORITIES - 1; ++lane) {
+    for (cursor = q->prio_head[lane]; cursor; cursor = cursor->next) {
+      count_total++;
+      count_stealable += cursor->stealable;
+    }
+  }
   assert(count_total == q->qlength);
   assert(count_stealable == q->qlength_stealable);
 }
@@ -151,7 +247,169 @@ static inline qt_threadqueue_node_t *ALLOC_TQNODE(void) { /*{{{ */
 
 #define FREE_TQNODE(t) qt_mpool_free(generic_threadqueue_pools.nodes, t)
 
+static void qt_steal_victims_init(enum qt_steal_policy policy) { /*{{{*/
+  qthread_shepherd_id_t const nshepherds = qlib->nshepherds;
+
+  if ((policy == STEAL_SORTED) || (nshepherds < 2)) { return; }
+  steal_victims = qt_calloc(nshepherds, sizeof(qt_steal_victims_t));
+  assert(steal_victims);
+  for (qthread_shepherd_id_t s = 0; s < nshepherds; ++s) {
+    qthread_shepherd_t *const shep = &qlib->shepherds[s];
+    qt_steal_victims_t *const v = &steal_victims[s];
+    qthread_shepherd_id_t const *const sorted = shep->sorted_sheplist;
+    size_t level0 = nshepherds - 1;
+
+    v->level_ends = qt_malloc(sizeof(size_t) * (nshepherds - 1));
+    assert(v->level_ends);
+    v->nlevels = 0;
+    for (size_t i = 1; i < nshepherds - 1; ++i) {
+      if ((policy == STEAL_HIERARCHICAL) &&
+          (shep->shep_dists[sorted[i]] != shep->shep_dists[sorted[i - 1]])) {
+        v->level_ends[v->nlevels++] = i;
+      }
+    }
+    v->level_ends[v->nlevels++] = nshepherds - 1;
+    if (v->nlevels > 1) { level0 = v->level_ends[0]; }
+    /* the innermost level is probed twice per pass when there is anything
+     * further out, since those steals are the cheapest */
+    v->order = qt_malloc(sizeof(qthread_shepherd_id_t) *
+                         (nshepherds - 1 + ((v->nlevels > 1) ? level0 : 0)));
+    assert(v->order);
+    v->order_len = 0;
+    v->seed = (uint32_t)(s + 1) * 2654435761u;
+    if (v->seed == 0) { v->seed = 1; }
+  }
+} /*}}}*/
+
+static void qt_steal_victims_free(void) { /*{{{*/
+  if (steal_victims == NULL) { return; }
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; ++s) {
+    qt_free(steal_victims[s].order);
+    qt_free(steal_victims[s].level_ends);
+  }
+  qt_free(steal_victims);
+  steal_victims = NULL;
+} /*}}}*/
+
+/* Lay out the victims for one pass of qthread_steal(): each level in turn,
+ * shuffled. Only the thread holding the shepherd's stealing flag calls this,
+ * so the per-shepherd order and seed need no synchronization. */
+static void qt_steal_victims_shuffle(qt_steal_victims_t *v,
+                                     qthread_shepherd_id_t const *sorted) { /*{{{*/
+  size_t k = 0;
+
+  for (size_t l = 0; l < v->nlevels; ++l) {
+    size_t const start = l ? v->level_ends[l - 1] : 0;
+    size_t const len = v->level_ends[l] - start;
+    int const passes = ((l == 0) && (v->nlevels > 1)) ? 2 : 1;
+
+    for (int p = 0; p < passes; ++p) {
+      qthread_shepherd_id_t *const seg = v->order + k;
+      for (size_t i = 0; i < len; ++i) { seg[i] = sorted[start + i]; }
+      for (size_t i = len; i > 1; --i) {
+        /* xorshift32 */
+        uint32_t x = v->seed;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        v->seed = x;
+
+        size_t const j = x % i;
+        qthread_shepherd_id_t const tmp = seg[i - 1];
+        seg[i - 1] = seg[j];
+        seg[j] = tmp;
+      }
+      k += len;
+    }
+  }
+  v->order_len = k;
+} /*}}}*/
+
+static void qt_steal_adapt_init(void) { /*{{{*/
+  qthread_shepherd_id_t const nshepherds = qlib->nshepherds;
+  long initial;
+
+  steal_chunk_min = qt_internal_get_env_num("STEAL_CHUNK_MIN", 1, 1);
+  steal_chunk_max = qt_internal_get_env_num("STEAL_CHUNK_MAX", 128, 1);
+  if (steal_chunk_max < steal_chunk_min) { steal_chunk_max = steal_chunk_min; }
+  initial = steal_chunksize ? steal_chunksize : 8;
+  if (initial < steal_chunk_min) { initial = steal_chunk_min; }
+  if (initial > steal_chunk_max) { initial = steal_chunk_max; }
+
+  if (nshepherds < 2) { return; }
+  steal_adapt = qt_calloc(nshepherds, sizeof(qt_steal_adapt_t));
+  assert(steal_adapt);
+  for (qthread_shepherd_id_t s = 0; s < nshepherds; ++s) {
+    steal_adapt[s].victims = qt_calloc(nshepherds, sizeof(qt_victim_stats_t));
+    assert(steal_adapt[s].victims);
+    for (qthread_shepherd_id_t v = 0; v < nshepherds; ++v) {
+      steal_adapt[s].victims[v].chunk = initial;
+    }
+  }
+} /*}}}*/
+
+static void qt_steal_adapt_free(void) { /*{{{*/
+  if (steal_adapt == NULL) { return; }
+  for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; ++s) {
+    qt_free(steal_adapt[s].victims);
+  }
+  qt_free(steal_adapt);
+  steal_adapt = NULL;
+} /*}}}*/
+
+static inline void qt_steal_adapt_resize(qt_victim_stats_t *vs,
+                                         long chunk) { /*{{{*/
+  if (chunk < steal_chunk_min) { chunk = steal_chunk_min; }
+  if (chunk > steal_chunk_max) { chunk = steal_chunk_max; }
+  vs->chunk = chunk;
+} /*}}}*/
+
+/* Called on entry to a steal: the shepherd's queue ran dry, so whatever was
+ * stolen last time has been drained. */
+static inline void qt_steal_adapt_drained(qt_steal_adapt_t *a,
+                                          double now) { /*{{{*/
+  if (a->last_amt == 0) { return; }
+
+  qt_victim_stats_t *const vs = &a->victims[a->last_victim];
+  double const drain = now - a->last_time;
+
+  if (drain < STEAL_DRAIN_GROW * a->cost) {
+    qt_steal_adapt_resize(vs, vs->chunk * 2);
+  } else if (drain > STEAL_DRAIN_SHRINK * a->cost) {
+    qt_steal_adapt_resize(vs, vs->chunk / 2);
+  }
+  a->last_amt = 0;
+} /*}}}*/
+
+static inline void qt_steal_adapt_result(qt_steal_adapt_t *a,
+                                         qthread_shepherd_id_t victim,
+                                         qt_threadqueue_node_t *stolen,
+                                         double start) { /*{{{*/
+  qt_victim_stats_t *const vs = &a->victims[victim];
+
+  if (stolen) {
+    double const now = qtimer_wtime();
+    long amt = 0;
+
+    for (qt_threadqueue_node_t *n = stolen; n; n = n->next) { amt++; }
+    vs->hits++;
+    a->cost = (a->cost == 0.0) ? (now - start)
+                               : (a->cost * 7 + (now - start)) / 8;
+    a->last_time = now;
+    a->last_amt = amt;
+    a->last_victim = victim;
+  } else {
+    vs->misses++;
+  }
+  if (vs->hits + vs->misses >= STEAL_MISS_WINDOW) {
+    if (vs->misses > vs->hits) { qt_steal_adapt_resize(vs, vs->chunk / 2); }
+    vs->hits = vs->misses = 0;
+  }
+} /*}}}*/
+
 static void qt_threadqueue_subsystem_shutdown(void) { /*{{{*/
+  qt_steal_adapt_free();
+  qt_steal_victims_free();
   qt_mpool_destroy(generic_threadqueue_pools.nodes);
   qt_mpool_destroy(generic_threadqueue_pools.queues);
   free_agged_tasks();
@@ -164,6 +422,24 @@ void INTERNAL qt_threadqueue_subsystem_init(void) { /*{{{*/
   generic_threadqueue_pools.nodes =
     qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), qthread_cacheline());
   steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+  if (qt_internal_get_env_bool("STEAL_ADAPTIVE", 0)) { qt_steal_adapt_init(); }
+  {
+    char const *policy = qt_internal_get_env_str("STEAL_POLICY", "sorted");
+    if (policy == NULL) {
+      /* default: walk the sorted_sheplist */
+    } else if (!strcasecmp(policy, "hierarchical")) {
+      qt_steal_victims_init(STEAL_HIERARCHICAL);
+    } else if (!strcasecmp(policy, "random")) {
+      qt_steal_victims_init(STEAL_RANDOM);
+    } else if (strcasecmp(policy, "sorted")) {
+      fprintf(stderr,
+              "unknown QT_STEAL_POLICY \"%s\"; using \"sorted\"\n",
+              policy);
+    }
+  }
+  park_spincount = qt_internal_get_env_num("CONDWAIT_BACKOFF", 2048, 0);
+  prio_aging = qt_internal_get_env_num("PRIORITY_AGING", 0, 0);
+  placement_choices = qt_internal_get_env_num("PLACEMENT_CHOICES", 1, 1);
   qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 } /*}}}*/
 
@@ -190,7 +466,7 @@ ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q) { /*{{{*/
 /*****************************************/
 
 static inline qt_threadqueue_node_t *
-qthread_steal(qthread_shepherd_t *thief_shepherd);
+qthread_steal(qthread_shepherd_t *thief_shepherd, long *idle);
 
 qt_threadqueue_t INTERNAL *qt_threadqueue_new(void) { /*{{{*/
   qt_threadqueue_t *q = ALLOC_THREADQUEUE();
@@ -201,6 +477,14 @@ qt_threadqueue_t INTERNAL *qt_threadqueue_new(void) { /*{{{*/
     q->qlength = 0;
     q->qlength_stealable = 0;
     QTHREAD_TRYLOCK_INIT(q->qlock);
+    atomic_store_explicit(&q->park_seq, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->nparked, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->shepherd, NULL, memory_order_relaxed);
+    for (int lane = 0; lane < QT_PRIO_LANES; ++lane) {
+      q->prio_head[lane] = q->prio_tail[lane] = NULL;
+    }
+    q->prio_qlength = 0;
+    q->prio_served = 0;
   }
 
   return q;
@@ -235,6 +519,14 @@ void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q) { /*{{{*/
     q->qlength_stealable = 0;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
   }
+  for (int lane = 0; lane < QT_PRIO_LANES; ++lane) {
+    while (q->prio_head[lane]) {
+      qt_threadqueue_node_t *node = q->prio_head[lane];
+      q->prio_head[lane] = node->next;
+      FREE_QTHREAD(node->value);
+      FREE_TQNODE(node);
+    }
+  }
   assert(q->head == q->tail);
   QTHREAD_TRYLOCK_DESTROY(q->qlock);
   FREE_THREADQUEUE(q);
@@ -247,10 +539,155 @@ static inline int qt_threadqueue_isstealable(qthread_t *t) { /*{{{*/
            : 0;
 } /*}}}*/
 
+/* Priority lanes; all of these must be called with the queue locked. */
+static inline void qt_prio_push(qt_threadqueue_t *q,
+                                qt_threadqueue_node_t *node) { /*{{{*/
+  int const lane = node->value->priority - 1;
+
+  assert(lane >= 0 && lane < QT_PRIO_LANES);
+  node->next = NULL;
+  node->prev = q->prio_tail[lane];
+  if (q->prio_tail[lane]) {
+    q->prio_tail[lane]->next = node;
+  } else {
+    q->prio_head[lane] = node;
+  }
+  q->prio_tail[lane] = node;
+  q->qlength++;
+  q->qlength_stealable += node->stealable;
+  q->prio_qlength++;
+} /*}}}*/
+
+static inline void qt_prio_unlink(qt_threadqueue_t *q,
+                                  qt_threadqueue_node_t *node) { /*{{{*/
+  int const lane = node->value->priority - 1;
+
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    q->prio_head[lane] = node->next;
+  }
+  if (node->next) {
+    node->next->prev = node->prev;
+  } else {
+    q->prio_tail[lane] = node->prev;
+  }
+  node->next = node->prev = NULL;
+  q->qlength--;
+  q->qlength_stealable -= node->stealable;
+  q->prio_qlength--;
+} /*}}}*/
+
+/* Returns the oldest task of the highest non-empty priority, or NULL if the
+ * caller should take from the normal list instead. With QT_PRIORITY_AGING=N,
+ * every Nth pick goes to the lowest non-empty level instead, so that a steady
+ * stream of urgent tasks cannot starve everything else. */
+static inline qt_threadqueue_node_t *
+qt_prio_pop(qt_threadqueue_t *q) { /*{{{*/
+  qt_threadqueue_node_t *node = NULL;
+
+  if (QTHREAD_LIKELY(q->prio_qlength == 0)) { return NULL; }
+  if (prio_aging && ((++q->prio_served % prio_aging) == 0)) {
+    if (q->tail) { return NULL; }
+    for (int lane = 0; lane < QT_PRIO_LANES && !node; ++lane) {
+      node = q->prio_head[lane];
+    }
+  } else {
+    for (int lane = QT_PRIO_LANES - 1; lane >= 0 && !node; --lane) {
+      node = q->prio_head[lane];
+    }
+  }
+  assert(node);
+  qt_prio_unlink(q, node);
+  return node;
+} /*}}}*/
+
+/* Idle workers spin for park_spincount passes and then sleep on their queue's
+ * park_seq. Whoever puts work on a queue reads nparked_total with the queue
+ * still locked (qt_threadqueue_parked(); a plain load, with no fence) and, if
+ * it is nonzero, wakes one worker after unlocking: on the queue's own
+ * shepherd if possible, otherwise on the nearest shepherd that can steal the
+ * work. The McCoy thread only runs on worker 0, so it wakes everybody on its
+ * queue.
+ *
+ * A parking worker raises nparked_total before it checks its queue's length,
+ * and does that check under the queue lock. So either its check comes after
+ * an enqueue and finds the task, or the enqueue's critical section comes
+ * after its raise and sees it parked. Work that lands on other queues is
+ * only found when the bounded sleep runs out. */
+static inline long qt_threadqueue_parked(void) { /*{{{*/
+  return atomic_load_explicit(&nparked_total, memory_order_relaxed);
+} /*}}}*/
+
+static inline int qt_threadqueue_unpark(qt_threadqueue_t *q,
+                                        int count) { /*{{{*/
+  if (atomic_load_explicit(&q->nparked, memory_order_relaxed) == 0) {
+    return 0;
+  }
+  atomic_fetch_add_explicit(&q->park_seq, 1, memory_order_release);
+  qt_futex_wake(&q->park_seq, count);
+  return 1;
+} /*}}}*/
+
+static void qt_threadqueue_wake(qt_threadqueue_t *q, qthread_t *t) { /*{{{*/
+  if (atomic_load_explicit(&t->flags, memory_order_relaxed) &
+      QTHREAD_REAL_MCCOY) {
+    qt_threadqueue_unpark(q, INT32_MAX);
+    return;
+  }
+  if (qt_threadqueue_unpark(q, 1) || !qt_threadqueue_isstealable(t)) {
+    return;
+  }
+
+  qthread_shepherd_t *shep =
+    atomic_load_explicit(&q->shepherd, memory_order_relaxed);
+  if (shep && shep->sorted_sheplist) {
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds - 1; i++) {
+      if (qt_threadqueue_unpark(
+            qlib->shepherds[shep->sorted_sheplist[i]].ready, 1)) {
+        return;
+      }
+    }
+  } else {
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; i++) {
+      if (qt_threadqueue_unpark(qlib->shepherds[i].ready, 1)) { return; }
+    }
+  }
+} /*}}}*/
+
+static void qt_threadqueue_park(qt_threadqueue_t *q) { /*{{{*/
+  /* bounded, like QTHREAD_COND_WAIT, so that work which appears on a remote
+   * queue while we sleep is eventually stolen */
+  struct timespec const timeout = {0, 500000000};
+  uint32_t seq = atomic_load_explicit(&q->park_seq, memory_order_acquire);
+
+  long qlength;
+
+  atomic_fetch_add_explicit(&q->nparked, 1, memory_order_seq_cst);
+  atomic_fetch_add_explicit(&nparked_total, 1, memory_order_seq_cst);
+  QTHREAD_TRYLOCK_LOCK(&q->qlock);
+  qlength = q->qlength;
+  QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  if (qlength == 0) { qt_futex_wait(&q->park_seq, seq, &timeout); }
+  atomic_fetch_sub_explicit(&nparked_total, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&q->nparked, 1, memory_order_relaxed);
+} /*}}}*/
+
+static inline void qt_threadqueue_idle(qt_threadqueue_t *q,
+                                       long *idle) { /*{{{*/
+  if (park_spincount && (++*idle > park_spincount)) {
+    qt_threadqueue_park(q);
+    *idle = 0;
+  } else {
+    SPINLOCK_BODY();
+  }
+} /*}}}*/
+
 /* enqueue at tail */
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict t) { /*{{{*/
   qt_threadqueue_node_t *node;
+  long parked;
 
   node = ALLOC_TQNODE();
   assert(node != NULL);
@@ -263,6 +700,13 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
 
   QTHREAD_TRYLOCK_LOCK(&q->qlock);
   PARANOIA_ONLY(sanity_check_queue(q));
+  if (t->priority) {
+    qt_prio_push(q, node);
+    parked = qt_threadqueue_parked();
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, t); }
+    return;
+  }
   node->next = NULL;
   node->prev = q->tail;
   q->tail = node;
@@ -273,13 +717,82 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
   }
   q->qlength++;
   q->qlength_stealable += node->stealable;
+  parked = qt_threadqueue_parked();
+  QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, t); }
+} /*}}}*/
+
+/* enqueue a batch of new tasks at tail, taking the lock once */
+void INTERNAL qt_threadqueue_enqueue_bulk(qt_threadqueue_t *restrict q,
+                                          qthread_t **restrict t,
+                                          size_t n) { /*{{{*/
+  qt_threadqueue_node_t *first = NULL, *last = NULL;
+  qt_threadqueue_node_t *prio = NULL, *prio_last = NULL;
+  long count = 0, count_stealable = 0;
+  long parked;
+
+  assert(q != NULL);
+  if (n == 0) { return; }
+
+  for (size_t i = 0; i < n; ++i) {
+    qt_threadqueue_node_t *node = ALLOC_TQNODE();
+    assert(node != NULL);
+
+    node->value = t[i];
+    node->stealable = qt_threadqueue_isstealable(t[i]);
+    node->next = NULL;
+    if (t[i]->priority) {
+      if (prio_last) {
+        prio_last->next = node;
+      } else {
+        prio = node;
+      }
+      prio_last = node;
+    } else {
+      node->prev = last;
+      if (last) {
+        last->next = node;
+      } else {
+        first = node;
+      }
+      last = node;
+      count++;
+      count_stealable += node->stealable;
+    }
+  }
+
+  QTHREAD_TRYLOCK_LOCK(&q->qlock);
+  PARANOIA_ONLY(sanity_check_queue(q));
+  if (last) {
+    first->prev = q->tail;
+    q->tail = last;
+    if (q->head == NULL) {
+      q->head = first;
+    } else {
+      first->prev->next = first;
+    }
+    q->qlength += count;
+    q->qlength_stealable += count_stealable;
+  }
+  while (prio) {
+    qt_threadqueue_node_t *next = prio->next;
+    qt_prio_push(q, prio);
+    prio = next;
+  }
+  parked = qt_threadqueue_parked();
   QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  /* one wakeup per task, until nobody is left sleeping */
+  for (size_t i = 0; parked && i < n; ++i) {
+    qt_threadqueue_wake(q, t[i]);
+    parked = qt_threadqueue_parked();
+  }
 } /*}}}*/
 
 /* yielded threads enqueue at head */
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict t) { /*{{{*/
   qt_threadqueue_node_t *node;
+  long parked;
 
   node = ALLOC_TQNODE();
   assert(node != NULL);
@@ -292,6 +805,14 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
 
   QTHREAD_TRYLOCK_LOCK(&q->qlock);
   PARANOIA_ONLY(sanity_check_queue(q));
+  if (t->priority) {
+    /* behind the other tasks of the same priority */
+    qt_prio_push(q, node);
+    parked = qt_threadqueue_parked();
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, t); }
+    return;
+  }
   node->prev = NULL;
   node->next = q->head;
   q->head = node;
@@ -302,7 +823,9 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
   }
   q->qlength++;
   if (node->stealable) { q->qlength_stealable++; }
+  parked = qt_threadqueue_parked();
   QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, t); }
 } /*}}}*/
 
 #define QTHREAD_TASK_IS_AGGREGABLE(f)                                          \
@@ -319,6 +842,7 @@ qthread_t INTERNAL *qt_init_agg_task(void) // partly a duplicate from qthread.c
   t->thread_state = QTHREAD_STATE_NEW;
   atomic_store_explicit(&t->flags, 0, memory_order_relaxed);
   t->target_shepherd = NO_SHEPHERD;
+  t->priority = 0;
   t->team = NULL;
   t->f = (qthread_f)qlib->agg_f; // changed function pointer type!!!
   t->arg = NULL;                 // set later
@@ -527,6 +1051,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
   qthread_shepherd_t *my_shepherd = qthread_internal_getshep();
   qthread_t *t;
   qthread_worker_id_t worker_id = NO_WORKER;
+  long idle = 0;
 #ifdef QTHREAD_TASK_AGGREGATION
   int curr_cost, max_t, ret_agg_task;
 #endif
@@ -535,6 +1060,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
   assert(my_shepherd);
   assert(my_shepherd->ready == q);
   assert(my_shepherd->sorted_sheplist);
+  atomic_store_explicit(&q->shepherd, my_shepherd, memory_order_relaxed);
 #ifdef QTHREAD_TASK_AGGREGATION
   t = qt_init_agg_task();
 #endif
@@ -641,11 +1167,11 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
         qc->qlength = qc->qlength_stealable = 0;
 #endif /* if 0 */
       }
-    } else if (q->head) {
+    } else if (q->head || q->prio_qlength) {
       QTHREAD_TRYLOCK_LOCK(&q->qlock);
       PARANOIA_ONLY(sanity_check_queue(q));
-      node = q->tail;
-      if (node != NULL) {
+      node = qt_prio_pop(q);
+      if ((node == NULL) && ((node = q->tail) != NULL)) {
         assert(q->head);
         assert(q->qlength > 0);
 
@@ -690,10 +1216,10 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
       if (worker_id == NO_WORKER) { worker_id = qthread_worker(NULL); }
       if ((my_shepherd->shepherd_id == 0) && (worker_id == 0)) {
         while (my_shepherd->stealing == 1)
-          SPINLOCK_BODY(); // no sense contending for the lock
+          qt_threadqueue_idle(q, &idle); // no sense contending for the lock
       } else {
         while (my_shepherd->stealing)
-          SPINLOCK_BODY(); // no sense contending for the lock
+          qt_threadqueue_idle(q, &idle); // no sense contending for the lock
       }
       continue;
     }
@@ -701,14 +1227,20 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
     if ((node == NULL) && (active)) {
       if (qlib->nshepherds > 1) {
         if (!steal_disable) {
-          node =
-            qthread_steal(my_shepherd); // TODO: same agg behavior when stealing
+          node = qthread_steal(
+            my_shepherd, &idle); // TODO: same agg behavior when stealing
         } else {
-          while (NULL == q->head) SPINLOCK_BODY();
+          while (NULL == q->head && 0 == q->prio_qlength)
+            qt_threadqueue_idle(q, &idle);
           continue;
         }
       }
     }
+    if (node == NULL) {
+      qt_threadqueue_idle(q, &idle);
+      continue;
+    }
+    idle = 0;
     if (node) {
 #ifdef QTHREAD_TASK_AGGREGATION
       qthread_thread_free(
@@ -750,31 +1282,59 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t *q,
 /* enqueue multiple (from steal) */
 void INTERNAL qt_threadqueue_enqueue_multiple(
   qt_threadqueue_t *q, qt_threadqueue_node_t *first) { /*{{{*/
-  qt_threadqueue_node_t *last;
-  size_t addCnt = 1;
+  qt_threadqueue_node_t *last = NULL;
+  qt_threadqueue_node_t *prio = NULL, *prio_last = NULL;
+  qthread_t *const wake_t = first->value;
+  size_t addCnt = 0;
+  long parked;
 
   assert(first != NULL);
   assert(q != NULL);
 
-  last = first;
-  while (last->next) {
-    last = last->next;
-    addCnt++;
+  /* stolen tasks keep their priority: pull those out for the lanes */
+  for (qt_threadqueue_node_t *node = first, *next; node; node = next) {
+    next = node->next;
+    node->next = NULL;
+    if (node->value->priority) {
+      if (prio_last) {
+        prio_last->next = node;
+      } else {
+        prio = node;
+      }
+      prio_last = node;
+    } else {
+      node->prev = last;
+      if (last) {
+        last->next = node;
+      } else {
+        first = node;
+      }
+      last = node;
+      addCnt++;
+    }
   }
 
   QTHREAD_TRYLOCK_LOCK(&q->qlock);
   PARANOIA_ONLY(sanity_check_queue(q));
-  last->next = NULL;
-  first->prev = q->tail;
-  q->tail = last;
-  if (q->head == NULL) {
-    q->head = first;
-  } else {
-    first->prev->next = first;
+  if (last) {
+    first->prev = q->tail;
+    q->tail = last;
+    if (q->head == NULL) {
+      q->head = first;
+    } else {
+      first->prev->next = first;
+    }
+    q->qlength += addCnt;
+    q->qlength_stealable += addCnt;
+  }
+  while (prio) {
+    qt_threadqueue_node_t *next = prio->next;
+    qt_prio_push(q, prio);
+    prio = next;
   }
-  q->qlength += addCnt;
-  q->qlength_stealable += addCnt;
+  parked = qt_threadqueue_parked();
   QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, wake_t); }
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -785,6 +1345,7 @@ void INTERNAL qt_threadqueue_enqueue_cache(
 
   qt_threadqueue_node_t *first = cache->on_deck;
   qt_threadqueue_node_t *last;
+  long parked;
 
   if (cache->qlength) {
     first->next = cache->head;
@@ -812,7 +1373,9 @@ void INTERNAL qt_threadqueue_enqueue_cache(
   }
   q->qlength += cache->qlength;
   q->qlength_stealable += cache->qlength_stealable;
+  parked = qt_threadqueue_parked();
   QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+  if (QTHREAD_UNLIKELY(parked)) { qt_threadqueue_wake(q, first->value); }
   cache->qlength = 0;
   cache->qlength_stealable = 0;
 } /*}}}*/
@@ -821,14 +1384,18 @@ void INTERNAL qt_threadqueue_enqueue_cache(
 /* dequeue stolen threads at head, skip yielded threads */
 qt_threadqueue_node_t INTERNAL *
 qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
-                             qt_threadqueue_t *v) { /*{{{ */
+                             qt_threadqueue_t *v,
+                             long desired_stolen) { /*{{{ */
   qt_threadqueue_node_t *node;
   qt_threadqueue_node_t *first = NULL;
   qt_threadqueue_node_t *last = NULL;
   long amtStolen = 0;
-  long desired_stolen;
 
-  if (steal_chunksize == 0) {
+  if (desired_stolen > 0) {
+    /* chosen by the caller, but never more than half of the victim */
+    long const half = v->qlength_stealable / 2;
+    if ((half > 0) && (desired_stolen > half)) { desired_stolen = half; }
+  } else if (steal_chunksize == 0) {
     desired_stolen = v->qlength_stealable / 2;
   } else {
     desired_stolen = steal_chunksize;
@@ -841,6 +1408,27 @@ qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
 
   if (!QTHREAD_TRYLOCK_TRY(&v->qlock)) { return NULL; }
   PARANOIA_ONLY(sanity_check_queue(v));
+  /* highest priority first */
+  for (int lane = QT_PRIO_LANES - 1;
+       lane >= 0 && v->prio_qlength > 0 && amtStolen < desired_stolen;
+       --lane) {
+    node = v->prio_head[lane];
+    while (node && amtStolen < desired_stolen) {
+      qt_threadqueue_node_t *next = node->next;
+      if (node->stealable) {
+        qt_prio_unlink(v, node);
+        if (first == NULL) {
+          first = node;
+        } else {
+          last->next = node;
+          node->prev = last;
+        }
+        last = node;
+        amtStolen++;
+      }
+      node = next;
+    }
+  }
   while (v->qlength_stealable > 0 && amtStolen < desired_stolen) {
     node = (qt_threadqueue_node_t *)v->head;
     do {
@@ -919,7 +1507,7 @@ qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
  *  Returns the work stolen
  */
 static inline qt_threadqueue_node_t *
-qthread_steal(qthread_shepherd_t *thief_shepherd) { /*{{{*/
+qthread_steal(qthread_shepherd_t *thief_shepherd, long *idle) { /*{{{*/
   qt_threadqueue_node_t *stolen = NULL;
 
   assert(thief_shepherd);
@@ -943,18 +1531,38 @@ qthread_steal(qthread_shepherd_t *thief_shepherd) { /*{{{*/
     }
   }
 
-  qthread_shepherd_id_t i = 0;
+  size_t i = 0;
   qthread_shepherd_t *const shepherds = qlib->shepherds;
   qthread_shepherd_id_t *const sorted_sheplist =
     thief_shepherd->sorted_sheplist;
   assert(sorted_sheplist);
+  qt_steal_victims_t *const v =
+    steal_victims ? &steal_victims[thief_shepherd->shepherd_id] : NULL;
+  qthread_shepherd_id_t const *victims = sorted_sheplist;
+  size_t nvictims = qlib->nshepherds - 1;
+
+  if (v) {
+    qt_steal_victims_shuffle(v, sorted_sheplist);
+    victims = v->order;
+    nvictims = v->order_len;
+  }
+
+  qt_steal_adapt_t *const a =
+    steal_adapt ? &steal_adapt[thief_shepherd->shepherd_id] : NULL;
+
+  if (a) { qt_steal_adapt_drained(a, qtimer_wtime()); }
 
   qt_threadqueue_t *myqueue = thief_shepherd->ready;
 
   while (stolen == NULL) {
-    qt_threadqueue_t *victim_queue = shepherds[sorted_sheplist[i]].ready;
+    qt_threadqueue_t *victim_queue = shepherds[victims[i]].ready;
     if (0 != victim_queue->qlength_stealable) {
-      stolen = qt_threadqueue_dequeue_steal(myqueue, victim_queue);
+      /* only the steal itself counts as its cost, not the idle passes */
+      double const start = a ? qtimer_wtime() : 0.0;
+
+      stolen = qt_threadqueue_dequeue_steal(
+        myqueue, victim_queue, a ? a->victims[victims[i]].chunk : 0);
+      if (a) { qt_steal_adapt_result(a, victims[i], stolen, start); }
       if (stolen) {
         qt_threadqueue_node_t *surplus = stolen->next;
         if (surplus) {
@@ -972,8 +1580,12 @@ qthread_steal(qthread_shepherd_t *thief_shepherd) { /*{{{*/
     }
 
     i++;
-    i *= (i < qlib->nshepherds - 1);
+    i *= (i < nvictims);
     if (i == 0) {
+      if (park_spincount && (++*idle > park_spincount)) {
+        break; // give up and let the caller park
+      }
+      if (v) { qt_steal_victims_shuffle(v, sorted_sheplist); }
 #ifdef HAVE_PTHREAD_YIELD
       pthread_yield();
 #elif defined(HAVE_SCHED_YIELD)
@@ -1109,6 +1721,32 @@ fixup_on_deck:
 } /*}}}*/
 #endif /* ifdef QTHREAD_USE_SPAWNCACHE */
 
+/* filter the priority lanes, in dequeue order; returns 1 if told to stop */
+static int qt_prio_filter(qt_threadqueue_t *q,
+                          qt_threadqueue_filter_f f) { /*{{{*/
+  for (int lane = QT_PRIO_LANES - 1; lane >= 0 && q->prio_qlength > 0;
+       --lane) {
+    qt_threadqueue_node_t *node = q->prio_head[lane];
+    while (node) {
+      qt_threadqueue_node_t *next = node->next;
+      switch (f(node->value)) {
+        case IGNORE_AND_CONTINUE: break;
+        case IGNORE_AND_STOP: return 1;
+        case REMOVE_AND_CONTINUE:
+          qt_prio_unlink(q, node);
+          FREE_TQNODE(node);
+          break;
+        case REMOVE_AND_STOP:
+          qt_prio_unlink(q, node);
+          FREE_TQNODE(node);
+          return 1;
+      }
+      node = next;
+    }
+  }
+  return 0;
+} /*}}}*/
+
 /* walk queue removing all tasks matching this description */
 void INTERNAL qt_threadqueue_filter(qt_threadqueue_t *q,
                                     qt_threadqueue_filter_f f) { /*{{{*/
@@ -1124,6 +1762,10 @@ void INTERNAL qt_threadqueue_filter(qt_threadqueue_t *q,
 
   QTHREAD_TRYLOCK_LOCK(&q->qlock);
   PARANOIA_ONLY(sanity_check_queue(q));
+  if (qt_prio_filter(q, f)) {
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    return;
+  }
   if (q->qlength > 0) {
     qt_threadqueue_node_t **lp = NULL;
     qt_threadqueue_node_t **rp = NULL;
@@ -1196,7 +1838,17 @@ qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
 
   QTHREAD_TRYLOCK_LOCK(&q->qlock);
   PARANOIA_ONLY(sanity_check_queue(q));
-  if (q->qlength > 0) {
+  /* prioritized tasks are already ahead of the normal list; leave them be */
+  for (int lane = QT_PRIO_LANES - 1; lane >= 0 && q->prio_qlength > 0;
+       --lane) {
+    for (node = q->prio_head[lane]; node; node = node->next) {
+      if (node->value->ret == value) {
+        QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+        return node->value;
+      }
+    }
+  }
+  if (q->qlength > q->prio_qlength) {
     node = (qt_threadqueue_node_t *)q->tail;
     t = (node) ? (qthread_t *)node->value : NULL;
     while ((t != NULL) && (t->ret != value)) {
@@ -1227,8 +1879,72 @@ void INTERNAL qthread_steal_enable(void) { /*{{{*/ steal_disable = 0; } /*}}}*/
 
 void INTERNAL qthread_steal_disable(void) { /*{{{*/ steal_disable = 1; } /*}}}*/
 
+static inline uint32_t qt_placement_rand(void) { /*{{{*/
+  uint32_t x = TLS_GET(placement_seed);
+
+  if (x == 0) {
+    /* every thread has its own copy, at its own address */
+    x = (uint32_t)(uintptr_t)&placement_seed * 2654435761u;
+    if (x == 0) { x = 1; }
+  }
+  /* xorshift32 */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  TLS_SET(placement_seed, x);
+  return x;
+} /*}}}*/
+
+static qthread_shepherd_id_t
+qt_placement_choose(qthread_shepherd_t *curr_shep) { /*{{{*/
+  qthread_shepherd_t *const sheps = qlib->shepherds;
+  qthread_shepherd_id_t const nsheps = qlib->nshepherds;
+  qthread_shepherd_id_t best;
+  ssize_t best_len;
+  unsigned long samples = placement_choices;
+
+  if (curr_shep) {
+    best = curr_shep->shepherd_id;
+    best_len = qt_threadqueue_advisory_queuelen(curr_shep->ready);
+    samples--;
+  } else {
+    best = (qthread_shepherd_id_t)(qt_placement_rand() % nsheps);
+    best_len = qt_threadqueue_advisory_queuelen(sheps[best].ready);
+    if (!atomic_load_explicit(&sheps[best].active, memory_order_relaxed)) {
+      best_len = SSIZE_MAX;
+    }
+    samples--;
+  }
+  if (best_len == 0) { return best; }
+  for (unsigned long i = 0; i < samples; ++i) {
+    qthread_shepherd_id_t cand;
+    ssize_t len;
+
+    if (curr_shep) {
+      /* the nearer half of the other shepherds */
+      size_t const span = nsheps / 2;
+      cand = curr_shep->sorted_sheplist[qt_placement_rand() % span];
+    } else {
+      cand = (qthread_shepherd_id_t)(qt_placement_rand() % nsheps);
+    }
+    if (!atomic_load_explicit(&sheps[cand].active, memory_order_relaxed)) {
+      continue;
+    }
+    len = qt_threadqueue_advisory_queuelen(sheps[cand].ready);
+    if (len < best_len) {
+      best = cand;
+      best_len = len;
+      if (len == 0) { break; }
+    }
+  }
+  return best;
+} /*}}}*/
+
 qthread_shepherd_id_t INTERNAL
 qt_threadqueue_choose_dest(qthread_shepherd_t *curr_shep) {
+  if ((placement_choices > 1) && (qlib->nshepherds > 1)) {
+    return qt_placement_choose(curr_shep);
+  }
   if (curr_shep) {
     return curr_shep->shepherd_id;
   } else {
@@ -0,0 +1,476 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* The API */
+#include "qthread/qthread.h"
+
+/* System Headers */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h> /* for sched_yield() */
+#include <stdint.h>
+#include <stdio.h>    /* for fprintf() */
+#include <sys/time.h> /* for gettimeofday() */
+#include <time.h>     /* for nanosleep() */
+
+/* Public Headers */
+#include "qthread/qtimer.h"
+
+/* Internal Headers */
+#include "qt_alloc.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_blocking_structs.h"
+#include "qt_envariables.h"
+#include "qt_feb.h" /* for qt_multiwait_block() */
+#include "qt_qthread_mgmt.h"   /* for qthread_internal_self() */
+#include "qt_qthread_struct.h" /* to pass data back to worker */
+#include "qt_shepherd_innards.h"
+#include "qt_subsystems.h" /* for qthread_internal_cleanup() */
+#include "qt_threadqueues.h"
+#include "qt_threadstate.h"
+#include "qt_timers.h"
+#include "qt_visibility.h"
+
+/* The wheel has QT_TIMER_LEVELS levels of QT_TIMER_SLOTS slots; a slot of
+ * level l covers 64^l ticks. A timer goes in the lowest level that reaches
+ * its expiry, and moves down a level (is "cascaded") when the level below
+ * wraps around. Timers further out than the whole wheel wait in the top
+ * level and are filed again each time it comes around. */
+#define QT_TIMER_LEVELS 4
+#define QT_TIMER_SLOT_BITS 6
+#define QT_TIMER_SLOTS (1u << QT_TIMER_SLOT_BITS)
+#define QT_TIMER_SLOT_MASK ((uint64_t)QT_TIMER_SLOTS - 1)
+#define QT_TIMER_RANGE ((uint64_t)1 << (QT_TIMER_LEVELS * QT_TIMER_SLOT_BITS))
+
+enum qt_timer_kind {
+  QT_TIMER_SLEEP,
+  QT_TIMER_ONESHOT,
+  QT_TIMER_PERIODIC,
+  QT_TIMER_EXPIRE /* a timed FEB or syncvar wait; see qt_timer_block() */
+};
+
+struct qthread_timer_s {
+  struct qthread_timer_s *next;
+  struct qthread_timer_s **pprev; /* NULL when not on the wheel */
+  uint64_t expires;               /* tick */
+  uint64_t period;                /* ticks */
+  qthread_f f;
+  void *arg;
+  qthread_t *task; /* the sleeper */
+  uint8_t kind;
+  uint8_t cancelled;    /* while being fired */
+  _Atomic uint8_t done; /* an expiry, once it has been fired */
+};
+
+_Atomic uint64_t qt_timer_wake = UINT64_MAX;
+
+static struct qthread_timer_s *timer_wheel[QT_TIMER_LEVELS][QT_TIMER_SLOTS];
+static uint64_t timer_current = 0; /* the next tick to process */
+static size_t timer_count = 0;     /* timers on the wheel */
+static uint64_t timer_tick_ns = 1000000;
+static double timer_base = 0.0;
+static int timer_stopped = 0;
+
+static pthread_t timer_thread;
+static int timer_thread_running = 0;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond = PTHREAD_COND_INITIALIZER;
+
+static inline uint64_t qt_timer_now_ns(void) { /*{{{*/
+  return (uint64_t)((qtimer_wtime() - timer_base) * 1e9);
+} /*}}}*/
+
+/* The first tick at least nsecs from now */
+static inline uint64_t qt_timer_deadline(uint64_t nsecs) { /*{{{*/
+  if (nsecs > (UINT64_MAX >> 2)) { nsecs = UINT64_MAX >> 2; }
+  return (qt_timer_now_ns() + nsecs + timer_tick_ns - 1) / timer_tick_ns;
+} /*}}}*/
+
+/* The timer lock must be held by all of the following. */
+static void qt_timer_link(struct qthread_timer_s *t) { /*{{{*/
+  uint64_t expires = (t->expires < timer_current) ? timer_current : t->expires;
+  uint64_t delta = expires - timer_current;
+  unsigned int level = 0;
+  struct qthread_timer_s **slot;
+
+  if (delta >= QT_TIMER_RANGE) {
+    delta = QT_TIMER_RANGE - 1;
+    expires = timer_current + delta;
+  }
+  while (level < QT_TIMER_LEVELS - 1 &&
+         delta >= ((uint64_t)1 << ((level + 1) * QT_TIMER_SLOT_BITS))) {
+    level++;
+  }
+  slot = &timer_wheel[level][(expires >> (level * QT_TIMER_SLOT_BITS)) &
+                             QT_TIMER_SLOT_MASK];
+  t->next = *slot;
+  if (t->next) { t->next->pprev = &t->next; }
+  t->pprev = slot;
+  *slot = t;
+} /*}}}*/
+
+static void qt_timer_unlink(struct qthread_timer_s *t) { /*{{{*/
+  *t->pprev = t->next;
+  if (t->next) { t->next->pprev = t->pprev; }
+  t->pprev = NULL;
+} /*}}}*/
+
+static void qt_timer_add(struct qthread_timer_s *t) { /*{{{*/
+  uint64_t const due = (t->expires < timer_current) ? timer_current : t->expires;
+
+  qt_timer_link(t);
+  timer_count++;
+  if (due < atomic_load_explicit(&qt_timer_wake, memory_order_relaxed)) {
+    atomic_store_explicit(&qt_timer_wake, due, memory_order_relaxed);
+    pthread_cond_signal(&timer_cond);
+  }
+} /*}}}*/
+
+/* The timer thread only exists once something has used a timer */
+static void *qt_timer_thread_func(void *arg);
+
+static void qt_timer_start_thread(void) { /*{{{*/
+  int r;
+
+  if (timer_thread_running || timer_stopped) { return; }
+  r = pthread_create(&timer_thread, NULL, qt_timer_thread_func, NULL);
+  if (r != 0) {
+    fprintf(stderr, "qt_timer_start_thread: pthread_create() failed (%d)\n", r);
+  } else {
+    timer_thread_running = 1;
+  }
+} /*}}}*/
+
+/* Process every tick up to and including now, and return the timers that
+ * came due, linked through their next pointers. */
+static struct qthread_timer_s *qt_timer_advance(uint64_t now) { /*{{{*/
+  struct qthread_timer_s *due = NULL;
+  struct qthread_timer_s **tail = &due;
+
+  while (timer_current <= now && timer_count > 0) {
+    unsigned int const idx = timer_current & QT_TIMER_SLOT_MASK;
+    struct qthread_timer_s *t;
+
+    if (idx == 0) {
+      for (unsigned int l = 1; l < QT_TIMER_LEVELS; ++l) {
+        unsigned int const i =
+          (timer_current >> (l * QT_TIMER_SLOT_BITS)) & QT_TIMER_SLOT_MASK;
+
+        t = timer_wheel[l][i];
+        timer_wheel[l][i] = NULL;
+        while (t) {
+          struct qthread_timer_s *const next = t->next;
+
+          qt_timer_link(t);
+          t = next;
+        }
+        if (i != 0) { break; }
+      }
+    }
+    t = timer_wheel[0][idx];
+    timer_wheel[0][idx] = NULL;
+    while (t) {
+      t->pprev = NULL;
+      *tail = t;
+      tail = &t->next;
+      t = t->next;
+      timer_count--;
+    }
+    timer_current++;
+  }
+  *tail = NULL;
+  if (timer_current <= now) { timer_current = now + 1; }
+  return due;
+} /*}}}*/
+
+/* The next tick with something to do: the next non-empty slot of the lowest
+ * level, or the point where it wraps and the levels above cascade. */
+static uint64_t qt_timer_next_wake(void) { /*{{{*/
+  uint64_t t = timer_current;
+
+  if (timer_count == 0) { return UINT64_MAX; }
+  if ((t & QT_TIMER_SLOT_MASK) == 0) { return t; }
+  do {
+    if (timer_wheel[0][t & QT_TIMER_SLOT_MASK]) { return t; }
+  } while (++t & QT_TIMER_SLOT_MASK);
+  return t;
+} /*}}}*/
+
+/* Called without the timer lock. A sleeper's entry lives on its stack, so
+ * it must not be touched once the sleeper has been enqueued; an expiry's
+ * entry, likewise, not once it is marked done. */
+static void qt_timer_fire(struct qthread_timer_s *t) { /*{{{*/
+  while (t) {
+    struct qthread_timer_s *const next = t->next;
+
+    switch (t->kind) {
+      case QT_TIMER_SLEEP: {
+        qthread_t *const sleeper = t->task;
+
+        assert(sleeper->rdata->shepherd_ptr->ready != NULL);
+        qt_threadqueue_enqueue(sleeper->rdata->shepherd_ptr->ready, sleeper);
+        break;
+      }
+      case QT_TIMER_ONESHOT:
+        qthread_spawn(t->f, t->arg, 0, NULL, 0, NULL, NO_SHEPHERD, 0);
+        qt_free(t);
+        break;
+      case QT_TIMER_PERIODIC:
+        qthread_spawn(t->f, t->arg, 0, NULL, 0, NULL, NO_SHEPHERD, 0);
+        pthread_mutex_lock(&timer_lock);
+        if (t->cancelled || timer_stopped) {
+          pthread_mutex_unlock(&timer_lock);
+          qt_free(t);
+          break;
+        }
+        /* stay on the original schedule; periods that have already gone by
+         * are skipped rather than run late */
+        t->expires += t->period;
+        if (t->expires < timer_current) {
+          t->expires +=
+            ((timer_current - t->expires + t->period - 1) / t->period) *
+            t->period;
+        }
+        qt_timer_add(t);
+        pthread_mutex_unlock(&timer_lock);
+        break;
+      case QT_TIMER_EXPIRE:
+        t->f(t->arg);
+        atomic_store_explicit(&t->done, 1, memory_order_release);
+        break;
+    }
+    t = next;
+  }
+} /*}}}*/
+
+static void *qt_timer_thread_func(void *arg) { /*{{{*/
+  pthread_mutex_lock(&timer_lock);
+  while (!timer_stopped) {
+    uint64_t const wake =
+      atomic_load_explicit(&qt_timer_wake, memory_order_relaxed);
+    uint64_t const now = qt_timer_now_ns();
+    struct qthread_timer_s *due;
+
+    if (wake == UINT64_MAX) {
+      pthread_cond_wait(&timer_cond, &timer_lock);
+      continue;
+    }
+    if (wake * timer_tick_ns > now) {
+      uint64_t const wait = wake * timer_tick_ns - now;
+      struct timeval tv;
+      struct timespec deadline;
+
+      gettimeofday(&tv, NULL);
+      deadline.tv_sec = tv.tv_sec + (time_t)(wait / 1000000000);
+      deadline.tv_nsec = (tv.tv_usec * 1000L) + (long)(wait % 1000000000);
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+      continue;
+    }
+    due = qt_timer_advance(now / timer_tick_ns);
+    atomic_store_explicit(
+      &qt_timer_wake, qt_timer_next_wake(), memory_order_relaxed);
+    pthread_mutex_unlock(&timer_lock);
+    qt_timer_fire(due);
+    pthread_mutex_lock(&timer_lock);
+  }
+  pthread_mutex_unlock(&timer_lock);
+  return NULL;
+} /*}}}*/
+
+void INTERNAL qt_timer_poll_internal(void) { /*{{{*/
+  uint64_t const now = qt_timer_now_ns() / timer_tick_ns;
+  struct qthread_timer_s *due;
+
+  if (now < atomic_load_explicit(&qt_timer_wake, memory_order_relaxed)) {
+    return;
+  }
+  /* somebody else is at it */
+  if (pthread_mutex_trylock(&timer_lock) != 0) { return; }
+  if (timer_stopped) {
+    pthread_mutex_unlock(&timer_lock);
+    return;
+  }
+  due = qt_timer_advance(now);
+  atomic_store_explicit(
+    &qt_timer_wake, qt_timer_next_wake(), memory_order_relaxed);
+  pthread_mutex_unlock(&timer_lock);
+  qt_timer_fire(due);
+} /*}}}*/
+
+void INTERNAL qt_timer_insert(struct qthread_timer_s *t) { /*{{{*/
+  pthread_mutex_lock(&timer_lock);
+  qt_timer_start_thread();
+  qt_timer_add(t);
+  pthread_mutex_unlock(&timer_lock);
+} /*}}}*/
+
+/* Runs before the shepherds stop, so that nothing spawns into them after */
+static void qt_timer_subsystem_stop(void) { /*{{{*/
+  pthread_mutex_lock(&timer_lock);
+  timer_stopped = 1;
+  atomic_store_explicit(&qt_timer_wake, UINT64_MAX, memory_order_relaxed);
+  pthread_cond_signal(&timer_cond);
+  pthread_mutex_unlock(&timer_lock);
+  if (timer_thread_running) {
+    pthread_join(timer_thread, NULL);
+    timer_thread_running = 0;
+  }
+} /*}}}*/
+
+/* Runs after the shepherds have stopped; sleepers and timed waits still on
+ * the wheel are abandoned along with their tasks. */
+static void qt_timer_subsystem_freemem(void) { /*{{{*/
+  for (unsigned int l = 0; l < QT_TIMER_LEVELS; ++l) {
+    for (unsigned int i = 0; i < QT_TIMER_SLOTS; ++i) {
+      struct qthread_timer_s *t = timer_wheel[l][i];
+
+      while (t) {
+        struct qthread_timer_s *const next = t->next;
+
+        if ((t->kind == QT_TIMER_ONESHOT) || (t->kind == QT_TIMER_PERIODIC)) {
+          qt_free(t);
+        }
+        t = next;
+      }
+      timer_wheel[l][i] = NULL;
+    }
+  }
+  timer_count = 0;
+} /*}}}*/
+
+void INTERNAL qt_timer_subsystem_init(void) { /*{{{*/
+  timer_tick_ns = 1000 * qt_internal_get_env_num("TIMER_TICK", 1000, 1000);
+  timer_base = qtimer_wtime();
+  timer_current = 0;
+  timer_count = 0;
+  timer_stopped = 0;
+  atomic_store_explicit(&qt_timer_wake, UINT64_MAX, memory_order_relaxed);
+  qthread_internal_cleanup_early(qt_timer_subsystem_stop);
+  qthread_internal_cleanup(qt_timer_subsystem_freemem);
+} /*}}}*/
+
+int API_FUNC qthread_sleep(uint64_t nsecs) { /*{{{*/
+  qthread_t *me = qthread_internal_self();
+  struct qthread_timer_s timer;
+
+  if ((me == NULL) ||
+      (atomic_load_explicit(&me->flags, memory_order_relaxed) &
+       QTHREAD_SIMPLE)) {
+    /* not a task that can be parked */
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(nsecs / 1000000000);
+    ts.tv_nsec = (long)(nsecs % 1000000000);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+    return QTHREAD_SUCCESS;
+  }
+  if (nsecs == 0) {
+    qthread_yield();
+    return QTHREAD_SUCCESS;
+  }
+  timer.kind = QT_TIMER_SLEEP;
+  timer.task = me;
+  timer.expires = qt_timer_deadline(nsecs);
+  timer.cancelled = 0;
+  me->rdata->blockedon.timer = &timer;
+  atomic_store_explicit(
+    &me->thread_state, QTHREAD_STATE_SLEEPING, memory_order_relaxed);
+  qthread_back_to_master(me);
+  return QTHREAD_SUCCESS;
+} /*}}}*/
+
+void INTERNAL qt_timer_block(struct qthread_multiwait_s *w,
+                             qthread_t *me,
+                             uint64_t nsecs,
+                             qthread_f expire,
+                             void *arg) { /*{{{*/
+  struct qthread_timer_s timer;
+
+  timer.kind = QT_TIMER_EXPIRE;
+  timer.f = expire;
+  timer.arg = arg;
+  timer.task = me;
+  timer.cancelled = 0;
+  atomic_store_explicit(&timer.done, 0, memory_order_relaxed);
+  timer.expires = qt_timer_deadline(nsecs);
+  qt_timer_insert(&timer);
+  qt_multiwait_block(w, me);
+  pthread_mutex_lock(&timer_lock);
+  if (timer.pprev) {
+    qt_timer_unlink(&timer);
+    timer_count--;
+    pthread_mutex_unlock(&timer_lock);
+    return;
+  }
+  pthread_mutex_unlock(&timer_lock);
+  /* it came due, so it is being (or has been) fired, and our stack has to
+   * stay put until that is over; the expiry never waits on us, but it may
+   * need our worker (or our CPU) to get there */
+  while (atomic_load_explicit(&timer.done, memory_order_acquire) == 0) {
+    if (me) {
+      qthread_yield();
+    } else {
+      sched_yield();
+    }
+  }
+} /*}}}*/
+
+static int qt_timer_new(uint64_t delay,
+                        uint64_t period,
+                        qthread_f f,
+                        void const *arg,
+                        qthread_timer_t *handle) { /*{{{*/
+  struct qthread_timer_s *t;
+
+  qassert_ret(f, QTHREAD_BADARGS);
+  t = qt_malloc(sizeof(struct qthread_timer_s));
+  qassert_ret(t, QTHREAD_MALLOC_ERROR);
+  t->kind = period ? QT_TIMER_PERIODIC : QT_TIMER_ONESHOT;
+  t->f = f;
+  t->arg = (void *)arg;
+  t->task = NULL;
+  t->cancelled = 0;
+  t->expires = qt_timer_deadline(delay);
+  t->period = (period + timer_tick_ns - 1) / timer_tick_ns;
+  if (handle) { *handle = t; }
+  qt_timer_insert(t);
+  return QTHREAD_SUCCESS;
+} /*}}}*/
+
+int API_FUNC qthread_spawn_after(uint64_t nsecs,
+                                 qthread_f f,
+                                 void const *arg) { /*{{{*/
+  return qt_timer_new(nsecs, 0, f, arg, NULL);
+} /*}}}*/
+
+int API_FUNC qthread_spawn_periodic(uint64_t period,
+                                    qthread_f f,
+                                    void const *arg,
+                                    qthread_timer_t *timer) { /*{{{*/
+  qassert_ret(period > 0, QTHREAD_BADARGS);
+  return qt_timer_new(period, period, f, arg, timer);
+} /*}}}*/
+
+int API_FUNC qthread_timer_cancel(qthread_timer_t timer) { /*{{{*/
+  qassert_ret(timer, QTHREAD_BADARGS);
+  pthread_mutex_lock(&timer_lock);
+  if (timer->pprev) {
+    qt_timer_unlink(timer);
+    timer_count--;
+    pthread_mutex_unlock(&timer_lock);
+    qt_free(timer);
+  } else {
+    /* being fired; whoever is firing it frees it */
+    timer->cancelled = 1;
+    pthread_mutex_unlock(&timer_lock);
+  }
+  return QTHREAD_SUCCESS;
+} /*}}}*/
+
+/* vim:set expandtab: */
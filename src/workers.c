@@ -9,6 +9,7 @@
 
 /* Internal Headers */
 #include "qt_asserts.h"
+#include "qt_futex.h"
 #include "qt_initialized.h" // for qthread_library_initialized
 #include "qt_shepherd_innards.h"
 #include "qt_visibility.h"
@@ -36,8 +37,13 @@ int API_FUNC qthread_disable_worker(qthread_worker_id_t const w) { /*{{{*/
     return QTHREAD_NOT_ALLOWED;
   }
 
-  (void)QT_CAS(qlib->shepherds[shep].workers[worker].active, 1, 0);
-  qlib->nworkers_active--; // decrement active count
+  uint_fast8_t was_active = 1;
+  if (atomic_compare_exchange_strong(
+        &qlib->shepherds[shep].workers[worker].active, &was_active, 0)) {
+    // decrement active count
+    qthread_internal_incr(
+      &(qlib->nworkers_active), &(qlib->nworkers_active_lock), -1);
+  }
 
   if (worker == 0) { qthread_disable_shepherd(shep); }
 
@@ -54,12 +60,33 @@ void API_FUNC qthread_enable_worker(qthread_worker_id_t const w) { /*{{{ */
 
   if (worker == 0) { qthread_enable_shepherd(shep); }
   if (worker < qlib->nworkerspershep) {
-    qthread_internal_incr(
-      &(qlib->nworkers_active), &(qlib->nworkers_active_lock), 1);
-    (void)QT_CAS(qlib->shepherds[shep].workers[worker].active, 0, 1);
+    uint_fast8_t was_active = 0;
+    if (atomic_compare_exchange_strong(
+          &qlib->shepherds[shep].workers[worker].active, &was_active, 1)) {
+      qthread_internal_incr(
+        &(qlib->nworkers_active), &(qlib->nworkers_active_lock), 1);
+      qt_worker_wake(&qlib->shepherds[shep].workers[worker]);
+    }
   }
 } /*}}} */
 
+/* Disabled workers sleep in qt_worker_wait_enabled() rather than spinning, so
+ * that they cost nothing while the process shares the node; whoever sets a
+ * worker's active flag must call this afterward. */
+void INTERNAL qt_worker_wake(qthread_worker_t *w) { /*{{{*/
+  atomic_fetch_add_explicit(&w->enable_seq, 1, memory_order_seq_cst);
+  qt_futex_wake(&w->enable_seq, 1);
+} /*}}}*/
+
+void INTERNAL qt_worker_wait_enabled(qthread_worker_t *w) { /*{{{*/
+  while (!atomic_load_explicit(&w->active, memory_order_seq_cst)) {
+    uint32_t const seq =
+      atomic_load_explicit(&w->enable_seq, memory_order_seq_cst);
+    if (atomic_load_explicit(&w->active, memory_order_seq_cst)) { break; }
+    qt_futex_wait(&w->enable_seq, seq, NULL);
+  }
+} /*}}}*/
+
 qthread_worker_id_t API_FUNC
 qthread_worker(qthread_shepherd_id_t *shepherd_id) { /*{{{ */
   assert(qthread_library_initialized);
@@ -0,0 +1,132 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <pthread.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+
+/* Plain pthreads (not qthreads) ping-ponging values with tasks through FEBs
+ * and syncvars, blocking on both sides. */
+
+static aligned_t rounds = 1000;
+
+typedef struct {
+  aligned_t ping;
+  aligned_t pong;
+  syncvar_t sping;
+  syncvar_t spong;
+  aligned_t done;
+} channel_t;
+
+static aligned_t feb_echo(void *arg) {
+  channel_t *c = (channel_t *)arg;
+  aligned_t v;
+
+  for (aligned_t i = 0; i < rounds; ++i) {
+    qthread_readFE(&v, &c->ping);
+    qthread_writeEF_const(&c->pong, v + 1);
+  }
+  return 0;
+}
+
+static aligned_t syncvar_echo(void *arg) {
+  channel_t *c = (channel_t *)arg;
+  uint64_t v;
+
+  for (aligned_t i = 0; i < rounds; ++i) {
+    qthread_syncvar_readFE(&v, &c->sping);
+    qthread_syncvar_writeEF_const(&c->spong, v + 1);
+  }
+  return 0;
+}
+
+static void *external(void *arg) {
+  channel_t *c = (channel_t *)arg;
+  aligned_t ret[2];
+
+  qthread_fork(feb_echo, c, &ret[0]);
+  qthread_fork(syncvar_echo, c, &ret[1]);
+  for (aligned_t i = 0; i < rounds; ++i) {
+    aligned_t v;
+    uint64_t sv;
+
+    qthread_writeEF_const(&c->ping, i);
+    qthread_syncvar_writeEF_const(&c->sping, i);
+    qthread_readFE(&v, &c->pong);
+    assert(v == i + 1);
+    qthread_syncvar_readFE(&sv, &c->spong);
+    assert(sv == i + 1);
+  }
+  qthread_readFF(NULL, &ret[0]);
+  qthread_readFF(NULL, &ret[1]);
+  qthread_fill(&c->done);
+  return NULL;
+}
+
+static aligned_t gate;
+
+static void *waiter(void *arg) {
+  aligned_t v;
+
+  qthread_readFF(&v, &gate);
+  assert(v == 42);
+  qthread_writeF_const((aligned_t *)arg, 1);
+  return NULL;
+}
+
+static aligned_t filler(void *arg) {
+  qthread_writeF_const(&gate, 42);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t npthreads = 4;
+  pthread_t threads[16];
+  channel_t channels[16];
+  aligned_t ret;
+  aligned_t passed[16];
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(rounds, "NUM_ROUNDS");
+  NUMARG(npthreads, "NUM_PTHREADS");
+  if (npthreads > 16) { npthreads = 16; }
+
+  for (aligned_t i = 0; i < npthreads; ++i) {
+    qthread_empty(&channels[i].ping);
+    qthread_empty(&channels[i].pong);
+    qthread_empty(&channels[i].done);
+    channels[i].sping = SYNCVAR_EMPTY_INITIALIZER;
+    channels[i].spong = SYNCVAR_EMPTY_INITIALIZER;
+    assert(pthread_create(&threads[i], NULL, external, &channels[i]) == 0);
+  }
+  /* the main task must not sit in pthread_join() while its worker is needed
+   * by the tasks the pthreads are talking to */
+  for (aligned_t i = 0; i < npthreads; ++i) {
+    qthread_readFF(NULL, &channels[i].done);
+    pthread_join(threads[i], NULL);
+  }
+  iprintf("%lu pthreads did %lu round trips each\n",
+          (unsigned long)npthreads,
+          (unsigned long)rounds);
+
+  /* several pthreads waiting on one FEB are all released by one task */
+  qthread_empty(&gate);
+  for (aligned_t i = 0; i < npthreads; ++i) {
+    qthread_empty(&passed[i]);
+    assert(pthread_create(&threads[i], NULL, waiter, &passed[i]) == 0);
+  }
+  qthread_fork(filler, NULL, &ret);
+  qthread_readFF(NULL, &ret);
+  for (aligned_t i = 0; i < npthreads; ++i) {
+    qthread_readFF(NULL, &passed[i]);
+    pthread_join(threads[i], NULL);
+  }
+
+  return 0;
+}
+
+/* vim:set expandtab */
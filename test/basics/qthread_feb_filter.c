@@ -0,0 +1,71 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The filter that lets FEB operations on full words skip the hash, made as
+ * small as it goes and then overloaded with far more empty words than it has
+ * counters, so that every counter is in use: full words must still read as
+ * full and empty ones as empty, round after round. */
+
+#define NWORDS 4096
+
+static aligned_t words[NWORDS];
+static aligned_t full[NWORDS];
+
+static aligned_t reader(void *arg) {
+  aligned_t *const w = (aligned_t *)arg;
+  aligned_t v;
+
+  qthread_readFF(&v, w);
+  return v;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t *rets;
+
+  setenv("QT_FEB_FILTER_SIZE", "1", 1);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  rets = malloc(sizeof(aligned_t) * NWORDS);
+  assert(rets);
+
+  for (int round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < NWORDS; ++i) {
+      full[i] = i;
+      qthread_empty(&words[i]);
+    }
+    for (size_t i = 0; i < NWORDS; ++i) {
+      aligned_t v = 0;
+
+      assert(qthread_feb_status(&words[i]) == 0);
+      assert(qthread_feb_status(&full[i]) == 1);
+      qthread_readFF(&v, &full[i]);
+      assert(v == i);
+      qthread_writeFF_const(&full[i], i + 1);
+      assert(full[i] == i + 1);
+    }
+    for (size_t i = 0; i < NWORDS; ++i) {
+      qthread_fork(reader, &words[i], &rets[i]);
+    }
+    for (size_t i = 0; i < NWORDS; ++i) {
+      qthread_writeEF_const(&words[i], i * 3);
+    }
+    for (size_t i = 0; i < NWORDS; ++i) {
+      qthread_readFF(NULL, &rets[i]);
+      assert(rets[i] == i * 3);
+      assert(qthread_feb_status(&words[i]) == 1);
+    }
+    iprintf("round %d: %d words emptied and filled\n", round, NWORDS);
+  }
+
+  free(rets);
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,66 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <fenv.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A task's floating-point control state (here, the rounding mode) belongs to
+ * it: it must survive the task's context switches, and must not leak into
+ * other tasks, including those spawned with QTHREAD_SPAWN_FIXED_FPENV. */
+
+#define YIELDS 1000
+
+static aligned_t rounds_up(void *arg) {
+  volatile double three = 3.0;
+
+  fesetround(FE_UPWARD);
+  for (int i = 0; i < YIELDS; ++i) {
+    qthread_yield();
+    if (fegetround() != FE_UPWARD) { return 1; }
+  }
+  /* 1/3 rounded up is above 1/3 rounded to nearest */
+  return ((1.0 / three) * 3.0 > 1.0) ? 0 : 2;
+}
+
+static aligned_t rounds_nearest(void *arg) {
+  for (int i = 0; i < YIELDS; ++i) {
+    qthread_yield();
+    if (fegetround() != FE_TONEAREST) { return 1; }
+  }
+  return 0;
+}
+
+int main(void) {
+  aligned_t rets[4];
+  int ret;
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  assert(fegetround() == FE_TONEAREST);
+
+  /* all on one shepherd, so that they take turns */
+  ret = qthread_spawn(rounds_up, NULL, 0, &rets[0], 0, NULL, 0, 0);
+  assert(ret == QTHREAD_SUCCESS);
+  ret = qthread_spawn(rounds_nearest, NULL, 0, &rets[1], 0, NULL, 0, 0);
+  assert(ret == QTHREAD_SUCCESS);
+  ret = qthread_spawn(
+    rounds_nearest, NULL, 0, &rets[2], 0, NULL, 0, QTHREAD_SPAWN_FIXED_FPENV);
+  assert(ret == QTHREAD_SUCCESS);
+  ret = qthread_spawn(rounds_up, NULL, 0, &rets[3], 0, NULL, 0, 0);
+  assert(ret == QTHREAD_SUCCESS);
+  for (int i = 0; i < 4; ++i) {
+    qthread_readFF(NULL, &rets[i]);
+    if (rets[i] != 0) {
+      fprintf(stderr, "task %d saw the wrong rounding mode (%d)\n", i,
+              (int)rets[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  assert(fegetround() == FE_TONEAREST);
+  return EXIT_SUCCESS;
+}
+
+/* vim:set expandtab */
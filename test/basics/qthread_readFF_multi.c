@@ -0,0 +1,148 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+
+/* Tasks waiting on the first of, or all of, several FEBs and syncvars at
+ * once. */
+
+#define NADDRS 8
+#define NWAITERS 4
+
+static aligned_t febs[NADDRS];
+static aligned_t const *feb_ptrs[NADDRS];
+static syncvar_t svs[NADDRS];
+static syncvar_t *sv_ptrs[NADDRS];
+static aligned_t filled;
+
+static aligned_t feb_any(void *arg) {
+  size_t index = NADDRS;
+
+  assert(qthread_readFF_any(feb_ptrs, NADDRS, &index) == QTHREAD_SUCCESS);
+  assert(index < NADDRS);
+  assert(qthread_feb_status(&febs[index]) == 1);
+  return index;
+}
+
+static aligned_t feb_all(void *arg) {
+  assert(qthread_readFF_all(feb_ptrs, NADDRS) == QTHREAD_SUCCESS);
+  assert(qthread_incr(&filled, 0) == NADDRS);
+  return 0;
+}
+
+static aligned_t sv_any(void *arg) {
+  size_t index = NADDRS;
+
+  assert(qthread_syncvar_readFF_any(sv_ptrs, NADDRS, &index) ==
+         QTHREAD_SUCCESS);
+  assert(index < NADDRS);
+  assert(qthread_syncvar_status(&svs[index]) == 1);
+  return index;
+}
+
+static aligned_t sv_all(void *arg) {
+  assert(qthread_syncvar_readFF_all(sv_ptrs, NADDRS) == QTHREAD_SUCCESS);
+  assert(qthread_incr(&filled, 0) == NADDRS);
+  return 0;
+}
+
+static void empty_all(void) {
+  for (int i = 0; i < NADDRS; ++i) {
+    qthread_empty(&febs[i]);
+    qthread_syncvar_empty(&svs[i]);
+  }
+  filled = 0;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t rounds = 100;
+  aligned_t rets[NWAITERS];
+  size_t index;
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(rounds, "NUM_ROUNDS");
+
+  for (int i = 0; i < NADDRS; ++i) {
+    feb_ptrs[i] = &febs[i];
+    sv_ptrs[i] = &svs[i];
+    svs[i] = SYNCVAR_EMPTY_INITIALIZER;
+  }
+
+  /* something is full already: no blocking at all */
+  empty_all();
+  qthread_writeF_const(&febs[3], 3);
+  assert(qthread_readFF_any(feb_ptrs, NADDRS, &index) == QTHREAD_SUCCESS);
+  assert(index == 3);
+  qthread_syncvar_writeF_const(&svs[6], 6);
+  assert(qthread_syncvar_readFF_any(sv_ptrs, NADDRS, &index) ==
+         QTHREAD_SUCCESS);
+  assert(index == 6);
+  for (int i = 0; i < NADDRS; ++i) {
+    qthread_fill(&febs[i]);
+    qthread_syncvar_fill(&svs[i]);
+  }
+  assert(qthread_readFF_all(feb_ptrs, NADDRS) == QTHREAD_SUCCESS);
+  assert(qthread_syncvar_readFF_all(sv_ptrs, NADDRS) == QTHREAD_SUCCESS);
+
+  for (aligned_t r = 0; r < rounds; ++r) {
+    size_t const which = r % NADDRS;
+
+    /* any: one fill wakes every waiter, and the fills after it find only the
+     * nodes the waiters have not taken back yet */
+    empty_all();
+    for (int i = 0; i < NWAITERS; ++i) {
+      qthread_fork(feb_any, NULL, &rets[i]);
+    }
+    qthread_yield();
+    qthread_writeF_const(&febs[which], r);
+    for (int i = 0; i < NWAITERS; ++i) {
+      qthread_readFF(NULL, &rets[i]);
+      assert(rets[i] == which);
+    }
+    for (int i = 0; i < NWAITERS; ++i) {
+      qthread_fork(sv_any, NULL, &rets[i]);
+    }
+    qthread_yield();
+    qthread_syncvar_writeF_const(&svs[which], r);
+    for (int i = 0; i < NWAITERS; ++i) {
+      qthread_readFF(NULL, &rets[i]);
+      assert(rets[i] == which);
+    }
+    for (int i = 0; i < NADDRS; ++i) {
+      qthread_fill(&febs[i]);
+      qthread_syncvar_fill(&svs[i]);
+    }
+
+    /* all: nobody wakes before the last fill */
+    empty_all();
+    for (int i = 0; i < NWAITERS; ++i) {
+      qthread_fork(i & 1 ? sv_all : feb_all, NULL, &rets[i]);
+    }
+    qthread_yield();
+    for (int i = 0; i < NADDRS; ++i) {
+      size_t const j = (i + which) % NADDRS;
+
+      if (i == NADDRS - 1) { qthread_incr(&filled, 1); }
+      qthread_writeF_const(&febs[j], j);
+      qthread_syncvar_writeF_const(&svs[j], j);
+      if (i < NADDRS - 1) {
+        qthread_incr(&filled, 1);
+        qthread_yield();
+      }
+    }
+    for (int i = 0; i < NWAITERS; ++i) { qthread_readFF(NULL, &rets[i]); }
+  }
+  iprintf("%lu rounds of %d waiters on %d addresses\n",
+          (unsigned long)rounds,
+          NWAITERS,
+          NADDRS);
+
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,132 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  aligned_t remaining;
+  aligned_t total;
+} step_t;
+
+/* A long tail-recursive chain with a copied argument; every step updates
+ * the argument it was given and replaces itself with the next step. */
+static aligned_t step(void *arg) {
+  step_t s = *(step_t *)arg;
+
+  if (s.remaining == 0) { return s.total; }
+  s.total += s.remaining--;
+  return qthread_replace(step, &s, sizeof(s));
+}
+
+/* The same with the argument passed by pointer, checking that the task's
+ * identity, stack and task-local data carry over. */
+typedef struct {
+  aligned_t remaining;
+  unsigned id;
+  void *stack_marker;
+} chain_t;
+
+static aligned_t link_step(void *arg) {
+  chain_t *c = arg;
+  int here;
+  unsigned *tl = qthread_get_tasklocal(sizeof(unsigned));
+
+  if (qthread_id() != c->id) { return 1; }
+  if (c->stack_marker == NULL) {
+    c->stack_marker = &here;
+    *tl = 42;
+  } else if (*tl != 42) {
+    return 2;
+  } else if ((char *)c->stack_marker - (char *)&here > 4096 ||
+             (char *)&here - (char *)c->stack_marker > 4096) {
+    return 3; /* the chain is not unwinding its frames */
+  }
+  if (c->remaining-- == 0) { return 0; }
+  return qthread_replace(link_step, c, 0);
+}
+
+static aligned_t link_start(void *arg) {
+  chain_t *c = arg;
+
+  c->id = qthread_id();
+  return qthread_replace(link_step, c, 0);
+}
+
+/* Arguments bigger than QT_ARGCOPY_SIZE take another path. */
+typedef struct {
+  char pad[4000];
+  aligned_t remaining;
+} big_t;
+
+static aligned_t big_step(void *arg) {
+  big_t b;
+
+  memcpy(&b, arg, sizeof(b));
+  for (size_t i = 0; i < sizeof(b.pad); ++i) {
+    if (b.pad[i] != (char)b.remaining) { return 1; }
+  }
+  if (b.remaining == 0) { return 0; }
+  b.remaining--;
+  memset(b.pad, (char)b.remaining, sizeof(b.pad));
+  return qthread_replace(big_step, &b, sizeof(b));
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t steps = 1000000;
+  aligned_t ret;
+  syncvar_t sret = SYNCVAR_STATIC_INITIALIZER;
+  uint64_t sval;
+  step_t s;
+  chain_t c = {1000, 0, NULL};
+  big_t *b = malloc(sizeof(big_t));
+  qtimer_t timer = qtimer_create();
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(steps, "STEPS");
+
+  s.remaining = steps;
+  s.total = 0;
+  qtimer_start(timer);
+  qthread_fork_copyargs(step, &s, sizeof(s), &ret);
+  qthread_readFF(NULL, &ret);
+  qtimer_stop(timer);
+  assert(ret == steps * (steps + 1) / 2);
+  iprintf("%lu steps in %f secs (%f ns per step)\n",
+          (unsigned long)steps,
+          qtimer_secs(timer),
+          qtimer_secs(timer) * 1e9 / steps);
+
+  /* the return value goes wherever the original task's was going */
+  s.remaining = 100;
+  s.total = 0;
+  qthread_fork_syncvar_copyargs(step, &s, sizeof(s), &sret);
+  qthread_syncvar_readFF(&sval, &sret);
+  assert(sval == 5050);
+
+  qthread_fork(link_start, &c, &ret);
+  qthread_readFF(NULL, &ret);
+  assert(ret == 0);
+
+  b->remaining = 3;
+  memset(b->pad, 3, sizeof(b->pad));
+  qthread_fork_copyargs(big_step, b, sizeof(big_t), &ret);
+  qthread_readFF(NULL, &ret);
+  assert(ret == 0);
+
+  /* not from outside a task */
+  assert(qthread_replace(step, &s, sizeof(s)) == QTHREAD_NOT_ALLOWED);
+
+  free(b);
+  qtimer_destroy(timer);
+  return 0;
+}
+
+/* vim:set expandtab */
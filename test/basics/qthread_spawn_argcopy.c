@@ -0,0 +1,76 @@
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* one size per argument-copy size class (with the default QT_ARGCOPY_SIZE of
+ * 1024), plus the edges between them and a few that must be malloc'd */
+static size_t const sizes[] = {
+  1, 8, 63, 64, 65, 128, 200, 256, 511, 512, 513, 1000, 1024, 1025, 4000};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static aligned_t check_arg(void *arg) {
+  uint8_t const *bytes = (uint8_t const *)arg;
+  size_t size;
+  uint8_t *tl;
+
+  memcpy(&size, bytes, sizeof(size_t));
+  for (size_t i = sizeof(size_t); i < size; i++) {
+    assert(bytes[i] == (uint8_t)(i + size));
+  }
+  /* the default task-local space sits right after the argument space and
+   * must not overlap it */
+  tl = qthread_get_tasklocal(sizeof(size_t));
+  assert(tl);
+  memset(tl, 0xff, sizeof(size_t));
+  for (size_t i = sizeof(size_t); i < size; i++) {
+    assert(bytes[i] == (uint8_t)(i + size));
+  }
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t rets[NSIZES][4];
+  uint8_t *buf = malloc(sizes[NSIZES - 1]);
+
+  assert(buf);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+
+  for (size_t s = 0; s < NSIZES; s++) {
+    size_t const size = sizes[s] < sizeof(size_t) ? sizeof(size_t) : sizes[s];
+
+    memcpy(buf, &size, sizeof(size_t));
+    for (size_t i = sizeof(size_t); i < size; i++) {
+      buf[i] = (uint8_t)(i + size);
+    }
+    for (int k = 0; k < 4; k++) {
+      assert(qthread_spawn(check_arg,
+                           buf,
+                           size,
+                           &rets[s][k],
+                           0,
+                           NULL,
+                           NO_SHEPHERD,
+                           0) == QTHREAD_SUCCESS);
+    }
+    /* the argument was copied; scribbling on it must not matter */
+    memset(buf, 0, size);
+  }
+  for (size_t s = 0; s < NSIZES; s++) {
+    size_t const size = sizes[s] < sizeof(size_t) ? sizeof(size_t) : sizes[s];
+    for (int k = 0; k < 4; k++) {
+      aligned_t r;
+      qthread_readFF(&r, &rets[s][k]);
+      assert(r == size);
+    }
+    iprintf("%u-byte arguments: ok\n", (unsigned)size);
+  }
+  free(buf);
+
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/sinc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* more than one batch, and not a multiple of the batch size */
+#define NTASKS 1000
+
+static aligned_t counter = 0;
+static aligned_t seen[NTASKS];
+
+struct bulk_arg {
+  size_t idx;
+  aligned_t val;
+};
+
+static aligned_t by_ptr(void *arg) {
+  qthread_incr(&counter, 1);
+  return (aligned_t)(uintptr_t)arg;
+}
+
+static aligned_t by_copy(void *arg) {
+  struct bulk_arg const *a = (struct bulk_arg const *)arg;
+
+  qthread_incr(&seen[a->idx], 1);
+  return a->val;
+}
+
+static aligned_t on_shep(void *arg) {
+  qthread_incr(&counter, 1);
+  return qthread_shep();
+}
+
+int main(int argc, char *argv[]) {
+  static aligned_t rets[NTASKS];
+  static syncvar_t srets[NTASKS];
+  static void *ptrs[NTASKS];
+  static struct bulk_arg args[NTASKS];
+  qt_sinc_t sinc;
+  qthread_shepherd_id_t target;
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  target = qthread_num_shepherds() - 1;
+  iprintf("%i shepherds, %i workers\n",
+          qthread_num_shepherds(),
+          qthread_num_workers());
+
+  /* pointer arguments, aligned_t returns */
+  for (size_t i = 0; i < NTASKS; i++) { ptrs[i] = (void *)(uintptr_t)(i + 1); }
+  assert(qthread_spawn_bulk(by_ptr, ptrs, 0, rets, NTASKS, NO_SHEPHERD, 0) ==
+         QTHREAD_SUCCESS);
+  for (size_t i = 0; i < NTASKS; i++) {
+    aligned_t r;
+    qthread_readFF(&r, &rets[i]);
+    assert(r == i + 1);
+  }
+  assert(counter == NTASKS);
+  iprintf("pointer args: ok\n");
+
+  /* copied arguments, syncvar_t returns */
+  for (size_t i = 0; i < NTASKS; i++) {
+    args[i].idx = i;
+    args[i].val = 2 * i;
+    srets[i] = SYNCVAR_EMPTY_INITIALIZER;
+  }
+  assert(qthread_spawn_bulk(by_copy,
+                            args,
+                            sizeof(struct bulk_arg),
+                            srets,
+                            NTASKS,
+                            NO_SHEPHERD,
+                            QTHREAD_SPAWN_RET_SYNCVAR_T) == QTHREAD_SUCCESS);
+  for (size_t i = 0; i < NTASKS; i++) {
+    uint64_t r;
+    qthread_syncvar_readFF(&r, &srets[i]);
+    assert(r == 2 * i);
+    assert(seen[i] == 1);
+  }
+  iprintf("copied args: ok\n");
+
+  /* a single sinc for all of the tasks */
+  counter = 0;
+  qt_sinc_init(&sinc, 0, NULL, NULL, NTASKS);
+  assert(qthread_spawn_bulk(by_ptr,
+                            NULL,
+                            0,
+                            &sinc,
+                            NTASKS,
+                            NO_SHEPHERD,
+                            QTHREAD_SPAWN_RET_SINC_VOID) == QTHREAD_SUCCESS);
+  qt_sinc_wait(&sinc, NULL);
+  qt_sinc_fini(&sinc);
+  assert(counter == NTASKS);
+  iprintf("sinc: ok\n");
+
+  /* pinned to one shepherd */
+  counter = 0;
+  assert(qthread_spawn_bulk(on_shep, NULL, 0, rets, NTASKS, target, 0) ==
+         QTHREAD_SUCCESS);
+  for (size_t i = 0; i < NTASKS; i++) {
+    aligned_t r;
+    qthread_readFF(&r, &rets[i]);
+    assert(r == target);
+  }
+  assert(counter == NTASKS);
+  iprintf("targeted: ok\n");
+
+  /* team flags are rejected */
+  assert(qthread_spawn_bulk(by_ptr,
+                            NULL,
+                            0,
+                            NULL,
+                            1,
+                            NO_SHEPHERD,
+                            QTHREAD_SPAWN_NEW_TEAM) == QTHREAD_BADARGS);
+
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,74 @@
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h> /* for getenv() */
+
+#define NTASKS 16
+
+static aligned_t counter = 0;
+static aligned_t order[3][NTASKS];
+
+static aligned_t record(void *arg) {
+  aligned_t *slot = (aligned_t *)arg;
+
+  *slot = qthread_incr(&counter, 1);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static int const prio[3] = {0, 3, QTHREAD_NUM_PRIORITIES - 1};
+  aligned_t rets[3][NTASKS];
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  iprintf("%i shepherds, %i workers\n",
+          qthread_num_shepherds(),
+          qthread_num_workers());
+
+  /* lowest priority first, so that a FIFO or LIFO queue would get it wrong */
+  for (int p = 0; p < 3; p++) {
+    for (int i = 0; i < NTASKS; i++) {
+      int ret = qthread_spawn(record,
+                              &order[p][i],
+                              0,
+                              &rets[p][i],
+                              0,
+                              NULL,
+                              NO_SHEPHERD,
+                              QTHREAD_SPAWN_PRIORITY(prio[p]));
+      assert(ret == QTHREAD_SUCCESS);
+    }
+  }
+  for (int p = 0; p < 3; p++) {
+    for (int i = 0; i < NTASKS; i++) { qthread_readFF(NULL, &rets[p][i]); }
+  }
+  assert(counter == 3 * NTASKS);
+  iprintf("all %i tasks ran\n", 3 * NTASKS);
+
+#ifdef SCHEDULER_sherwood
+  /* with a single worker nothing runs until we block, and then the ready
+   * queue must be drained highest priority first, FIFO within a raised
+   * priority (priority 0 keeps the scheduler's usual LIFO order) */
+  if ((qthread_num_workers() == 1) && !getenv("QT_PRIORITY_AGING") &&
+      !getenv("QTHREAD_PRIORITY_AGING")) {
+    for (int p = 0; p < 3; p++) {
+      for (int i = 0; i < NTASKS; i++) {
+        iprintf("priority %i task %i ran %lu\n",
+                prio[p],
+                i,
+                (unsigned long)order[p][i]);
+        assert(order[p][i] >= (aligned_t)((2 - p) * NTASKS));
+        assert(order[p][i] < (aligned_t)((3 - p) * NTASKS));
+        if (p > 0) {
+          assert(order[p][i] == (aligned_t)((2 - p) * NTASKS + i));
+        }
+      }
+    }
+    iprintf("tasks ran in priority order\n");
+  }
+#endif
+  return 0;
+}
+
+/* vim:set expandtab */
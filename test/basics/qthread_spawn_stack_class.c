@@ -0,0 +1,107 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSMALL 1000
+
+static aligned_t stack_bytes(void *arg) {
+  return (aligned_t)((char *)qthread_bos() - (char *)qthread_tos());
+}
+
+/* use (most of) the stack: recurse through frames of 1KiB each */
+static size_t deep(size_t depth) {
+  volatile char frame[1024];
+
+  memset((char *)frame, (int)depth, sizeof(frame));
+  if (depth == 0) { return frame[0]; }
+  return deep(depth - 1) + frame[depth % sizeof(frame)];
+}
+
+static aligned_t deep_task(void *arg) {
+  size_t const depth = (size_t)(uintptr_t)arg;
+
+  return (aligned_t)deep(depth) + (aligned_t)qthread_stackleft();
+}
+
+int main(int argc, char *argv[]) {
+  static aligned_t rets[NSMALL];
+  aligned_t ret;
+  size_t small, large;
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+
+  /* the default class */
+  assert(qthread_spawn(stack_bytes, NULL, 0, &ret, 0, NULL, NO_SHEPHERD, 0) ==
+         QTHREAD_SUCCESS);
+  qthread_readFF(&ret, &ret);
+  assert(ret == qthread_readstate(STACK_SIZE));
+
+  /* lots of small-stack tasks */
+  for (size_t i = 0; i < NSMALL; i++) {
+    assert(qthread_spawn(stack_bytes,
+                         NULL,
+                         0,
+                         &rets[i],
+                         0,
+                         NULL,
+                         NO_SHEPHERD,
+                         QTHREAD_SPAWN_STACK_SMALL) == QTHREAD_SUCCESS);
+  }
+  small = 0;
+  for (size_t i = 0; i < NSMALL; i++) {
+    qthread_readFF(&ret, &rets[i]);
+    if (small == 0) { small = ret; }
+    assert(ret == small);
+  }
+  iprintf("default stack %lu, small stack %lu\n",
+          (unsigned long)qthread_readstate(STACK_SIZE),
+          (unsigned long)small);
+  assert(small <= qthread_readstate(STACK_SIZE));
+
+  /* a large-stack task that uses more stack than the default class has */
+  assert(qthread_spawn(stack_bytes,
+                       NULL,
+                       0,
+                       &ret,
+                       0,
+                       NULL,
+                       NO_SHEPHERD,
+                       QTHREAD_SPAWN_STACK_LARGE) == QTHREAD_SUCCESS);
+  qthread_readFF(&ret, &ret);
+  large = ret;
+  iprintf("large stack %lu\n", (unsigned long)large);
+  assert(large >= qthread_readstate(STACK_SIZE));
+  assert(qthread_spawn(deep_task,
+                       (void *)(uintptr_t)(large / 2048),
+                       0,
+                       &ret,
+                       0,
+                       NULL,
+                       NO_SHEPHERD,
+                       QTHREAD_SPAWN_STACK_LARGE) == QTHREAD_SUCCESS);
+  qthread_readFF(&ret, &ret);
+
+  /* size hints map onto the classes */
+  assert(qthread_spawn_stack_flag(1) == QTHREAD_SPAWN_STACK_SMALL);
+  assert(qthread_spawn_stack_flag(small) == QTHREAD_SPAWN_STACK_SMALL);
+  if (small < qthread_readstate(STACK_SIZE)) {
+    assert(qthread_spawn_stack_flag(small + 1) == 0);
+  }
+  assert(qthread_spawn_stack_flag(large) ==
+         ((large == qthread_readstate(STACK_SIZE))
+            ? 0
+            : QTHREAD_SPAWN_STACK_LARGE));
+  assert(qthread_spawn_stack_flag(large + 1) == QTHREAD_SPAWN_STACK_LARGE);
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set expandtab */
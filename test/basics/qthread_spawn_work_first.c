@@ -0,0 +1,101 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* tasks spawned but not yet finished, and the most there ever were */
+static aligned_t outstanding = 0;
+static aligned_t max_outstanding = 0;
+
+static void spawned(void) {
+  aligned_t const now = qthread_incr(&outstanding, 1) + 1;
+  aligned_t old = max_outstanding;
+
+  while (now > old) {
+    aligned_t const seen = qthread_cas(&max_outstanding, old, now);
+    if (seen == old) { break; }
+    old = seen;
+  }
+}
+
+static aligned_t fib(void *arg) {
+  aligned_t const n = (aligned_t)(uintptr_t)arg;
+  aligned_t r1, r2;
+
+  if (n < 2) {
+    qthread_incr(&outstanding, -1);
+    return n;
+  }
+  spawned();
+  qthread_spawn(fib, (void *)(uintptr_t)(n - 1), 0, &r1, 0, NULL,
+                NO_SHEPHERD, QTHREAD_SPAWN_WORK_FIRST);
+  spawned();
+  qthread_spawn(fib, (void *)(uintptr_t)(n - 2), 0, &r2, 0, NULL,
+                NO_SHEPHERD, QTHREAD_SPAWN_WORK_FIRST);
+  qthread_readFF(NULL, &r1);
+  qthread_readFF(NULL, &r2);
+  qthread_incr(&outstanding, -1);
+  return r1 + r2;
+}
+
+static aligned_t leaf(void *arg) {
+  qthread_incr(&outstanding, -1);
+  return 0;
+}
+
+/* With a single worker, a work-first child that does not block has finished
+ * by the time the spawn returns to its parent, so a spawn loop never has
+ * more than one child outstanding (a help-first one queues all of them). */
+static aligned_t spawn_loop(void *arg) {
+  size_t const n = (size_t)(uintptr_t)arg;
+  aligned_t *rets = calloc(n, sizeof(aligned_t));
+
+  assert(rets);
+  for (size_t i = 0; i < n; ++i) {
+    spawned();
+    qthread_spawn(leaf, NULL, 0, &rets[i], 0, NULL, NO_SHEPHERD,
+                  QTHREAD_SPAWN_WORK_FIRST);
+    if (outstanding != 0) { return 1; }
+  }
+  for (size_t i = 0; i < n; ++i) { qthread_readFF(NULL, &rets[i]); }
+  free(rets);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t n = 20;
+  aligned_t ret;
+
+  setenv("QT_NUM_SHEPHERDS", "1", 1);
+  setenv("QT_NUM_WORKERS_PER_SHEPHERD", "1", 1);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(n, "FIB_INPUT");
+
+  qthread_fork(spawn_loop, (void *)(uintptr_t)1000, &ret);
+  qthread_readFF(NULL, &ret);
+  assert(ret == 0);
+  assert(max_outstanding == 1);
+
+  max_outstanding = 0;
+  qthread_fork(fib, (void *)(uintptr_t)n, &ret);
+  qthread_readFF(NULL, &ret);
+  iprintf("fib(%lu) = %lu, at most %lu tasks outstanding\n",
+          (unsigned long)n, (unsigned long)ret,
+          (unsigned long)max_outstanding);
+  assert(ret == 6765 || n != 20);
+#ifndef SCHEDULER_nemesis
+  /* depth-first: about one suspended task per level of recursion (the
+   * nemesis queue is FIFO, so it resumes parents breadth-first) */
+  assert(max_outstanding <= n + 1);
+#endif
+
+  return 0;
+}
+
+/* vim:set expandtab */
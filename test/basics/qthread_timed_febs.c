@@ -0,0 +1,163 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <pthread.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+
+/* readFE, readFF and writeEF with timeouts, on FEBs and syncvars: waits that
+ * run out, waits that are satisfied in time, and a lot of each racing the
+ * other. */
+
+#define MS (UINT64_C(1000000))
+
+static aligned_t feb;
+static syncvar_t sv = SYNCVAR_EMPTY_INITIALIZER;
+static aligned_t total;
+
+static aligned_t late_fill(void *arg) {
+  qthread_sleep(5 * MS);
+  qthread_writeF_const(&feb, 42);
+  qthread_syncvar_writeF_const(&sv, 43);
+  return 0;
+}
+
+static aligned_t late_empty(void *arg) {
+  qthread_sleep(5 * MS);
+  qthread_readFE(NULL, &feb);
+  qthread_syncvar_readFE(NULL, &sv);
+  return 0;
+}
+
+/* keeps retrying with timeouts too short to be sure of anything */
+static aligned_t consumer(void *arg) {
+  aligned_t v;
+
+  while (qthread_readFE_timed(&v, &feb, MS) == ETIMEDOUT) {}
+  qthread_incr(&total, v);
+  return 0;
+}
+
+static aligned_t sv_consumer(void *arg) {
+  uint64_t v;
+
+  while (qthread_syncvar_readFE_timed(&v, &sv, MS) == ETIMEDOUT) {}
+  qthread_incr(&total, (aligned_t)v);
+  return 0;
+}
+
+static void *external(void *arg) {
+  aligned_t v;
+  uint64_t sv_v;
+
+  assert(qthread_readFE_timed(&v, &feb, 2 * MS) == ETIMEDOUT);
+  assert(qthread_syncvar_readFF_timed(&sv_v, &sv, 2 * MS) ==
+         ETIMEDOUT);
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t nconsumers = 64;
+  aligned_t rets[64];
+  aligned_t ret;
+  aligned_t v;
+  uint64_t sv_v;
+  pthread_t thread;
+  aligned_t expected = 0;
+  qtimer_t timer = qtimer_create();
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(nconsumers, "NUM_CONSUMERS");
+  if (nconsumers > 64) { nconsumers = 64; }
+
+  /* nobody comes: the waits run out, and leave nothing behind */
+  qthread_empty(&feb);
+  qtimer_start(timer);
+  assert(qthread_readFE_timed(&v, &feb, 10 * MS) == ETIMEDOUT);
+  qtimer_stop(timer);
+  iprintf("readFE timed out after %f secs\n", qtimer_secs(timer));
+  assert(qtimer_secs(timer) >= 0.0099);
+  assert(qthread_readFF_timed(&v, &feb, MS) == ETIMEDOUT);
+  assert(qthread_syncvar_readFE_timed(&sv_v, &sv, MS) == ETIMEDOUT);
+  assert(qthread_syncvar_readFF_timed(&sv_v, &sv, MS) == ETIMEDOUT);
+  assert(qthread_feb_status(&feb) == 0);
+  assert(qthread_syncvar_status(&sv) == 0);
+  assert(qthread_readFE_timed(&v, &feb, 0) == ETIMEDOUT);
+  assert(pthread_create(&thread, NULL, external, NULL) == 0);
+  pthread_join(thread, NULL);
+
+  qthread_writeF_const(&feb, 1);
+  qthread_syncvar_writeF_const(&sv, 1);
+  assert(qthread_writeEF_const_timed(&feb, 2, MS) == ETIMEDOUT);
+  assert(qthread_syncvar_writeEF_const_timed(&sv, 2, MS) == ETIMEDOUT);
+  assert(qthread_writeEF_const_timed(&feb, 2, 0) == ETIMEDOUT);
+  qthread_readFF(&v, &feb);
+  assert(v == 1);
+  qthread_syncvar_readFF(&sv_v, &sv);
+  assert(sv_v == 1);
+
+  /* no waiting needed */
+  assert(qthread_readFF_timed(&v, &feb, 0) == QTHREAD_SUCCESS);
+  assert(v == 1);
+  assert(qthread_readFE_timed(&v, &feb, 0) == QTHREAD_SUCCESS);
+  assert(v == 1 && qthread_feb_status(&feb) == 0);
+  assert(qthread_writeEF_const_timed(&feb, 3, 0) == QTHREAD_SUCCESS);
+  assert(qthread_syncvar_readFE_timed(&sv_v, &sv, 0) == QTHREAD_SUCCESS);
+  assert(sv_v == 1);
+  assert(qthread_syncvar_writeEF_const_timed(&sv, 3, 0) == QTHREAD_SUCCESS);
+
+  /* somebody comes in time */
+  qthread_fork(late_empty, NULL, &ret);
+  assert(qthread_writeEF_const_timed(&feb, 4, 1000 * MS) == QTHREAD_SUCCESS);
+  assert(qthread_syncvar_writeEF_const_timed(&sv, 4, 1000 * MS) ==
+         QTHREAD_SUCCESS);
+  qthread_readFF(NULL, &ret);
+  qthread_readFE(&v, &feb);
+  assert(v == 4);
+  qthread_syncvar_readFE(&sv_v, &sv);
+  assert(sv_v == 4);
+  qthread_fork(late_fill, NULL, &ret);
+  assert(qthread_readFF_timed(&v, &feb, 1000 * MS) == QTHREAD_SUCCESS);
+  assert(v == 42);
+  assert(qthread_readFE_timed(&v, &feb, 1000 * MS) == QTHREAD_SUCCESS);
+  assert(v == 42 && qthread_feb_status(&feb) == 0);
+  assert(qthread_syncvar_readFE_timed(&sv_v, &sv, 1000 * MS) ==
+         QTHREAD_SUCCESS);
+  assert(sv_v == 43);
+  qthread_readFF(NULL, &ret);
+
+  /* timeouts racing the writes: every value is taken exactly once */
+  total = 0;
+  for (aligned_t i = 0; i < nconsumers; ++i) {
+    qthread_fork(consumer, NULL, &rets[i]);
+  }
+  for (aligned_t i = 1; i <= nconsumers; ++i) {
+    if (i % 4 == 0) { qthread_sleep(MS); }
+    qthread_writeEF_const(&feb, i);
+    expected += i;
+  }
+  for (aligned_t i = 0; i < nconsumers; ++i) { qthread_readFF(NULL, &rets[i]); }
+  assert(total == expected);
+  assert(qthread_feb_status(&feb) == 0);
+  total = 0;
+  for (aligned_t i = 0; i < nconsumers; ++i) {
+    qthread_fork(sv_consumer, NULL, &rets[i]);
+  }
+  for (aligned_t i = 1; i <= nconsumers; ++i) {
+    if (i % 4 == 0) { qthread_sleep(MS); }
+    qthread_syncvar_writeEF_const(&sv, i);
+  }
+  for (aligned_t i = 0; i < nconsumers; ++i) { qthread_readFF(NULL, &rets[i]); }
+  assert(total == expected);
+  iprintf("%lu consumers each got one value\n", (unsigned long)nconsumers);
+
+  qtimer_destroy(timer);
+  return 0;
+}
+
+/* vim:set expandtab */
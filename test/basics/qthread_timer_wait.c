@@ -66,7 +66,7 @@ static int test1(void) {
   return status;
 }
 
-static void qthread_sleep(double secs) {
+static void yield_for(double secs) {
   qtimer_t t = qtimer_create();
   qtimer_start(t);
   do {
@@ -77,7 +77,7 @@ static void qthread_sleep(double secs) {
 }
 
 static aligned_t task(void *arg) {
-  qthread_sleep(t_short);
+  yield_for(t_short);
   // atomic equivalent of check *= 2;
   int check_local = atomic_load_explicit(&check, memory_order_relaxed);
   while (atomic_compare_exchange_weak_explicit(&check,
@@ -93,7 +93,7 @@ static int test2(void) {
   aligned_t ret;
   status &= qthread_fork(task, NULL, &ret);
   atomic_fetch_add_explicit(&check, 1, memory_order_relaxed);
-  qthread_sleep(t_long);
+  yield_for(t_long);
   atomic_fetch_sub_explicit(&check, 2, memory_order_relaxed);
   qthread_readFF(NULL, &ret);
   return status;
@@ -0,0 +1,101 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+
+#define MS (UINT64_C(1000000))
+
+static aligned_t ticks = 0;
+static aligned_t fired;
+static double fired_at;
+
+static aligned_t sleeper(void *arg) {
+  qthread_sleep((uint64_t)(uintptr_t)arg);
+  return 0;
+}
+
+static aligned_t tick(void *arg) {
+  qthread_incr(&ticks, 1);
+  return 0;
+}
+
+static aligned_t once(void *arg) {
+  fired_at = qtimer_wtime();
+  qthread_writeF_const(&fired, 1);
+  return 0;
+}
+
+static aligned_t never(void *arg) {
+  assert(0 && "fired before its time");
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t nsleepers = 100;
+  aligned_t rets[100];
+  qthread_timer_t periodic;
+  aligned_t before, after;
+  double start;
+  qtimer_t timer = qtimer_create();
+
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+
+  /* the main task sleeps at least as long as it asked to */
+  qtimer_start(timer);
+  assert(qthread_sleep(10 * MS) == QTHREAD_SUCCESS);
+  qtimer_stop(timer);
+  iprintf("slept 10ms in %f secs\n", qtimer_secs(timer));
+  assert(qtimer_secs(timer) >= 0.0099);
+
+  /* sleepers don't hold on to their workers: with one worker, this would
+   * take two seconds if they did (with more, on an oversubscribed machine,
+   * it can take that long anyway) */
+  qtimer_start(timer);
+  for (aligned_t i = 0; i < nsleepers; ++i) {
+    qthread_fork(sleeper, (void *)(uintptr_t)(20 * MS), &rets[i]);
+  }
+  for (aligned_t i = 0; i < nsleepers; ++i) { qthread_readFF(NULL, &rets[i]); }
+  qtimer_stop(timer);
+  iprintf("%lu tasks slept 20ms in %f secs\n",
+          (unsigned long)nsleepers,
+          qtimer_secs(timer));
+  assert(qtimer_secs(timer) >= 0.0199);
+  if (qthread_num_workers() == 1) { assert(qtimer_secs(timer) < 1.0); }
+
+  /* one-shot */
+  qthread_empty(&fired);
+  start = qtimer_wtime();
+  assert(qthread_spawn_after(15 * MS, once, NULL) == QTHREAD_SUCCESS);
+  qthread_readFF(NULL, &fired);
+  iprintf("spawn_after(15ms) ran after %f secs\n", fired_at - start);
+  assert(fired_at - start >= 0.0149);
+
+  /* periodic, until cancelled */
+  start = qtimer_wtime();
+  assert(qthread_spawn_periodic(5 * MS, tick, NULL, &periodic) ==
+         QTHREAD_SUCCESS);
+  while (qthread_incr(&ticks, 0) < 5) { qthread_sleep(MS); }
+  iprintf("5 periods of 5ms in %f secs\n", qtimer_wtime() - start);
+  assert(qtimer_wtime() - start >= 0.0249);
+  assert(qthread_timer_cancel(periodic) == QTHREAD_SUCCESS);
+  qthread_sleep(20 * MS); /* let any run that was in flight finish */
+  before = qthread_incr(&ticks, 0);
+  qthread_sleep(30 * MS);
+  after = qthread_incr(&ticks, 0);
+  assert(before == after);
+
+  /* still pending at qthread_finalize() */
+  assert(qthread_spawn_after(3600 * 1000 * MS, never, NULL) ==
+         QTHREAD_SUCCESS);
+
+  qtimer_destroy(timer);
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,75 @@
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> /* for __rdtsc() */
+#define HAVE_TSC 1
+#endif
+
+// Context-switch cost: two tasks on a single shepherd with a single worker
+// take turns yielding, so every qthread_yield() is a switch out to the
+// shepherd and into the other task. One "yield-pair" is a yield by each of
+// the two tasks. Timing starts once both have been spawned and are waiting.
+
+static size_t ITERATIONS = 1000000;
+static aligned_t running;
+static aligned_t go;
+
+static aligned_t yielder(void *arg) {
+  qthread_incr(&running, 1);
+  qthread_readFF(NULL, &go);
+  for (size_t i = 0; i < ITERATIONS; ++i) { qthread_yield(); }
+  return 0;
+}
+
+static void run(char const *name, unsigned int flags) {
+  qtimer_t timer = qtimer_create();
+  aligned_t rets[2];
+  double secs;
+
+  running = 0;
+  qthread_empty(&go);
+  for (int i = 0; i < 2; ++i) {
+    int const ret = qthread_spawn(yielder, NULL, 0, &rets[i], 0, NULL, 0, flags);
+    assert(ret == QTHREAD_SUCCESS);
+  }
+  while (running < 2) { qthread_yield(); }
+
+#ifdef HAVE_TSC
+  unsigned long long const start = __rdtsc();
+#endif
+  qtimer_start(timer);
+  qthread_fill(&go);
+  for (int i = 0; i < 2; ++i) { qthread_readFF(NULL, &rets[i]); }
+  qtimer_stop(timer);
+  secs = qtimer_secs(timer);
+#ifdef HAVE_TSC
+  printf("%-12s %8.1f ns  %8.1f cycles per yield-pair\n",
+         name,
+         secs * 1e9 / ITERATIONS,
+         (double)(__rdtsc() - start) / ITERATIONS);
+#else
+  printf("%-12s %8.1f ns per yield-pair\n", name, secs * 1e9 / ITERATIONS);
+#endif
+  qtimer_destroy(timer);
+}
+
+int main(int argc, char *argv[]) {
+  /* a second worker would run the two tasks side by side */
+  setenv("QT_NUM_SHEPHERDS", "1", 1);
+  setenv("QT_NUM_WORKERS_PER_SHEPHERD", "1", 1);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  NUMARG(ITERATIONS, "ITERATIONS");
+
+  run("default", 0);
+  run("fixed-fpenv", QTHREAD_SPAWN_FIXED_FPENV);
+  run("default", 0);
+  run("fixed-fpenv", QTHREAD_SPAWN_FIXED_FPENV);
+
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -46,6 +46,8 @@ static aligned_t validation[] = {
   39088169  // 38
 };
 
+static unsigned int spawn_flags = QTHREAD_SPAWN_RET_SYNCVAR_T;
+
 static aligned_t fib(void *arg_) {
   unsigned int n = *(unsigned int *)arg_;
 
@@ -56,9 +58,9 @@ static aligned_t fib(void *arg_) {
   unsigned int n1 = n - 1;
   unsigned int n2 = n - 2;
 
-  qthread_fork_syncvar(fib, &n1, &ret1);
-  qthread_fork_syncvar(fib, &n2, &ret2);
-  qthread_yield_near();
+  qthread_spawn(fib, &n1, 0, &ret1, 0, NULL, NO_SHEPHERD, spawn_flags);
+  qthread_spawn(fib, &n2, 0, &ret2, 0, NULL, NO_SHEPHERD, spawn_flags);
+  if (!(spawn_flags & QTHREAD_SPAWN_WORK_FIRST)) { qthread_yield_near(); }
 
   qthread_syncvar_readFF(NULL, &ret1);
   qthread_syncvar_readFF(NULL, &ret2);
@@ -70,11 +72,14 @@ int main(int argc, char *argv[]) {
   qtimer_t timer = qtimer_create();
   aligned_t n = 20;
   aligned_t ret = 0;
+  aligned_t work_first = 0;
 
   /* setup */
   assert(qthread_initialize() == QTHREAD_SUCCESS);
   CHECK_VERBOSE();
   NUMARG(n, "FIB_INPUT");
+  NUMARG(work_first, "WORK_FIRST");
+  if (work_first) { spawn_flags |= QTHREAD_SPAWN_WORK_FIRST; }
 
   qtimer_start(timer);
   qthread_fork(fib, &n, &ret);
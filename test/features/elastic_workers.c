@@ -0,0 +1,80 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h> /* for usleep() */
+
+static aligned_t spin(void *arg) {
+  qtimer_t t = qtimer_create();
+
+  qtimer_start(t);
+  do { qtimer_stop(t); } while (qtimer_secs(t) < 0.02);
+  qtimer_destroy(t);
+  return 0;
+}
+
+/* wait up to five seconds for the worker count to satisfy cond */
+#define WAIT_FOR(cond)                                                         \
+  for (int tries = 0; !(cond) && tries < 5000; tries++) { usleep(1000); }
+
+int main(int argc, char *argv[]) {
+  qthread_shepherd_id_t nsheps;
+  qthread_worker_id_t total;
+  aligned_t *rets;
+  size_t ntasks;
+
+  setenv("QT_ELASTIC", "yes", 0);
+  setenv("QT_ELASTIC_INTERVAL", "1", 0);
+  setenv("QT_ELASTIC_IDLE", "5", 0);
+  /* the single-worker schedulers refuse more than one worker per shepherd,
+   * and with only one there is nothing to scale */
+#if !defined(SCHEDULER_nemesis) && !defined(SCHEDULER_lifo) &&                \
+  !defined(SCHEDULER_mutexfifo) && !defined(SCHEDULER_mtsfifo) &&              \
+  !defined(SCHEDULER_mdlifo)
+  if (!getenv("QT_NUM_WORKERS_PER_SHEPHERD") && !getenv("QT_HWPAR")) {
+    setenv("QT_NUM_SHEPHERDS", "1", 0);
+    setenv("QT_NUM_WORKERS_PER_SHEPHERD", "4", 0);
+  }
+#endif
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+
+  nsheps = qthread_num_shepherds();
+  total = nsheps * qthread_num_workers_local(0);
+  iprintf("%i shepherds, %i of %i workers\n",
+          (int)nsheps,
+          (int)qthread_num_workers(),
+          (int)total);
+  if (total == nsheps) {
+    iprintf("only one worker per shepherd; nothing to scale\n");
+    return 0;
+  }
+
+  /* nothing to do: the controller should shrink to one worker per shepherd */
+  WAIT_FOR(qthread_num_workers() == nsheps);
+  iprintf("idle: %i workers\n", (int)qthread_num_workers());
+  assert(qthread_num_workers() == nsheps);
+
+  /* a backlog: it should grow again */
+  ntasks = 8 * total;
+  rets = malloc(ntasks * sizeof(aligned_t));
+  assert(rets);
+  for (size_t i = 0; i < ntasks; i++) {
+    assert(qthread_fork(spin, NULL, &rets[i]) == QTHREAD_SUCCESS);
+  }
+  WAIT_FOR(qthread_num_workers() > nsheps);
+  iprintf("busy: %i workers\n", (int)qthread_num_workers());
+  assert(qthread_num_workers() > nsheps);
+  for (size_t i = 0; i < ntasks; i++) { qthread_readFF(NULL, &rets[i]); }
+  free(rets);
+
+  return 0;
+}
+
+/* vim:set expandtab */
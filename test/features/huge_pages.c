@@ -0,0 +1,75 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  aligned_t value;
+  char pad[200];
+} payload_t;
+
+/* Use some stack, so that every stack in the huge-page chunks gets touched. */
+static aligned_t plain(void *arg) {
+  volatile unsigned char buf[2048];
+  aligned_t sum = 0;
+
+  for (size_t i = 0; i < sizeof(buf); ++i) { buf[i] = (unsigned char)i; }
+  for (size_t i = 0; i < sizeof(buf); ++i) { sum += buf[i]; }
+  return (aligned_t)(uintptr_t)arg + sum;
+}
+
+/* Runs on a descriptor from one of the argument-copy pools. */
+static aligned_t copied(void *arg) {
+  payload_t const *p = arg;
+
+  for (size_t i = 0; i < sizeof(p->pad); ++i) {
+    if (p->pad[i] != (char)p->value) { return 0; }
+  }
+  return p->value;
+}
+
+int main(int argc, char *argv[]) {
+  size_t ntasks = 5000;
+  aligned_t *rets;
+  aligned_t const stacksum = 255 * 128 * 8; /* sum of buf[] in plain() */
+
+  setenv("QT_HUGE_PAGES", "yes", 0);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(ntasks, "NUM_TASKS");
+
+  rets = calloc(ntasks, sizeof(aligned_t));
+  assert(rets);
+
+  for (int round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < ntasks; ++i) {
+      int ret;
+
+      if (i & 1) {
+        payload_t p;
+
+        p.value = i;
+        for (size_t j = 0; j < sizeof(p.pad); ++j) { p.pad[j] = (char)i; }
+        ret = qthread_fork_copyargs(copied, &p, sizeof(p), &rets[i]);
+      } else {
+        ret = qthread_fork(plain, (void *)(uintptr_t)i, &rets[i]);
+      }
+      assert(ret == QTHREAD_SUCCESS);
+    }
+    for (size_t i = 0; i < ntasks; ++i) {
+      qthread_readFF(NULL, &rets[i]);
+      assert(rets[i] == ((i & 1) ? i : i + stacksum));
+    }
+    iprintf("round %d: %lu tasks ok\n", round, (unsigned long)ntasks);
+  }
+
+  free(rets);
+  return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,86 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSHALLOW 100
+#define NDEEP 10
+#define DEEP_BYTES 16384
+
+static aligned_t shallow(void *arg) { return (aligned_t)(uintptr_t)arg; }
+
+static aligned_t deep(void *arg) {
+  volatile char buf[DEEP_BYTES];
+
+  memset((char *)buf, 1, sizeof(buf));
+  return buf[(uintptr_t)arg % DEEP_BYTES];
+}
+
+static qthread_stack_profile_t const *find(qthread_stack_profile_t const *p,
+                                           size_t n,
+                                           qthread_f f) {
+  for (size_t i = 0; i < n; i++) {
+    if (p[i].f == f) { return &p[i]; }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  static aligned_t rets[NSHALLOW + NDEEP];
+  qthread_stack_profile_t profiles[8];
+  qthread_stack_profile_t const *s = NULL, *d = NULL;
+  size_t n = 0;
+
+  setenv("QT_STACK_PROFILE", "yes", 0);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+
+  for (size_t i = 0; i < NSHALLOW; i++) {
+    assert(qthread_fork(shallow, (void *)(uintptr_t)i, &rets[i]) ==
+           QTHREAD_SUCCESS);
+  }
+  for (size_t i = 0; i < NDEEP; i++) {
+    assert(qthread_fork(deep, (void *)(uintptr_t)i, &rets[NSHALLOW + i]) ==
+           QTHREAD_SUCCESS);
+  }
+  for (size_t i = 0; i < NSHALLOW + NDEEP; i++) {
+    qthread_readFF(NULL, &rets[i]);
+  }
+  /* a task is profiled once it is back in its worker's scheduler loop,
+   * which may be a little after its return value is written */
+  for (int tries = 0; tries < 100000; tries++) {
+    n = qthread_stack_profile(profiles, 8);
+    s = find(profiles, n, shallow);
+    d = find(profiles, n, deep);
+    if (s && d && (s->ntasks == NSHALLOW) && (d->ntasks == NDEEP)) { break; }
+    qthread_yield();
+  }
+  assert(s && d);
+  iprintf("shallow: %lu tasks, max %lu; deep: %lu tasks, max %lu\n",
+          (unsigned long)s->ntasks,
+          (unsigned long)s->max_used,
+          (unsigned long)d->ntasks,
+          (unsigned long)d->max_used);
+  assert(s->ntasks == NSHALLOW);
+  assert(d->ntasks == NDEEP);
+  assert(d->max_used >= DEEP_BYTES);
+  assert(d->max_used <= d->stack_size);
+  assert(s->max_used < d->max_used);
+  {
+    size_t total = 0;
+    for (int b = 0; b < QTHREAD_STACK_PROFILE_BUCKETS; b++) {
+      total += d->histogram[b];
+    }
+    assert(total == NDEEP);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set expandtab */
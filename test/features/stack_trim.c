@@ -0,0 +1,68 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* for usleep() */
+
+static aligned_t gate;
+
+/* Fill part of the stack, block, and make sure it survived; run on stacks
+ * whose pages have been handed back to the OS, this also checks that they
+ * come back usable. */
+static aligned_t blocker(void *arg) {
+  volatile unsigned char buf[4096];
+  unsigned char const pattern = (unsigned char)(uintptr_t)arg;
+
+  for (size_t i = 0; i < sizeof(buf); ++i) { buf[i] = pattern; }
+  qthread_readFF(NULL, &gate);
+  for (size_t i = 0; i < sizeof(buf); ++i) {
+    if (buf[i] != pattern) { return 1; }
+  }
+  return 0;
+}
+
+static void burst(aligned_t *rets, size_t ntasks) {
+  qthread_empty(&gate);
+  for (size_t i = 0; i < ntasks; ++i) {
+    int ret = qthread_fork(blocker, (void *)(uintptr_t)(i + 1), &rets[i]);
+    assert(ret == QTHREAD_SUCCESS);
+  }
+  qthread_yield();
+  qthread_fill(&gate);
+  for (size_t i = 0; i < ntasks; ++i) {
+    qthread_readFF(NULL, &rets[i]);
+    assert(rets[i] == 0);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t ntasks = 2000;
+  aligned_t *rets;
+
+  setenv("QT_STACK_TRIM", "5", 0);
+  setenv("QT_STACK_CACHE", "2", 0);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(ntasks, "NUM_TASKS");
+
+  rets = calloc(ntasks, sizeof(aligned_t));
+  assert(rets);
+
+  for (int round = 0; round < 3; ++round) {
+    burst(rets, ntasks);
+    /* give the trimmer time to get to the stacks */
+    usleep(50000);
+    iprintf("round %d passed\n", round);
+  }
+
+  free(rets);
+  return 0;
+}
+
+/* vim:set expandtab */
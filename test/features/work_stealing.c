@@ -0,0 +1,66 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "argparsing.h"
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Every task piles onto shepherd 0 and then makes itself stealable again;
+ * the other shepherds have nothing to do but take work from shepherd 0. */
+
+static aligned_t yields = 1000;
+static aligned_t moved = 0;
+
+static aligned_t task(void *arg) {
+  int elsewhere = 0;
+
+  qthread_migrate_to(0);
+  qthread_migrate_to(NO_SHEPHERD);
+  for (aligned_t i = 0; i < yields; ++i) {
+    qthread_yield();
+    if (qthread_shep() != 0) { elsewhere = 1; }
+  }
+  if (elsewhere) { qthread_incr(&moved, 1); }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  aligned_t ntasks = 256;
+  aligned_t *rets;
+  qtimer_t timer = qtimer_create();
+
+  setenv("QT_NUM_SHEPHERDS", "2", 0);
+  assert(qthread_initialize() == QTHREAD_SUCCESS);
+  CHECK_VERBOSE();
+  NUMARG(ntasks, "NUM_TASKS");
+  NUMARG(yields, "NUM_YIELDS");
+  rets = malloc(ntasks * sizeof(aligned_t));
+  assert(rets);
+
+  qtimer_start(timer);
+  for (aligned_t i = 0; i < ntasks; ++i) { qthread_fork(task, NULL, &rets[i]); }
+  for (aligned_t i = 0; i < ntasks; ++i) { qthread_readFF(NULL, &rets[i]); }
+  qtimer_stop(timer);
+  iprintf("%lu of %lu tasks on %u shepherds were stolen from shepherd 0 "
+          "(%f secs)\n",
+          (unsigned long)moved,
+          (unsigned long)ntasks,
+          (unsigned)qthread_num_shepherds(),
+          qtimer_secs(timer));
+
+#ifdef SCHEDULER_nemesis
+  /* the other schedulers have their own stealing policies and knobs; this
+   * checks that nemesis steals at all */
+  if (qthread_num_shepherds() > 1) { assert(moved > 0); }
+#endif
+
+  free(rets);
+  qtimer_destroy(timer);
+  return 0;
+}
+
+/* vim:set expandtab */
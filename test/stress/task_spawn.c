@@ -35,6 +35,12 @@ int main(int argc, char *argv[]) {
   } while (donecount != count);
   iprintf("manually spawned and sync'd %u threads\n", (unsigned)count);
 
+  donecount = 0;
+  assert(qthread_spawn_bulk(null_task, NULL, 0, NULL, count, NO_SHEPHERD, 0) ==
+         QTHREAD_SUCCESS);
+  while (donecount != count) { qthread_yield(); }
+  iprintf("bulk spawned and sync'd %u threads\n", (unsigned)count);
+
   qt_loop(0, count, par_null_task, NULL);
   iprintf("automatically spawned and sync'd %u threads\n", (unsigned)count);
 